@@ -1,8 +1,9 @@
 #version 450
 
 #include "utils.glsl"
+#include "vertex_format.glsl"
 
-layout(location = 0) in vec3 in_pos;
+layout(location = 0) in vec4 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_uv;
 layout(location = 3) in vec4 in_tangent_bitangent_sign;
@@ -16,22 +17,26 @@ layout(location = 4) out vec3 out_tangent;
 layout(location = 5) out vec3 out_bitangent;
 layout(location = 6) out vec4 out_prev_camera_position;
 layout(location = 7) out vec4 out_camera_position;
+layout(location = 8) flat out uvec4 out_texture_layers;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
 uniform mat4 model;
+uniform uvec4 texture_layers;
 
 void main() {
-    const vec4 position = model * vec4(in_pos, 1.0);
+    const vec4 position = model * vec4(decode_position(in_pos), 1.0);
+    const vec4 tangent_bitangent_sign = decode_tangent(in_pos, in_tangent_bitangent_sign);
 
-    out_normal = normalize(mat3(model) * in_normal);
-    out_tangent = normalize(mat3(model) * in_tangent_bitangent_sign.xyz);
-    out_bitangent = cross(out_tangent, out_normal) * (in_tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
+    out_normal = normalize(mat3(model) * decode_normal(in_normal));
+    out_tangent = normalize(mat3(model) * tangent_bitangent_sign.xyz);
+    out_bitangent = cross(out_tangent, out_normal) * (tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
 
     out_uv = in_uv;
     out_color = in_color;
+    out_texture_layers = texture_layers;
     out_position = position.xyz;
     out_prev_camera_position = frame.camera.prev_view_proj * position;
     out_camera_position = frame.camera.view_proj * position;
@@ -0,0 +1,26 @@
+#version 450
+
+#include "utils.glsl"
+#include "vertex_format.glsl"
+
+layout(location = 0) in vec4 in_pos;
+layout(location = 5) in uint in_instance;
+
+layout(binding = 0) uniform Data {
+    FrameData frame;
+};
+
+layout(binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+// Must match the depth of the full vertex shaders exactly for the passes that follow
+invariant gl_Position;
+
+void main() {
+    const mat4 model = instances[in_instance].model;
+    const vec4 position = model * vec4(decode_position(in_pos), 1.0);
+
+    gl_Position = frame.camera.view_proj * position;
+}
+
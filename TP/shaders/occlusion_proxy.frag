@@ -0,0 +1,6 @@
+#version 450
+
+// Depth only, proxies are drawn for occlusion queries
+void main() {
+}
+
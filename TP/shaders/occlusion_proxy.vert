@@ -0,0 +1,16 @@
+#version 450
+
+#include "utils.glsl"
+
+layout(location = 0) in vec3 in_pos;
+layout(location = 1) in vec3 in_center;
+layout(location = 2) in vec3 in_extent;
+
+layout(binding = 0) uniform Data {
+    FrameData frame;
+};
+
+void main() {
+    gl_Position = frame.camera.view_proj * vec4(in_center + in_pos * in_extent, 1.0);
+}
+
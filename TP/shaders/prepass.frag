@@ -16,9 +16,11 @@ layout(location = 4) in vec3 in_tangent;
 layout(location = 5) in vec3 in_bitangent;
 layout(location = 6) in vec4 in_prev_camera_position;
 layout(location = 7) in vec4 in_camera_position;
+layout(location = 8) flat in uvec4 in_texture_layers;
 
-layout(binding = 0) uniform sampler2D in_texture;
-layout(binding = 1) uniform sampler2D in_normal_texture;
+// Materials sample one layer of each array
+layout(binding = 0) uniform sampler2DArray in_texture;
+layout(binding = 1) uniform sampler2DArray in_normal_texture;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
@@ -32,7 +34,8 @@ const vec3 ambient = vec3(0.0);
 
 void main() {
 #ifdef NORMAL_MAPPED
-    const vec3 normal_map = unpack_normal_map(texture(in_normal_texture, in_uv).xy);
+    const vec2 normal_texel = texture(in_normal_texture, vec3(in_uv, in_texture_layers.y)).xy;
+    const vec3 normal_map = unpack_normal_map(normal_texel);
     const vec3 normal = normal_map.x * in_tangent +
                         normal_map.y * in_bitangent +
                         normal_map.z * in_normal;
@@ -46,6 +49,6 @@ void main() {
     gVelocity = (current_pos - frame.camera.jitter) - (previous_pos - frame.camera.prev_jitter);
 
 #ifdef TEXTURED
-    gAlbedo *= texture(in_texture, in_uv);
+    gAlbedo *= texture(in_texture, vec3(in_uv, in_texture_layers.x));
 #endif
 }
\ No newline at end of file
@@ -13,9 +13,10 @@ layout(location = 2) in vec3 in_color;
 layout(location = 3) in vec3 in_position;
 layout(location = 4) in vec3 in_tangent;
 layout(location = 5) in vec3 in_bitangent;
+layout(location = 8) flat in uvec4 in_texture_layers;
 
-layout(binding = 0) uniform sampler2D in_texture;
-layout(binding = 1) uniform sampler2D in_normal_texture;
+layout(binding = 0) uniform sampler2DArray in_texture;
+layout(binding = 1) uniform sampler2DArray in_normal_texture;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
@@ -29,7 +30,8 @@ const vec3 ambient = vec3(0.0);
 
 void main() {
 #ifdef NORMAL_MAPPED
-    const vec3 normal_map = unpack_normal_map(texture(in_normal_texture, in_uv).xy);
+    const vec2 normal_texel = texture(in_normal_texture, vec3(in_uv, in_texture_layers.y)).xy;
+    const vec3 normal_map = unpack_normal_map(normal_texel);
     const vec3 normal = normal_map.x * in_tangent +
                         normal_map.y * in_bitangent +
                         normal_map.z * in_normal;
@@ -1,13 +1,14 @@
 #version 450
 
 #include "utils.glsl"
+#include "vertex_format.glsl"
 
-layout(location = 0) in vec3 in_pos;
+layout(location = 0) in vec4 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_uv;
 layout(location = 3) in vec4 in_tangent_bitangent_sign;
 layout(location = 4) in vec3 in_color;
-layout(location = 5) in mat4 model;
+layout(location = 5) in uint in_instance;
 
 layout(location = 0) out vec3 out_normal;
 layout(location = 1) out vec2 out_uv;
@@ -17,20 +18,36 @@ layout(location = 4) out vec3 out_tangent;
 layout(location = 5) out vec3 out_bitangent;
 layout(location = 6) out vec4 out_prev_camera_position;
 layout(location = 7) out vec4 out_camera_position;
+layout(location = 8) flat out uvec4 out_texture_layers;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
+layout(binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+layout(binding = 3) readonly buffer Materials {
+    MaterialData materials[];
+};
+
+// Same depth as depth.vert
+invariant gl_Position;
+
 void main() {
-    const vec4 position = model * vec4(in_pos, 1.0);
+    const InstanceData instance = instances[in_instance];
+    const mat4 model = instance.model;
+    const vec4 position = model * vec4(decode_position(in_pos), 1.0);
+    const vec4 tangent_bitangent_sign = decode_tangent(in_pos, in_tangent_bitangent_sign);
 
-    out_normal = normalize(mat3(model) * in_normal);
-    out_tangent = normalize(mat3(model) * in_tangent_bitangent_sign.xyz);
-    out_bitangent = cross(out_tangent, out_normal) * (in_tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
+    out_normal = normalize(mat3(model) * decode_normal(in_normal));
+    out_tangent = normalize(mat3(model) * tangent_bitangent_sign.xyz);
+    out_bitangent = cross(out_tangent, out_normal) * (tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
 
     out_uv = in_uv;
     out_color = in_color;
+    out_texture_layers = materials[instance.material].texture_layers;
     out_position = position.xyz;
     out_prev_camera_position = frame.camera.prev_view_proj * position;
     out_camera_position = frame.camera.view_proj * position;
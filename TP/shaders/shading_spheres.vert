@@ -1,8 +1,9 @@
 #version 450
 
 #include "utils.glsl"
+#include "vertex_format.glsl"
 
-layout(location = 0) in vec3 in_pos;
+layout(location = 0) in vec4 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_uv;
 layout(location = 3) in vec4 in_tangent_bitangent_sign;
@@ -21,7 +22,7 @@ layout(binding = 0) uniform Data {
 };
 
 void main() {
-    const vec4 position = model * vec4(in_pos, 1.0);
+    const vec4 position = model * vec4(decode_position(in_pos), 1.0);
 
     out_light_pos = light_pos;
     out_light_color = light_color;
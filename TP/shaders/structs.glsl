@@ -26,3 +26,17 @@ struct TAASettings {
     uvec2 window_size;
     uvec2 padding_1;
 };
+
+struct InstanceData {
+    mat4 model;
+    // Index in the material table
+    uint material;
+    uint padding_1;
+    uint padding_2;
+    uint padding_3;
+};
+
+struct MaterialData {
+    // Layers of the texture arrays bound to units 0 to 3
+    uvec4 texture_layers;
+};
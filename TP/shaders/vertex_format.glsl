@@ -0,0 +1,41 @@
+// Decoding of the mesh vertex formats, see VertexFormat.h
+// Compact vertices store positions relative to the mesh bounds in [0, 1], with the bitangent sign
+// in w, and octahedral encoded normals and tangents.
+
+uniform uint compact_vertices;
+uniform vec3 vertex_position_offset;
+uniform vec3 vertex_position_scale;
+
+vec2 sign_not_zero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 octahedral_decode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * sign_not_zero(v.xy);
+    }
+    return normalize(v);
+}
+
+vec3 decode_position(vec4 pos) {
+    if(compact_vertices != 0) {
+        return vertex_position_offset + pos.xyz * vertex_position_scale;
+    }
+    return pos.xyz;
+}
+
+vec3 decode_normal(vec3 normal) {
+    if(compact_vertices != 0) {
+        return octahedral_decode(normal.xy);
+    }
+    return normal;
+}
+
+// Tangent in xyz and bitangent sign in w
+vec4 decode_tangent(vec4 pos, vec4 tangent) {
+    if(compact_vertices != 0) {
+        return vec4(octahedral_decode(tangent.xy), pos.w > 0.5 ? 1.0 : -1.0);
+    }
+    return tangent;
+}
@@ -0,0 +1,67 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+namespace OM3D {
+
+// Axis aligned bounding box
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool is_empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extent() const {
+        return (max - min) * 0.5f;
+    }
+
+    float surface_area() const {
+        if (is_empty()) {
+            return 0.0f;
+        }
+        const glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    void extend(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void extend(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool operator==(const AABB& other) const {
+        return min == other.min && max == other.max;
+    }
+
+    // Bounds of the box after transformation (Arvo's method)
+    AABB transformed(const glm::mat4& transform) const {
+        if (is_empty()) {
+            return *this;
+        }
+        const glm::vec3 c = glm::vec3(transform * glm::vec4(center(), 1.0f));
+        const glm::vec3 e = extent();
+        glm::vec3 r;
+        for (int i = 0; i != 3; ++i) {
+            r[i] = std::abs(transform[0][i]) * e.x + std::abs(transform[1][i]) * e.y +
+                   std::abs(transform[2][i]) * e.z;
+        }
+        return AABB{c - r, c + r};
+    }
+};
+
+}
+
+#endif // AABB_H
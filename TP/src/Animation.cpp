@@ -0,0 +1,192 @@
+#include "Animation.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+namespace OM3D {
+
+u32 AnimationPlayer::add_node(u32 transform, const glm::vec3& translation,
+                              const glm::quat& rotation, const glm::vec3& scale) {
+    const u32 node = u32(_transforms.size());
+    _transforms.push_back(transform);
+
+    // Padding lanes hold an identity transform
+    const size_t padded = (_transforms.size() + 3) / 4 * 4;
+    _tx.resize(padded, 0.0f);
+    _ty.resize(padded, 0.0f);
+    _tz.resize(padded, 0.0f);
+    _rx.resize(padded, 0.0f);
+    _ry.resize(padded, 0.0f);
+    _rz.resize(padded, 0.0f);
+    _rw.resize(padded, 1.0f);
+    _sx.resize(padded, 1.0f);
+    _sy.resize(padded, 1.0f);
+    _sz.resize(padded, 1.0f);
+    _matrices.resize(padded);
+
+    _tx[node] = translation.x;
+    _ty[node] = translation.y;
+    _tz[node] = translation.z;
+    _rx[node] = rotation.x;
+    _ry[node] = rotation.y;
+    _rz[node] = rotation.z;
+    _rw[node] = rotation.w;
+    _sx[node] = scale.x;
+    _sy[node] = scale.y;
+    _sz[node] = scale.z;
+    return node;
+}
+
+void AnimationPlayer::add_channel(u32 node, AnimationPath path, Interpolation interpolation,
+                                  std::vector<float> times, std::vector<glm::vec4> values,
+                                  float duration) {
+    DEBUG_ASSERT(node < _transforms.size());
+    DEBUG_ASSERT(!times.empty() && times.size() == values.size());
+
+    Channel& channel = _channels.emplace_back();
+    channel.node = node;
+    channel.path = path;
+    channel.interpolation = interpolation;
+    channel.duration = duration;
+    channel.times = std::move(times);
+    channel.values = std::move(values);
+}
+
+bool AnimationPlayer::is_empty() const {
+    return _channels.empty();
+}
+
+size_t AnimationPlayer::node_count() const {
+    return _transforms.size();
+}
+
+void AnimationPlayer::sample(Channel& channel, double time) {
+    const std::vector<float>& times = channel.times;
+    const float t =
+        channel.duration > 0.0f ? float(std::fmod(time, double(channel.duration))) : 0.0f;
+
+    // Keys are only searched forward from last frame's, starting over when the animation loops
+    if (t < times[channel.cursor]) {
+        channel.cursor = 0;
+    }
+    while (channel.cursor + 1 < times.size() && times[channel.cursor + 1] <= t) {
+        ++channel.cursor;
+    }
+
+    const u32 key = channel.cursor;
+    glm::vec4 value = channel.values[key];
+    if (key + 1 < times.size() && t > times[key] &&
+        channel.interpolation == Interpolation::Linear) {
+        const float alpha = (t - times[key]) / (times[key + 1] - times[key]);
+        glm::vec4 next = channel.values[key + 1];
+        if (channel.path == AnimationPath::Rotation && glm::dot(value, next) < 0.0f) {
+            // Shortest path, the quaternion is normalized when building the matrix
+            next = -next;
+        }
+        value += (next - value) * alpha;
+    }
+
+    const u32 node = channel.node;
+    switch (channel.path) {
+        case AnimationPath::Translation:
+            _tx[node] = value.x;
+            _ty[node] = value.y;
+            _tz[node] = value.z;
+            break;
+
+        case AnimationPath::Rotation:
+            _rx[node] = value.x;
+            _ry[node] = value.y;
+            _rz[node] = value.z;
+            _rw[node] = value.w;
+            break;
+
+        case AnimationPath::Scale:
+            _sx[node] = value.x;
+            _sy[node] = value.y;
+            _sz[node] = value.z;
+            break;
+    }
+}
+
+void AnimationPlayer::build_matrices() {
+    const size_t padded = _matrices.size();
+
+#if defined(ANIMATION_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    for (size_t i = 0; i < padded; i += 4) {
+        __m128 x = _mm_loadu_ps(_rx.data() + i);
+        __m128 y = _mm_loadu_ps(_ry.data() + i);
+        __m128 z = _mm_loadu_ps(_rz.data() + i);
+        __m128 w = _mm_loadu_ps(_rw.data() + i);
+
+        // Normalize the quaternions and premultiply them by 2
+        const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                                          _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+        const __m128 scale = _mm_div_ps(two, length2);
+        const __m128 xx = _mm_mul_ps(_mm_mul_ps(x, x), scale);
+        const __m128 yy = _mm_mul_ps(_mm_mul_ps(y, y), scale);
+        const __m128 zz = _mm_mul_ps(_mm_mul_ps(z, z), scale);
+        const __m128 xy = _mm_mul_ps(_mm_mul_ps(x, y), scale);
+        const __m128 xz = _mm_mul_ps(_mm_mul_ps(x, z), scale);
+        const __m128 yz = _mm_mul_ps(_mm_mul_ps(y, z), scale);
+        const __m128 wx = _mm_mul_ps(_mm_mul_ps(w, x), scale);
+        const __m128 wy = _mm_mul_ps(_mm_mul_ps(w, y), scale);
+        const __m128 wz = _mm_mul_ps(_mm_mul_ps(w, z), scale);
+
+        const __m128 sx = _mm_loadu_ps(_sx.data() + i);
+        const __m128 sy = _mm_loadu_ps(_sy.data() + i);
+        const __m128 sz = _mm_loadu_ps(_sz.data() + i);
+
+        // Rows are one component of a column for 4 nodes, transposing gives the column of each node
+        __m128 columns[4][4] = {
+            {_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+             _mm_mul_ps(_mm_add_ps(xy, wz), sx), _mm_mul_ps(_mm_sub_ps(xz, wy), sx), zero},
+            {_mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+             _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+             _mm_mul_ps(_mm_add_ps(yz, wx), sy), zero},
+            {_mm_mul_ps(_mm_add_ps(xz, wy), sz), _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+             _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz), zero},
+            {_mm_loadu_ps(_tx.data() + i), _mm_loadu_ps(_ty.data() + i),
+             _mm_loadu_ps(_tz.data() + i), one},
+        };
+
+        for (u32 c = 0; c != 4; ++c) {
+            _MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+            for (u32 k = 0; k != 4; ++k) {
+                _mm_storeu_ps(&_matrices[i + k][c][0], columns[c][k]);
+            }
+        }
+    }
+#else
+    for (size_t i = 0; i < padded; ++i) {
+        const glm::quat rotation = glm::normalize(glm::quat(_rw[i], _rx[i], _ry[i], _rz[i]));
+        glm::mat4& m = _matrices[i];
+        m = glm::mat4_cast(rotation);
+        m[0] *= _sx[i];
+        m[1] *= _sy[i];
+        m[2] *= _sz[i];
+        m[3] = glm::vec4(_tx[i], _ty[i], _tz[i], 1.0f);
+    }
+#endif
+}
+
+void AnimationPlayer::update(double time, TransformSystem& transforms) {
+    for (Channel& channel : _channels) {
+        sample(channel, time);
+    }
+
+    build_matrices();
+
+    for (size_t i = 0; i != _transforms.size(); ++i) {
+        transforms.set_local(_transforms[i], _matrices[i]);
+    }
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <TransformSystem.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+enum class AnimationPath { Translation, Rotation, Scale };
+
+enum class Interpolation { Step, Linear };
+
+// Keyframe animations of transforms, looping over the duration of their animation.
+// Channels write the translation, rotation and scale of their node, then the local matrices of
+// all animated nodes are built at once, four nodes per SIMD register.
+class AnimationPlayer : NonCopyable {
+
+    struct Channel {
+        u32 node = 0;
+        AnimationPath path = AnimationPath::Translation;
+        Interpolation interpolation = Interpolation::Linear;
+        float duration = 0.0f;
+
+        // Key used last frame, time only moves forward between loops
+        u32 cursor = 0;
+        std::vector<float> times;
+        std::vector<glm::vec4> values;
+    };
+
+    public:
+        AnimationPlayer() = default;
+
+        // Animate a transform starting from its rest pose, returns the animated node index
+        u32 add_node(u32 transform, const glm::vec3& translation, const glm::quat& rotation,
+                     const glm::vec3& scale);
+
+        // Rotations are (x, y, z, w) quaternions, translations and scales ignore w
+        void add_channel(u32 node, AnimationPath path, Interpolation interpolation,
+                         std::vector<float> times, std::vector<glm::vec4> values, float duration);
+
+        bool is_empty() const;
+        size_t node_count() const;
+
+        // Sample every channel at time and write the local matrices of the animated transforms
+        void update(double time, TransformSystem& transforms);
+
+    private:
+        void sample(Channel& channel, double time);
+        void build_matrices();
+
+        std::vector<Channel> _channels;
+        std::vector<u32> _transforms;
+
+        // Translation, rotation and scale of every node as structure of arrays, padded to 4
+        std::vector<float> _tx;
+        std::vector<float> _ty;
+        std::vector<float> _tz;
+        std::vector<float> _rx;
+        std::vector<float> _ry;
+        std::vector<float> _rz;
+        std::vector<float> _rw;
+        std::vector<float> _sx;
+        std::vector<float> _sy;
+        std::vector<float> _sz;
+
+        std::vector<glm::mat4> _matrices;
+};
+
+}
+
+#endif // ANIMATION_H
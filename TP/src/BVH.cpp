@@ -0,0 +1,393 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <iterator>
+#include <queue>
+
+namespace OM3D {
+
+static constexpr u32 bin_count = 16;
+static constexpr u32 min_leaf_size = 2;
+static constexpr u32 max_leaf_size = 8;
+static constexpr u32 all_planes = (1u << FrustumPlanes::plane_count) - 1;
+// Insertions and removals kept before a rebuild, relative to the built object count
+static constexpr size_t max_changes_ratio = 4;
+static constexpr size_t min_changes = 64;
+
+// Returns false if the box is outside the frustum. Planes that fully contain the box are
+// removed from plane_mask so that they are not tested again for the children.
+static bool test_planes(const AABB& box, const FrustumPlanes& frustum, u32& plane_mask) {
+    const glm::vec3 c = box.center();
+    const glm::vec3 e = box.extent();
+    for (u32 p = 0; p != FrustumPlanes::plane_count; ++p) {
+        const u32 bit = 1u << p;
+        if (!(plane_mask & bit)) {
+            continue;
+        }
+        const float s = frustum.nx[p] * c.x + frustum.ny[p] * c.y + frustum.nz[p] * c.z + frustum.d[p];
+        const float r = std::abs(frustum.nx[p]) * e.x + std::abs(frustum.ny[p]) * e.y +
+                        std::abs(frustum.nz[p]) * e.z;
+        if (s + r < 0.0f) {
+            return false;
+        }
+        if (s - r >= 0.0f) {
+            plane_mask &= ~bit;
+        }
+    }
+    return true;
+}
+
+void BVH::clear() {
+    _nodes.clear();
+    _parents.clear();
+    _object_bounds.clear();
+    _indices.clear();
+    _object_leaf.clear();
+    _object_slot.clear();
+    _pending.clear();
+    _holes = _built_count = 0;
+    _built_area = _area = 0.0f;
+}
+
+void BVH::build(const std::vector<AABB>& bounds, const std::vector<u32>& objects) {
+    clear();
+    _object_bounds = bounds;
+    _indices = objects;
+    _object_leaf.assign(bounds.size(), invalid_index);
+    _object_slot.assign(bounds.size(), invalid_index);
+    _built_count = objects.size();
+
+    if (objects.empty()) {
+        return;
+    }
+
+    std::vector<glm::vec3> centroids(bounds.size());
+    for (const u32 object : objects) {
+        centroids[object] = bounds[object].center();
+    }
+
+    _nodes.reserve(2 * objects.size());
+    _parents.reserve(2 * objects.size());
+    build_node(0, u32(objects.size()), centroids);
+
+    for (u32 i = 0; i != _indices.size(); ++i) {
+        _object_slot[_indices[i]] = i;
+    }
+
+    for (const Node& node : _nodes) {
+        _area += node.bounds.surface_area();
+    }
+    _built_area = _area;
+}
+
+u32 BVH::build_node(u32 first, u32 count, std::vector<glm::vec3>& centroids) {
+    const u32 index = u32(_nodes.size());
+    _nodes.emplace_back();
+    _parents.push_back(invalid_index);
+
+    AABB bounds;
+    AABB centroid_bounds;
+    for (u32 i = first; i != first + count; ++i) {
+        bounds.extend(_object_bounds[_indices[i]]);
+        centroid_bounds.extend(centroids[_indices[i]]);
+    }
+
+    _nodes[index].bounds = bounds;
+    _nodes[index].first = first;
+    _nodes[index].count = count;
+
+    auto make_leaf = [&] {
+        for (u32 i = first; i != first + count; ++i) {
+            _object_leaf[_indices[i]] = index;
+        }
+        return index;
+    };
+
+    if (count <= min_leaf_size) {
+        return make_leaf();
+    }
+
+    const glm::vec3 centroid_size = centroid_bounds.max - centroid_bounds.min;
+    int axis = 0;
+    if (centroid_size.y > centroid_size[axis]) axis = 1;
+    if (centroid_size.z > centroid_size[axis]) axis = 2;
+
+    const auto begin = _indices.begin() + first;
+    const auto end = begin + count;
+    const auto middle = begin + count / 2;
+
+    u32 split = first;
+    if (centroid_size[axis] <= 0.0f) {
+        // All centroids are the same, no plane can separate them
+        if (count <= max_leaf_size) {
+            return make_leaf();
+        }
+    } else {
+        struct Bin {
+            AABB bounds;
+            u32 count = 0;
+        };
+
+        const float axis_min = centroid_bounds.min[axis];
+        const float scale = float(bin_count) * 0.9999f / centroid_size[axis];
+        auto bin_index = [&](u32 object) {
+            return std::min(bin_count - 1, u32((centroids[object][axis] - axis_min) * scale));
+        };
+
+        Bin bins[bin_count];
+        for (auto it = begin; it != end; ++it) {
+            Bin& bin = bins[bin_index(*it)];
+            bin.bounds.extend(_object_bounds[*it]);
+            ++bin.count;
+        }
+
+        // Cost of splitting after bin i, swept from both sides
+        float right_costs[bin_count] = {};
+        {
+            AABB right;
+            u32 right_count = 0;
+            for (u32 i = bin_count - 1; i != 0; --i) {
+                right.extend(bins[i].bounds);
+                right_count += bins[i].count;
+                right_costs[i - 1] = right.surface_area() * float(right_count);
+            }
+        }
+
+        float best_cost = FLT_MAX;
+        u32 best_bin = 0;
+        {
+            AABB left;
+            u32 left_count = 0;
+            for (u32 i = 0; i != bin_count - 1; ++i) {
+                left.extend(bins[i].bounds);
+                left_count += bins[i].count;
+                const float cost = left.surface_area() * float(left_count) + right_costs[i];
+                if (left_count && left_count != count && cost < best_cost) {
+                    best_cost = cost;
+                    best_bin = i;
+                }
+            }
+        }
+
+        // Traversal and object tests are assumed to cost the same
+        const float area = std::max(bounds.surface_area(), FLT_MIN);
+        const float split_cost = 1.0f + best_cost / area;
+        const float leaf_cost = float(count);
+        if (leaf_cost <= split_cost && count <= max_leaf_size) {
+            return make_leaf();
+        }
+
+        if (best_cost != FLT_MAX) {
+            split = u32(std::partition(begin, end, [&](u32 object) {
+                            return bin_index(object) <= best_bin;
+                        }) - _indices.begin());
+        }
+    }
+
+    if (split == first || split == first + count) {
+        // Binning failed to separate the objects, fall back to a median split
+        split = first + count / 2;
+        std::nth_element(begin, middle, end, [&](u32 a, u32 b) {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+    }
+
+    const u32 left = build_node(first, split - first, centroids);
+    const u32 right = build_node(split, first + count - split, centroids);
+    _nodes[index].left = left;
+    _nodes[index].right = right;
+    _parents[left] = index;
+    _parents[right] = index;
+    return index;
+}
+
+AABB BVH::leaf_bounds(const Node& node) const {
+    AABB bounds;
+    for (u32 i = node.first; i != node.first + node.count; ++i) {
+        if (_indices[i] != invalid_index) {
+            bounds.extend(_object_bounds[_indices[i]]);
+        }
+    }
+    return bounds;
+}
+
+void BVH::refit(const std::vector<AABB>& bounds, const std::vector<u32>& moved) {
+    // Children always have a larger index than their parent, so popping the largest index
+    // first refits every node after all of its children.
+    std::priority_queue<u32> dirty;
+    for (const u32 object : moved) {
+        if (object >= _object_leaf.size() || _object_leaf[object] == invalid_index) {
+            continue;
+        }
+        _object_bounds[object] = bounds[object];
+        if (_object_leaf[object] != pending_leaf) {
+            dirty.push(_object_leaf[object]);
+        }
+    }
+
+    u32 last = invalid_index;
+    while (!dirty.empty()) {
+        const u32 index = dirty.top();
+        dirty.pop();
+        if (index == last) {
+            continue;
+        }
+        last = index;
+
+        Node& node = _nodes[index];
+        AABB new_bounds;
+        if (node.is_leaf()) {
+            new_bounds = leaf_bounds(node);
+        } else {
+            new_bounds = _nodes[node.left].bounds;
+            new_bounds.extend(_nodes[node.right].bounds);
+        }
+
+        if (new_bounds == node.bounds) {
+            // Ancestors can not change because of this node
+            continue;
+        }
+
+        _area += new_bounds.surface_area() - node.bounds.surface_area();
+        node.bounds = new_bounds;
+        if (_parents[index] != invalid_index) {
+            dirty.push(_parents[index]);
+        }
+    }
+}
+
+void BVH::insert(const AABB& bounds, u32 object) {
+    if (object >= _object_leaf.size()) {
+        _object_bounds.resize(object + 1);
+        _object_leaf.resize(object + 1, invalid_index);
+        _object_slot.resize(object + 1, invalid_index);
+    }
+    DEBUG_ASSERT(_object_leaf[object] == invalid_index);
+
+    _object_bounds[object] = bounds;
+    _object_leaf[object] = pending_leaf;
+    _object_slot[object] = u32(_pending.size());
+    _pending.push_back(object);
+}
+
+void BVH::remove(u32 object) {
+    if (object >= _object_leaf.size() || _object_leaf[object] == invalid_index) {
+        return;
+    }
+
+    const u32 slot = _object_slot[object];
+    if (_object_leaf[object] == pending_leaf) {
+        _pending[slot] = _pending.back();
+        _object_slot[_pending[slot]] = slot;
+        _pending.pop_back();
+    } else {
+        // The leaf keeps its bounds, which are still conservative, until the next refit or build
+        _indices[slot] = invalid_index;
+        ++_holes;
+    }
+
+    _object_leaf[object] = invalid_index;
+    _object_slot[object] = invalid_index;
+}
+
+void BVH::move(u32 from, u32 to) {
+    if (from >= _object_leaf.size() || _object_leaf[from] == invalid_index) {
+        return;
+    }
+    if (to >= _object_leaf.size()) {
+        _object_bounds.resize(to + 1);
+        _object_leaf.resize(to + 1, invalid_index);
+        _object_slot.resize(to + 1, invalid_index);
+    }
+    DEBUG_ASSERT(_object_leaf[to] == invalid_index);
+
+    const u32 slot = _object_slot[from];
+    _object_bounds[to] = _object_bounds[from];
+    _object_leaf[to] = _object_leaf[from];
+    _object_slot[to] = slot;
+    if (_object_leaf[to] == pending_leaf) {
+        _pending[slot] = to;
+    } else {
+        _indices[slot] = to;
+    }
+
+    _object_leaf[from] = invalid_index;
+    _object_slot[from] = invalid_index;
+}
+
+bool BVH::needs_rebuild() const {
+    const size_t max_changes = std::max(_built_count / max_changes_ratio, min_changes);
+    return _area > 2.0f * _built_area || _pending.size() + _holes > max_changes;
+}
+
+void BVH::cull(const FrustumPlanes& frustum, std::vector<u32>& visible) const {
+    for (const u32 object : _pending) {
+        u32 plane_mask = all_planes;
+        if (test_planes(_object_bounds[object], frustum, plane_mask)) {
+            visible.push_back(object);
+        }
+    }
+
+    if (_nodes.empty()) {
+        return;
+    }
+
+    struct StackEntry {
+        u32 node;
+        u32 plane_mask;
+    };
+
+    std::vector<StackEntry> stack;
+    stack.reserve(64);
+    stack.push_back({0, all_planes});
+
+    while (!stack.empty()) {
+        const StackEntry entry = stack.back();
+        stack.pop_back();
+
+        const Node& node = _nodes[entry.node];
+        u32 plane_mask = entry.plane_mask;
+        if (!test_planes(node.bounds, frustum, plane_mask)) {
+            continue;
+        }
+
+        if (!plane_mask) {
+            // Whole subtree is inside
+            if (_holes) {
+                std::copy_if(_indices.begin() + node.first,
+                             _indices.begin() + node.first + node.count,
+                             std::back_inserter(visible),
+                             [](u32 object) { return object != invalid_index; });
+            } else {
+                visible.insert(visible.end(), _indices.begin() + node.first,
+                               _indices.begin() + node.first + node.count);
+            }
+            continue;
+        }
+
+        if (node.is_leaf()) {
+            for (u32 i = node.first; i != node.first + node.count; ++i) {
+                if (_indices[i] == invalid_index) {
+                    continue;
+                }
+                u32 object_mask = plane_mask;
+                if (test_planes(_object_bounds[_indices[i]], frustum, object_mask)) {
+                    visible.push_back(_indices[i]);
+                }
+            }
+        } else {
+            stack.push_back({node.right, plane_mask});
+            stack.push_back({node.left, plane_mask});
+        }
+    }
+}
+
+bool BVH::is_empty() const {
+    return _nodes.empty() && _pending.empty();
+}
+
+size_t BVH::node_count() const {
+    return _nodes.size();
+}
+
+}
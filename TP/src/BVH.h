@@ -0,0 +1,82 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <AABB.h>
+#include <Culling.h>
+
+#include <vector>
+
+namespace OM3D {
+
+// Bounding volume hierarchy over object bounds, built with a binned SAH.
+// Every node covers a contiguous range of object indices so that a subtree
+// fully inside the frustum is accepted without visiting its children.
+// Objects added after the build are kept in a list tested one by one, removed ones leave a hole in
+// their leaf, until enough of them make a rebuild worth it (see needs_rebuild).
+class BVH {
+
+    static constexpr u32 invalid_index = u32(-1);
+    // Leaf of the objects inserted since the build
+    static constexpr u32 pending_leaf = u32(-2);
+
+    struct Node {
+        AABB bounds;
+        u32 first = 0;
+        u32 count = 0;
+        u32 left = invalid_index;
+        u32 right = invalid_index;
+
+        bool is_leaf() const {
+            return left == invalid_index;
+        }
+    };
+
+    public:
+        BVH() = default;
+
+        // Build over the objects listed in objects, bounds is indexed by object index
+        void build(const std::vector<AABB>& bounds, const std::vector<u32>& objects);
+        void clear();
+
+        // Update the bounds of the given objects and of all their ancestors
+        void refit(const std::vector<AABB>& bounds, const std::vector<u32>& moved);
+
+        // Constant time changes, for stores that move their last object into holes
+        void insert(const AABB& bounds, u32 object);
+        void remove(u32 object);
+        void move(u32 from, u32 to);
+
+        // True once refits, insertions and removals have degraded the tree enough that a rebuild
+        // is cheaper
+        bool needs_rebuild() const;
+
+        // Append the indices of the objects intersecting the frustum to visible
+        void cull(const FrustumPlanes& frustum, std::vector<u32>& visible) const;
+
+        bool is_empty() const;
+        size_t node_count() const;
+
+    private:
+        u32 build_node(u32 first, u32 count, std::vector<glm::vec3>& centroids);
+        AABB leaf_bounds(const Node& node) const;
+
+        std::vector<Node> _nodes;
+        std::vector<u32> _parents;
+        std::vector<AABB> _object_bounds;
+        // Object indices, permuted so that every node covers a contiguous range. Removed objects
+        // leave invalid_index.
+        std::vector<u32> _indices;
+        std::vector<u32> _object_leaf;
+        // Position of every object in _indices, or in _pending
+        std::vector<u32> _object_slot;
+        std::vector<u32> _pending;
+        size_t _holes = 0;
+        size_t _built_count = 0;
+
+        float _built_area = 0.0f;
+        float _area = 0.0f;
+};
+
+}
+
+#endif // BVH_H
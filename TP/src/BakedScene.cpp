@@ -0,0 +1,492 @@
+#include "BakedScene.h"
+
+#include <Texture.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+namespace OM3D {
+
+static constexpr u32 baked_scene_magic = 0x4B42334F; // "O3BK"
+// Bump when the layout or the import processing of the baked data changes
+static constexpr u32 baked_scene_version = 5;
+
+// Arrays start on this alignment in the file, so that they can be read in place from the mapping
+static constexpr size_t baked_array_alignment = 16;
+
+Result<u64> hash_file(const std::string& file_name) {
+    const auto file = MappedFile::open(file_name);
+    if (!file.is_ok) {
+        return {false, 0};
+    }
+    return {true, hash_bytes(Span<const u8>(file.value.data(), file.value.size()))};
+}
+
+BakedDependency hash_dependency(const std::string& scene_file_name, std::string uri) {
+    const size_t separator = scene_file_name.find_last_of("/\\");
+    const std::string directory =
+        separator == std::string::npos ? std::string() : scene_file_name.substr(0, separator + 1);
+    const auto hash = hash_file(directory + uri);
+    return {std::move(uri), hash.is_ok ? hash.value : 0};
+}
+
+u64 hash_bytes(Span<const u8> bytes) {
+    // FNV-1a over 64 bit words, then the remaining bytes
+    const u8* data = bytes.data();
+    const size_t size = bytes.size();
+    u64 hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+        u64 word = 0;
+        std::memcpy(&word, data + i, sizeof(u64));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i != size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash ^ u64(size);
+}
+
+namespace {
+
+class BakeWriter : NonCopyable {
+    public:
+        BakeWriter(std::FILE* file) : _file(file) {
+        }
+
+        bool is_ok() const {
+            return _ok;
+        }
+
+        void write_bytes(const void* data, size_t size) {
+            if (size && std::fwrite(data, 1, size, _file) != size) {
+                _ok = false;
+            }
+            _offset += size;
+        }
+
+        template<typename T>
+        void write(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write_bytes(&value, sizeof(T));
+        }
+
+        template<typename T>
+        void write_array(Span<const T> values) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write(u64(values.size()));
+            align();
+            write_bytes(values.data(), values.size() * sizeof(T));
+        }
+
+    private:
+        void align() {
+            static constexpr u8 zeros[baked_array_alignment] = {};
+            write_bytes(zeros, (baked_array_alignment - _offset % baked_array_alignment) %
+                                   baked_array_alignment);
+        }
+
+        std::FILE* _file = nullptr;
+        size_t _offset = 0;
+        bool _ok = true;
+};
+
+// Every read is bounds checked, a failed read leaves the reader failed
+class BakeReader {
+    public:
+        BakeReader(const u8* data, size_t size) : _data(data), _size(size) {
+        }
+
+        bool is_ok() const {
+            return _ok;
+        }
+
+        bool at_end() const {
+            return _offset == _size;
+        }
+
+        template<typename T>
+        bool read(T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (const u8* bytes = take(sizeof(T))) {
+                std::memcpy(&value, bytes, sizeof(T));
+            }
+            return _ok;
+        }
+
+        template<typename T>
+        bool read_array(Span<const T>& values) {
+            u64 count = 0;
+            if (!read(count) || !align() || count > (_size - _offset) / sizeof(T)) {
+                return _ok = false;
+            }
+            const T* begin = reinterpret_cast<const T*>(take(count * sizeof(T)));
+            values = Span<const T>(begin, size_t(count));
+            return _ok;
+        }
+
+        template<typename T>
+        bool read_array(std::vector<T>& values) {
+            Span<const T> view;
+            if (read_array(view)) {
+                values.assign(view.begin(), view.end());
+            }
+            return _ok;
+        }
+
+    private:
+        const u8* take(size_t size) {
+            if (!_ok || size > _size - _offset) {
+                _ok = false;
+                return nullptr;
+            }
+            const u8* bytes = _data + _offset;
+            _offset += size;
+            return bytes;
+        }
+
+        bool align() {
+            return take((baked_array_alignment - _offset % baked_array_alignment) %
+                        baked_array_alignment) || _ok;
+        }
+
+        const u8* _data = nullptr;
+        size_t _size = 0;
+        size_t _offset = 0;
+        bool _ok = true;
+};
+
+}
+
+static void write_scene(BakeWriter& writer, const BakedScene& scene) {
+    writer.write(u64(scene.nodes.size()));
+    for (const BakedNode& node : scene.nodes) {
+        writer.write(node.local);
+        writer.write(node.parent);
+    }
+
+    writer.write(u64(scene.animated_nodes.size()));
+    for (const BakedAnimatedNode& node : scene.animated_nodes) {
+        writer.write(node.node);
+        writer.write(node.translation);
+        const glm::quat& r = node.rotation;
+        writer.write(glm::vec4(r.x, r.y, r.z, r.w));
+        writer.write(node.scale);
+    }
+
+    writer.write(u64(scene.channels.size()));
+    for (const BakedChannel& channel : scene.channels) {
+        writer.write(channel.animated_node);
+        writer.write(u32(channel.path));
+        writer.write(u32(channel.interpolation));
+        writer.write(channel.duration);
+        writer.write_array<float>(channel.times);
+        writer.write_array<glm::vec4>(channel.values);
+    }
+
+    writer.write(u64(scene.meshes.size()));
+    for (const BakedMesh& mesh : scene.meshes) {
+        writer.write(mesh.key.hash);
+        writer.write(u64(mesh.key.vertex_count));
+        writer.write(u64(mesh.key.index_count));
+        writer.write_array<Vertex>(mesh.data.vertices);
+        writer.write_array<u32>(mesh.data.indices);
+        writer.write(u64(mesh.data.lods.size()));
+        for (const MeshLod& level : mesh.data.lods) {
+            writer.write(level.error);
+            writer.write_array<u32>(level.indices);
+        }
+        writer.write_array<Meshlet>(mesh.data.meshlets);
+    }
+
+    writer.write(u64(scene.textures.size()));
+    for (const BakedTexture& texture : scene.textures) {
+        writer.write(texture.size);
+        writer.write(u32(texture.format));
+        writer.write(texture.levels);
+        writer.write_array<u8>(texture.mip_chain);
+    }
+
+    writer.write(u64(scene.materials.size()));
+    for (const BakedMaterial& material : scene.materials) {
+        writer.write(material.albedo);
+        writer.write(material.normal);
+    }
+
+    writer.write(u64(scene.objects.size()));
+    for (const BakedObject& object : scene.objects) {
+        writer.write(object.node);
+        writer.write(object.mesh);
+        writer.write(object.material);
+    }
+}
+
+// Formats that import can produce
+static bool is_baked_texture_format(u32 format) {
+    switch (ImageFormat(format)) {
+        case ImageFormat::RGBA8_UNORM:
+        case ImageFormat::RGBA8_sRGB:
+        case ImageFormat::RGB8_UNORM:
+        case ImageFormat::RGB8_sRGB:
+        case ImageFormat::BC1_UNORM:
+        case ImageFormat::BC1_sRGB:
+        case ImageFormat::BC3_UNORM:
+        case ImageFormat::BC3_sRGB:
+        case ImageFormat::BC5_UNORM:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Counts come from the file: they are only trusted as far as the data they describe is there
+static bool read_count(BakeReader& reader, size_t& count) {
+    u64 value = 0;
+    if (!reader.read(value) || value > u64(u32(-1))) {
+        return false;
+    }
+    count = size_t(value);
+    return true;
+}
+
+// Whole triangles referencing existing vertices only
+static bool is_valid_triangle_list(const std::vector<u32>& indices, size_t vertex_count) {
+    return indices.size() % 3 == 0 &&
+           std::all_of(indices.begin(), indices.end(), [&](u32 i) { return i < vertex_count; });
+}
+
+static bool is_valid_mesh(const MeshData& data) {
+    if (!is_valid_triangle_list(data.indices, data.vertices.size())) {
+        return false;
+    }
+    for (const MeshLod& level : data.lods) {
+        if (!is_valid_triangle_list(level.indices, data.vertices.size())) {
+            return false;
+        }
+    }
+    for (const Meshlet& meshlet : data.meshlets) {
+        if (u64(meshlet.first_index) + meshlet.index_count > data.indices.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_scene(BakeReader& reader, BakedScene& scene) {
+    size_t count = 0;
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedNode& node = scene.nodes.emplace_back();
+        reader.read(node.local);
+        reader.read(node.parent);
+        if (node.parent != TransformSystem::no_parent && node.parent >= i) {
+            return false;
+        }
+    }
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedAnimatedNode& node = scene.animated_nodes.emplace_back();
+        glm::vec4 rotation;
+        reader.read(node.node);
+        reader.read(node.translation);
+        reader.read(rotation);
+        reader.read(node.scale);
+        node.rotation = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
+        if (node.node >= scene.nodes.size()) {
+            return false;
+        }
+    }
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedChannel& channel = scene.channels.emplace_back();
+        u32 path = 0;
+        u32 interpolation = 0;
+        reader.read(channel.animated_node);
+        reader.read(path);
+        reader.read(interpolation);
+        reader.read(channel.duration);
+        reader.read_array(channel.times);
+        reader.read_array(channel.values);
+        channel.path = AnimationPath(path);
+        channel.interpolation = Interpolation(interpolation);
+        if (channel.animated_node >= scene.animated_nodes.size() ||
+            path > u32(AnimationPath::Scale) || interpolation > u32(Interpolation::Linear) ||
+            channel.times.empty() || channel.times.size() != channel.values.size()) {
+            return false;
+        }
+    }
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedMesh& mesh = scene.meshes.emplace_back();
+        u64 vertex_count = 0;
+        u64 index_count = 0;
+        reader.read(mesh.key.hash);
+        reader.read(vertex_count);
+        reader.read(index_count);
+        mesh.key.vertex_count = size_t(vertex_count);
+        mesh.key.index_count = size_t(index_count);
+        reader.read_array(mesh.data.vertices);
+        reader.read_array(mesh.data.indices);
+
+        size_t lod_count = 0;
+        if (!read_count(reader, lod_count) || lod_count > StaticMesh::max_lod_count) {
+            return false;
+        }
+        mesh.data.lods.resize(lod_count);
+        for (MeshLod& level : mesh.data.lods) {
+            reader.read(level.error);
+            reader.read_array(level.indices);
+        }
+        reader.read_array(mesh.data.meshlets);
+        if (!reader.is_ok() || !is_valid_mesh(mesh.data)) {
+            return false;
+        }
+    }
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedTexture& texture = scene.textures.emplace_back();
+        u32 format = 0;
+        reader.read(texture.size);
+        reader.read(format);
+        reader.read(texture.levels);
+        reader.read_array(texture.mip_chain);
+        texture.format = ImageFormat(format);
+        if (!is_baked_texture_format(format) || !texture.size.x || !texture.size.y ||
+            !texture.levels || texture.levels > Texture::mip_levels(texture.size) ||
+            texture.mip_chain.size() !=
+                mip_chain_size(texture.size, texture.format, texture.levels)) {
+            return false;
+        }
+    }
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedMaterial& material = scene.materials.emplace_back();
+        reader.read(material.albedo);
+        reader.read(material.normal);
+        if (material.albedo >= i32(scene.textures.size()) ||
+            material.normal >= i32(scene.textures.size())) {
+            return false;
+        }
+    }
+
+    if (!read_count(reader, count)) {
+        return false;
+    }
+    for (size_t i = 0; i != count && reader.is_ok(); ++i) {
+        BakedObject& object = scene.objects.emplace_back();
+        reader.read(object.node);
+        reader.read(object.mesh);
+        reader.read(object.material);
+        if (object.node >= scene.nodes.size() || object.mesh >= scene.meshes.size() ||
+            object.material >= i32(scene.materials.size())) {
+            return false;
+        }
+    }
+
+    return reader.is_ok() && reader.at_end();
+}
+
+bool write_baked_scene(const std::string& file_name, u64 source_hash,
+                       const std::vector<BakedDependency>& dependencies, const BakedScene& scene) {
+    // Written aside and renamed, so that an interrupted write never leaves a truncated cache
+    const std::string temp_name = file_name + ".tmp";
+    std::FILE* file = std::fopen(temp_name.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    BakeWriter writer(file);
+    writer.write(baked_scene_magic);
+    writer.write(baked_scene_version);
+    writer.write(source_hash);
+    writer.write(u64(dependencies.size()));
+    for (const BakedDependency& dependency : dependencies) {
+        writer.write(dependency.hash);
+        writer.write_array(Span<const char>(dependency.uri.data(), dependency.uri.size()));
+    }
+    write_scene(writer, scene);
+
+    const bool closed = std::fclose(file) == 0;
+    if (!writer.is_ok() || !closed) {
+        std::remove(temp_name.c_str());
+        return false;
+    }
+
+    std::remove(file_name.c_str());
+    return std::rename(temp_name.c_str(), file_name.c_str()) == 0;
+}
+
+Result<BakedScene> read_baked_scene(const std::string& file_name, u64 source_hash) {
+    auto file = MappedFile::open(file_name);
+    if (!file.is_ok) {
+        return {false, {}};
+    }
+
+    BakeReader reader(file.value.data(), file.value.size());
+
+    u32 magic = 0;
+    u32 version = 0;
+    u64 hash = 0;
+    reader.read(magic);
+    reader.read(version);
+    reader.read(hash);
+    if (!reader.is_ok() || magic != baked_scene_magic || version != baked_scene_version ||
+        hash != source_hash) {
+        return {false, {}};
+    }
+
+    // Dependencies are read whole to be hashed, only once the rest of the header matches
+    size_t dependency_count = 0;
+    if (!read_count(reader, dependency_count)) {
+        return {false, {}};
+    }
+    for (size_t i = 0; i != dependency_count; ++i) {
+        u64 dependency_hash = 0;
+        Span<const char> uri;
+        reader.read(dependency_hash);
+        if (!reader.read_array(uri)) {
+            return {false, {}};
+        }
+        const BakedDependency dependency =
+            hash_dependency(file_name, std::string(uri.begin(), uri.end()));
+        if (dependency.hash != dependency_hash) {
+            std::cout << "\"" << dependency.uri << "\" changed since \"" << file_name
+                      << "\" was baked" << std::endl;
+            return {false, {}};
+        }
+    }
+
+    BakedScene scene;
+    if (!read_scene(reader, scene)) {
+        std::cerr << "Corrupt baked scene \"" << file_name << "\"" << std::endl;
+        return {false, {}};
+    }
+
+    // Texture mip chains are uploaded from the mapping
+    scene.mapping = std::move(file.value);
+    return {true, std::move(scene)};
+}
+
+}
@@ -0,0 +1,146 @@
+#ifndef BAKEDSCENE_H
+#define BAKEDSCENE_H
+
+#include <Animation.h>
+#include <ImageFormat.h>
+#include <MappedFile.h>
+#include <MeshCache.h>
+#include <StaticMesh.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace OM3D {
+
+class Scene;
+class Texture;
+
+// Transform of the scene hierarchy, parents come before their children
+struct BakedNode {
+    glm::mat4 local = glm::mat4(1.0f);
+    u32 parent = TransformSystem::no_parent;
+};
+
+// Rest pose of a node driven by animation channels
+struct BakedAnimatedNode {
+    u32 node = 0;
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+struct BakedChannel {
+    u32 animated_node = 0;
+    AnimationPath path = AnimationPath::Translation;
+    Interpolation interpolation = Interpolation::Linear;
+    float duration = 0.0f;
+    std::vector<float> times;
+    std::vector<glm::vec4> values;
+};
+
+// Mesh after import processing, key is the one of the data before processing
+struct BakedMesh {
+    MeshKey key;
+    MeshData data;
+};
+
+// Mip chain, see build_mip_chain. Images read from KTX2 or DDS files can stop before 1x1.
+// Pixels point into the cache file once it is loaded.
+struct BakedTexture {
+    glm::uvec2 size = {};
+    ImageFormat format = ImageFormat::RGBA8_UNORM;
+    u32 levels = 1;
+    Span<const u8> mip_chain;
+};
+
+// Mip chain that owns its memory, shared by every scene baked from the same image (see
+// TextureCache)
+struct SharedBakedTexture {
+    BakedTexture texture;
+    std::vector<u8> storage;
+};
+
+// Textures of the same size, format and levels, packed in the layers of one texture array so that
+// their materials can be drawn together
+struct BakedTextureArray {
+    // Texture of every layer
+    std::vector<u32> textures;
+};
+
+// Texture indices, -1 if the material has no such texture
+struct BakedMaterial {
+    i32 albedo = -1;
+    i32 normal = -1;
+};
+
+// Material is -1 for objects without material
+struct BakedObject {
+    u32 node = 0;
+    u32 mesh = 0;
+    i32 material = -1;
+};
+
+// Everything Scene::from_gltf builds from a file, ready to be uploaded.
+// Written next to the source file and loaded instead of parsing it again, see read_baked_scene.
+struct BakedScene {
+    std::vector<BakedNode> nodes;
+    std::vector<BakedAnimatedNode> animated_nodes;
+    std::vector<BakedChannel> channels;
+    std::vector<BakedMesh> meshes;
+    std::vector<BakedTexture> textures;
+    std::vector<BakedMaterial> materials;
+    std::vector<BakedObject> objects;
+
+    // Memory of the texture mip chains: built or found in TextureCache while baking, or the
+    // mapped cache file
+    std::vector<std::shared_ptr<const SharedBakedTexture>> texture_storage;
+    MappedFile mapping;
+};
+
+// File read while baking a scene besides the scene file, such as the buffers and images of a
+// .gltf file. The URI is relative to the directory of the scene file.
+struct BakedDependency {
+    std::string uri;
+    u64 hash = 0;
+};
+
+// Hash of the whole content of a file, which identifies the source of a baked scene
+Result<u64> hash_file(const std::string& file_name);
+u64 hash_bytes(Span<const u8> bytes);
+// Files that can not be read hash to 0, so that the scene is baked again once they appear
+BakedDependency hash_dependency(const std::string& scene_file_name, std::string uri);
+
+// The baked file is written next to the scene file, dependencies are checked again by
+// read_baked_scene
+bool write_baked_scene(const std::string& file_name, u64 source_hash,
+                       const std::vector<BakedDependency>& dependencies, const BakedScene& scene);
+// Fails if the file does not exist, is corrupt, was written by another version, baked from
+// a different source or if one of its dependencies changed
+Result<BakedScene> read_baked_scene(const std::string& file_name, u64 source_hash);
+
+// Read the baked scene of a glTF file, or parse and bake the file if there is no valid one.
+// Does not touch GL, so it can run on any thread.
+Result<BakedScene> bake_scene_file(const std::string& file_name);
+
+// Arrays holding every texture of a scene, always the same for the same scene
+std::vector<BakedTextureArray> pack_texture_arrays(const BakedScene& scene);
+
+// GL objects of a baked scene, to be created on the GL thread in any order.
+// Meshes are shared through MeshCache. Streamed texture arrays only get their tail.
+std::shared_ptr<StaticMesh> create_baked_mesh(const BakedMesh& mesh,
+                                              StagingBuffer* staging = nullptr);
+std::shared_ptr<Texture> create_baked_texture_array(Span<const BakedTexture> layers,
+                                                    StagingBuffer* staging = nullptr);
+
+// Build the scene once every mesh and texture array exists, in the order of the baked scene and
+// of pack_texture_arrays. The scene keeps baked alive if it streams its textures.
+std::unique_ptr<Scene> instantiate_baked_scene(
+    std::shared_ptr<const BakedScene> baked, Span<const std::shared_ptr<StaticMesh>> meshes,
+    Span<const std::shared_ptr<Texture>> texture_arrays);
+
+}
+
+#endif // BAKEDSCENE_H
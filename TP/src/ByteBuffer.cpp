@@ -17,6 +17,23 @@ ByteBuffer::ByteBuffer(const void* data, size_t size) : _handle(create_buffer_ha
     glNamedBufferData(_handle.get(), size, data, GL_STATIC_DRAW);
 }
 
+ByteBuffer ByteBuffer::persistent(size_t size) {
+    ALWAYS_ASSERT(size, "Buffer size can not be 0");
+    ByteBuffer buffer;
+    buffer._handle = GLHandle(create_buffer_handle());
+    buffer._size = size;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glNamedBufferStorage(buffer._handle.get(), size, nullptr, flags);
+    buffer._persistent_data = static_cast<byte*>(glMapNamedBufferRange(buffer._handle.get(), 0, size, flags));
+    ALWAYS_ASSERT(buffer._persistent_data, "Unable to map buffer");
+    return buffer;
+}
+
+byte* ByteBuffer::persistent_data() const {
+    return _persistent_data;
+}
+
 ByteBuffer::~ByteBuffer() {
     if(auto handle = _handle.get()) {
         glDeleteBuffers(1, &handle);
@@ -36,6 +53,17 @@ size_t ByteBuffer::byte_size() const {
     return _size;
 }
 
+void ByteBuffer::write(const void* data, size_t size, size_t offset) {
+    DEBUG_ASSERT(offset + size <= _size);
+    glNamedBufferSubData(_handle.get(), offset, size, data);
+}
+
+void ByteBuffer::copy(const ByteBuffer& src, size_t src_offset, size_t dst_offset, size_t size) {
+    DEBUG_ASSERT(src_offset + size <= src._size);
+    DEBUG_ASSERT(dst_offset + size <= _size);
+    glCopyNamedBufferSubData(src._handle.get(), _handle.get(), src_offset, dst_offset, size);
+}
+
 BufferMapping<byte> ByteBuffer::map_bytes(AccessType access) {
     return BufferMapping<byte>(map_internal(access), byte_size(), handle());
 }
@@ -16,11 +16,20 @@ class ByteBuffer : NonCopyable {
         ByteBuffer(const void* data, size_t size);
         ~ByteBuffer();
 
+        // Immutable storage that stays mapped for writing until the buffer is destroyed
+        static ByteBuffer persistent(size_t size);
+        byte* persistent_data() const;
+
         void bind(BufferUsage usage) const;
         void bind(BufferUsage usage, u32 index) const;
 
         size_t byte_size() const;
 
+        // Overwrite part of the buffer without mapping it
+        void write(const void* data, size_t size, size_t offset = 0);
+        // Copy part of another buffer on the GPU, the ranges must not overlap
+        void copy(const ByteBuffer& src, size_t src_offset, size_t dst_offset, size_t size);
+
         BufferMapping<byte> map_bytes(AccessType access = AccessType::ReadWrite);
 
     protected:
@@ -30,6 +39,7 @@ class ByteBuffer : NonCopyable {
     private:
         GLHandle _handle;
         size_t _size = 0;
+        byte* _persistent_data = nullptr;
 };
 
 }
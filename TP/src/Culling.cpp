@@ -0,0 +1,219 @@
+#include "Culling.h"
+
+#include <RadixSort.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULLING_SSE
+#endif
+
+namespace OM3D {
+
+FrustumPlanes FrustumPlanes::from_camera(const Camera& camera) {
+    const Frustum frustum = camera.build_frustum();
+    const glm::vec3 position = camera.position();
+    const glm::vec3 normals[plane_count] = {frustum._bottom_normal, frustum._left_normal,
+                                            frustum._near_normal, frustum._right_normal,
+                                            frustum._top_normal};
+
+    // Every plane goes through the camera position
+    FrustumPlanes planes;
+    for (u32 i = 0; i != plane_count; ++i) {
+        planes.nx[i] = normals[i].x;
+        planes.ny[i] = normals[i].y;
+        planes.nz[i] = normals[i].z;
+        planes.d[i] = -glm::dot(normals[i], position);
+    }
+    return planes;
+}
+
+void BoundingSpheres::clear() {
+    resize(0);
+}
+
+void BoundingSpheres::resize(size_t count) {
+    const size_t padded = (count + simd_width - 1) / simd_width * simd_width;
+    _x.resize(padded, 0.0f);
+    _y.resize(padded, 0.0f);
+    _z.resize(padded, 0.0f);
+    _radius.resize(padded, -FLT_MAX);
+    // Padding must never pass the test, including lanes that held a sphere before shrinking
+    std::fill(_radius.begin() + count, _radius.end(), -FLT_MAX);
+    _size = count;
+}
+
+void BoundingSpheres::set(size_t index, const glm::vec3& center, float radius) {
+    DEBUG_ASSERT(index < _size);
+    _x[index] = center.x;
+    _y[index] = center.y;
+    _z[index] = center.z;
+    _radius[index] = radius;
+}
+
+void BoundingSpheres::set(size_t index, const glm::mat4& transform, float local_radius) {
+    set(index, glm::vec3(transform[3]), local_radius * max_scale(transform));
+}
+
+glm::vec3 BoundingSpheres::center(size_t index) const {
+    DEBUG_ASSERT(index < _size);
+    return glm::vec3(_x[index], _y[index], _z[index]);
+}
+
+float BoundingSpheres::radius(size_t index) const {
+    DEBUG_ASSERT(index < _size);
+    return _radius[index];
+}
+
+size_t BoundingSpheres::size() const {
+    return _size;
+}
+
+void frustum_cull(const FrustumPlanes& frustum, const BoundingSpheres& spheres,
+                  std::vector<u32>& visible) {
+    const size_t padded = spheres._radius.size();
+    const float* xs = spheres._x.data();
+    const float* ys = spheres._y.data();
+    const float* zs = spheres._z.data();
+    const float* rs = spheres._radius.data();
+
+    // Indices are written unconditionally and the cursor only advances for visible spheres
+    visible.resize(padded);
+    u32* out = visible.data();
+
+#if defined(CULLING_AVX)
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t i = 0; i < padded; i += 8) {
+        const __m256 x = _mm256_loadu_ps(xs + i);
+        const __m256 y = _mm256_loadu_ps(ys + i);
+        const __m256 z = _mm256_loadu_ps(zs + i);
+        const __m256 r = _mm256_loadu_ps(rs + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (u32 p = 0; p != FrustumPlanes::plane_count; ++p) {
+            __m256 dist = _mm256_add_ps(r, _mm256_set1_ps(frustum.d[p]));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(x, _mm256_set1_ps(frustum.nx[p])));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(y, _mm256_set1_ps(frustum.ny[p])));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(z, _mm256_set1_ps(frustum.nz[p])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, zero, _CMP_GE_OQ));
+        }
+
+        const u32 mask = u32(_mm256_movemask_ps(inside));
+        for (u32 lane = 0; lane != 8; ++lane) {
+            *out = u32(i) + lane;
+            out += (mask >> lane) & 1;
+        }
+    }
+#elif defined(CULLING_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < padded; i += 4) {
+        const __m128 x = _mm_loadu_ps(xs + i);
+        const __m128 y = _mm_loadu_ps(ys + i);
+        const __m128 z = _mm_loadu_ps(zs + i);
+        const __m128 r = _mm_loadu_ps(rs + i);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (u32 p = 0; p != FrustumPlanes::plane_count; ++p) {
+            __m128 dist = _mm_add_ps(r, _mm_set1_ps(frustum.d[p]));
+            dist = _mm_add_ps(dist, _mm_mul_ps(x, _mm_set1_ps(frustum.nx[p])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(y, _mm_set1_ps(frustum.ny[p])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(z, _mm_set1_ps(frustum.nz[p])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, zero));
+        }
+
+        const u32 mask = u32(_mm_movemask_ps(inside));
+        for (u32 lane = 0; lane != 4; ++lane) {
+            *out = u32(i) + lane;
+            out += (mask >> lane) & 1;
+        }
+    }
+#else
+    for (size_t i = 0; i < padded; ++i) {
+        bool inside = true;
+        for (u32 p = 0; p != FrustumPlanes::plane_count; ++p) {
+            const float dist = xs[i] * frustum.nx[p] + ys[i] * frustum.ny[p] +
+                               zs[i] * frustum.nz[p] + frustum.d[p] + rs[i];
+            inside &= dist >= 0.0f;
+        }
+        *out = u32(i);
+        out += inside;
+    }
+#endif
+
+    visible.resize(out - visible.data());
+}
+
+void compute_depth_keys(const glm::vec3& position, const glm::vec3& forward,
+                        const BoundingSpheres& spheres, std::vector<u32>& keys) {
+    const size_t padded = spheres._radius.size();
+    const float* xs = spheres._x.data();
+    const float* ys = spheres._y.data();
+    const float* zs = spheres._z.data();
+    const float* rs = spheres._radius.data();
+
+    const float offset = -glm::dot(position, forward);
+    keys.resize(padded);
+
+#if defined(CULLING_AVX)
+    const __m256i sign = _mm256_set1_epi32(int(0x80000000));
+    for (size_t i = 0; i < padded; i += 8) {
+        const __m256 x = _mm256_loadu_ps(xs + i);
+        const __m256 y = _mm256_loadu_ps(ys + i);
+        const __m256 z = _mm256_loadu_ps(zs + i);
+        const __m256 r = _mm256_loadu_ps(rs + i);
+
+        __m256 depth = _mm256_sub_ps(_mm256_set1_ps(offset), r);
+        depth = _mm256_add_ps(depth, _mm256_mul_ps(x, _mm256_set1_ps(forward.x)));
+        depth = _mm256_add_ps(depth, _mm256_mul_ps(y, _mm256_set1_ps(forward.y)));
+        depth = _mm256_add_ps(depth, _mm256_mul_ps(z, _mm256_set1_ps(forward.z)));
+
+        // Flip all bits of negative values and only the sign bit of positive ones
+        const __m256i bits = _mm256_castps_si256(depth);
+        const __m256i mask = _mm256_or_si256(_mm256_srai_epi32(bits, 31), sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(keys.data() + i),
+                            _mm256_xor_si256(bits, mask));
+    }
+#elif defined(CULLING_SSE)
+    const __m128i sign = _mm_set1_epi32(int(0x80000000));
+    for (size_t i = 0; i < padded; i += 4) {
+        const __m128 x = _mm_loadu_ps(xs + i);
+        const __m128 y = _mm_loadu_ps(ys + i);
+        const __m128 z = _mm_loadu_ps(zs + i);
+        const __m128 r = _mm_loadu_ps(rs + i);
+
+        __m128 depth = _mm_sub_ps(_mm_set1_ps(offset), r);
+        depth = _mm_add_ps(depth, _mm_mul_ps(x, _mm_set1_ps(forward.x)));
+        depth = _mm_add_ps(depth, _mm_mul_ps(y, _mm_set1_ps(forward.y)));
+        depth = _mm_add_ps(depth, _mm_mul_ps(z, _mm_set1_ps(forward.z)));
+
+        // Flip all bits of negative values and only the sign bit of positive ones
+        const __m128i bits = _mm_castps_si128(depth);
+        const __m128i mask = _mm_or_si128(_mm_srai_epi32(bits, 31), sign);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(keys.data() + i), _mm_xor_si128(bits, mask));
+    }
+#else
+    for (size_t i = 0; i < padded; ++i) {
+        const float depth =
+            xs[i] * forward.x + ys[i] * forward.y + zs[i] * forward.z + offset - rs[i];
+        keys[i] = float_sort_key(depth);
+    }
+#endif
+
+    keys.resize(spheres.size());
+}
+
+float max_scale(const glm::mat4& transform) {
+    const float sx = glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0]));
+    const float sy = glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1]));
+    const float sz = glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2]));
+    return std::sqrt(std::max(sx, std::max(sy, sz)));
+}
+
+}
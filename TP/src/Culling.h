@@ -0,0 +1,71 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <Camera.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// Frustum planes stored as structure of arrays so that a plane component can be broadcast to
+// every SIMD lane. A point p is inside plane i when nx[i] * p.x + ny[i] * p.y + nz[i] * p.z + d[i] >= 0
+struct FrustumPlanes {
+    static constexpr u32 plane_count = 5;
+
+    float nx[plane_count];
+    float ny[plane_count];
+    float nz[plane_count];
+    float d[plane_count];
+
+    static FrustumPlanes from_camera(const Camera& camera);
+};
+
+// World space bounding spheres, one per object, stored as structure of arrays.
+// Storage is padded to the SIMD width with spheres that are never visible.
+class BoundingSpheres {
+
+    public:
+        static constexpr size_t simd_width = 8;
+
+        BoundingSpheres() = default;
+
+        void clear();
+        void resize(size_t count);
+        void set(size_t index, const glm::vec3& center, float radius);
+        void set(size_t index, const glm::mat4& transform, float local_radius);
+
+        glm::vec3 center(size_t index) const;
+        float radius(size_t index) const;
+
+        size_t size() const;
+
+    private:
+        friend void frustum_cull(const FrustumPlanes&, const BoundingSpheres&, std::vector<u32>&);
+        friend void compute_depth_keys(const glm::vec3&, const glm::vec3&, const BoundingSpheres&,
+                                       std::vector<u32>&);
+
+        std::vector<float> _x;
+        std::vector<float> _y;
+        std::vector<float> _z;
+        std::vector<float> _radius;
+        size_t _size = 0;
+};
+
+// Fill visible with the indices of the spheres intersecting the frustum, in increasing order
+void frustum_cull(const FrustumPlanes& frustum, const BoundingSpheres& spheres,
+                  std::vector<u32>& visible);
+
+// Fill keys with the view depth of the nearest point of each sphere along forward,
+// quantized so that comparing keys as integers orders spheres front to back
+void compute_depth_keys(const glm::vec3& position, const glm::vec3& forward,
+                        const BoundingSpheres& spheres, std::vector<u32>& keys);
+
+// Largest scale factor applied by the upper 3x3 part of the transform
+float max_scale(const glm::mat4& transform);
+
+}
+
+#endif // CULLING_H
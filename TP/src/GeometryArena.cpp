@@ -0,0 +1,269 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace OM3D {
+
+// Pools start with room for this many elements and double when full
+static constexpr u32 min_pool_capacity = 1 << 16;
+
+RangeAllocator::RangeAllocator(u32 capacity) {
+    grow(capacity);
+}
+
+u32 RangeAllocator::allocate(u32 size) {
+    DEBUG_ASSERT(size);
+    const auto best = _blocks_by_size.lower_bound(size);
+    if (best == _blocks_by_size.end()) {
+        return invalid_offset;
+    }
+
+    const u32 offset = best->second;
+    const u32 block_size = best->first;
+    remove_block(_blocks_by_offset.find(offset));
+    if (block_size > size) {
+        add_block(offset + size, block_size - size);
+    }
+    _free_space -= size;
+    return offset;
+}
+
+void RangeAllocator::free(u32 offset, u32 size) {
+    DEBUG_ASSERT(size && offset + size <= _capacity);
+    _free_space += size;
+
+    auto next = _blocks_by_offset.lower_bound(offset);
+    DEBUG_ASSERT(next == _blocks_by_offset.end() || next->first >= offset + size);
+    if (next != _blocks_by_offset.end() && next->first == offset + size) {
+        size += next->second;
+        next = remove_block(next);
+    }
+    if (next != _blocks_by_offset.begin()) {
+        const auto prev = std::prev(next);
+        DEBUG_ASSERT(prev->first + prev->second <= offset);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            remove_block(prev);
+        }
+    }
+    add_block(offset, size);
+}
+
+void RangeAllocator::grow(u32 capacity) {
+    DEBUG_ASSERT(capacity >= _capacity);
+    const u32 old_capacity = _capacity;
+    _capacity = capacity;
+    if (capacity > old_capacity) {
+        free(old_capacity, capacity - old_capacity);
+    }
+}
+
+u32 RangeAllocator::capacity() const {
+    return _capacity;
+}
+
+u32 RangeAllocator::free_space() const {
+    return _free_space;
+}
+
+void RangeAllocator::add_block(u32 offset, u32 size) {
+    _blocks_by_offset.emplace(offset, size);
+    _blocks_by_size.emplace(size, offset);
+}
+
+std::map<u32, u32>::iterator RangeAllocator::remove_block(std::map<u32, u32>::iterator block) {
+    const auto [first, last] = _blocks_by_size.equal_range(block->second);
+    const auto it =
+        std::find_if(first, last, [&](const auto& b) { return b.second == block->first; });
+    DEBUG_ASSERT(it != last);
+    _blocks_by_size.erase(it);
+    return _blocks_by_offset.erase(block);
+}
+
+GeometryPool::GeometryPool(std::vector<u32> strides) : _strides(std::move(strides)) {
+}
+
+u32 GeometryPool::allocate(u32 count) {
+    DEBUG_ASSERT(count);
+    u32 offset = _allocator.allocate(count);
+    if (offset == RangeAllocator::invalid_offset) {
+        // Compact the allocations if the free space is only fragmented, grow otherwise
+        u32 capacity = _allocator.capacity();
+        if (_allocator.free_space() < count) {
+            capacity = std::max({min_pool_capacity, 2 * capacity, _used + count});
+        }
+        repack(capacity);
+        offset = _allocator.allocate(count);
+        ALWAYS_ASSERT(offset != RangeAllocator::invalid_offset, "Geometry pool is full");
+    }
+
+    u32 id = u32(_allocations.size());
+    if (_free_ids.empty()) {
+        _allocations.emplace_back();
+    } else {
+        id = _free_ids.back();
+        _free_ids.pop_back();
+    }
+    _allocations[id] = {offset, count};
+    _used += count;
+    return id;
+}
+
+void GeometryPool::free(u32 id) {
+    Allocation& allocation = _allocations[id];
+    DEBUG_ASSERT(allocation.count);
+    _allocator.free(allocation.offset, allocation.count);
+    _used -= allocation.count;
+    allocation = {};
+    _free_ids.push_back(id);
+}
+
+u32 GeometryPool::offset(u32 id) const {
+    DEBUG_ASSERT(id < _allocations.size());
+    return _allocations[id].offset;
+}
+
+u32 GeometryPool::count(u32 id) const {
+    DEBUG_ASSERT(id < _allocations.size());
+    return _allocations[id].count;
+}
+
+void GeometryPool::write(u32 id, u32 stream, const void* data, StagingBuffer* staging) {
+    const Allocation& allocation = _allocations[id];
+    const size_t stride = _strides[stream];
+    if (staging) {
+        staging->upload(_buffers[stream], allocation.offset * stride, data,
+                        allocation.count * stride);
+    } else {
+        _buffers[stream].write(data, allocation.count * stride, allocation.offset * stride);
+    }
+}
+
+u32 GeometryPool::stream_count() const {
+    return u32(_strides.size());
+}
+
+const ByteBuffer& GeometryPool::buffer(u32 stream) const {
+    DEBUG_ASSERT(stream < _buffers.size());
+    return _buffers[stream];
+}
+
+u32 GeometryPool::used() const {
+    return _used;
+}
+
+u32 GeometryPool::capacity() const {
+    return _allocator.capacity();
+}
+
+void GeometryPool::defragment() {
+    if (_allocator.capacity()) {
+        repack(_allocator.capacity());
+    }
+}
+
+void GeometryPool::repack(u32 capacity) {
+    DEBUG_ASSERT(capacity >= _used);
+
+    // Keep the allocations in the same order, meshes loaded together stay close
+    std::vector<u32> live(_allocations.size());
+    std::iota(live.begin(), live.end(), 0u);
+    live.erase(std::remove_if(live.begin(), live.end(),
+                              [&](u32 id) { return !_allocations[id].count; }),
+               live.end());
+    std::sort(live.begin(), live.end(), [&](u32 lhs, u32 rhs) {
+        return _allocations[lhs].offset < _allocations[rhs].offset;
+    });
+
+    std::vector<ByteBuffer> buffers;
+    for (const u32 stride : _strides) {
+        buffers.emplace_back(nullptr, size_t(capacity) * stride);
+    }
+
+    _allocator = RangeAllocator(capacity);
+    for (const u32 id : live) {
+        Allocation& allocation = _allocations[id];
+        const u32 offset = _allocator.allocate(allocation.count);
+        for (size_t i = 0; i != _strides.size(); ++i) {
+            const size_t stride = _strides[i];
+            buffers[i].copy(_buffers[i], allocation.offset * stride, offset * stride,
+                            allocation.count * stride);
+        }
+        allocation.offset = offset;
+    }
+    _buffers = std::move(buffers);
+}
+
+GeometryRange::GeometryRange(GeometryPool* pool, u32 count) {
+    if (count) {
+        _pool = pool;
+        _id = pool->allocate(count);
+    }
+}
+
+GeometryRange::~GeometryRange() {
+    if (_pool) {
+        _pool->free(_id);
+    }
+}
+
+GeometryRange::GeometryRange(GeometryRange&& other) {
+    std::swap(_pool, other._pool);
+    std::swap(_id, other._id);
+}
+
+GeometryRange& GeometryRange::operator=(GeometryRange&& other) {
+    std::swap(_pool, other._pool);
+    std::swap(_id, other._id);
+    return *this;
+}
+
+void GeometryRange::write(u32 stream, const void* data, StagingBuffer* staging) {
+    if (_pool) {
+        _pool->write(_id, stream, data, staging);
+    }
+}
+
+GeometryPool* GeometryRange::pool() const {
+    return _pool;
+}
+
+u32 GeometryRange::offset() const {
+    return _pool ? _pool->offset(_id) : 0;
+}
+
+u32 GeometryRange::count() const {
+    return _pool ? _pool->count(_id) : 0;
+}
+
+GeometryArena& GeometryArena::global() {
+    static GeometryArena arena;
+    return arena;
+}
+
+GeometryPool& GeometryArena::vertex_pool(const VertexFormat& format) {
+    for (const auto& [pool_format, pool] : _vertex_pools) {
+        if (pool_format == format) {
+            return *pool;
+        }
+    }
+
+    std::vector<u32> strides;
+    for (u32 stream = 0; stream != format.stream_count(); ++stream) {
+        strides.push_back(format.stride(stream));
+    }
+    strides.push_back(format.positions_only().stride(0));
+    _vertex_pools.emplace_back(format, std::make_unique<GeometryPool>(std::move(strides)));
+    return *_vertex_pools.back().second;
+}
+
+GeometryPool& GeometryArena::index_pool() {
+    if (!_index_pool) {
+        _index_pool = std::make_unique<GeometryPool>(std::vector<u32>{sizeof(u32)});
+    }
+    return *_index_pool;
+}
+
+}
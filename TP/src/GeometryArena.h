@@ -0,0 +1,124 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <ByteBuffer.h>
+#include <StagingBuffer.h>
+#include <VertexFormat.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace OM3D {
+
+// Best fit free list over [0, capacity), in elements.
+// Free blocks are merged with their neighbours when released.
+class RangeAllocator {
+
+    public:
+        static constexpr u32 invalid_offset = u32(-1);
+
+        RangeAllocator(u32 capacity = 0);
+
+        // Returns invalid_offset if no free block is large enough
+        u32 allocate(u32 size);
+        void free(u32 offset, u32 size);
+
+        // New space is added after the current capacity
+        void grow(u32 capacity);
+
+        u32 capacity() const;
+        u32 free_space() const;
+
+    private:
+        void add_block(u32 offset, u32 size);
+        std::map<u32, u32>::iterator remove_block(std::map<u32, u32>::iterator block);
+
+        std::map<u32, u32> _blocks_by_offset;
+        std::multimap<u32, u32> _blocks_by_size;
+        u32 _capacity = 0;
+        u32 _free_space = 0;
+};
+
+// Large GL buffers shared by every mesh of a vertex layout, one buffer per stream.
+// Allocations are identified by an id because defragmentation moves them.
+class GeometryPool : NonMovable {
+
+    public:
+        GeometryPool(std::vector<u32> strides);
+
+        u32 allocate(u32 count);
+        void free(u32 id);
+
+        u32 offset(u32 id) const;
+        u32 count(u32 id) const;
+        // Uploads through staging if it is not null
+        void write(u32 id, u32 stream, const void* data, StagingBuffer* staging = nullptr);
+
+        u32 stream_count() const;
+        const ByteBuffer& buffer(u32 stream) const;
+
+        u32 used() const;
+        u32 capacity() const;
+
+        // Move every allocation to the start of the buffers, leaving one free block at the end
+        void defragment();
+
+    private:
+        // Copy the live allocations in order into new buffers of the given capacity
+        void repack(u32 capacity);
+
+        struct Allocation {
+            u32 offset = 0;
+            u32 count = 0;
+        };
+
+        std::vector<u32> _strides;
+        std::vector<ByteBuffer> _buffers;
+        RangeAllocator _allocator;
+
+        std::vector<Allocation> _allocations;
+        std::vector<u32> _free_ids;
+        u32 _used = 0;
+};
+
+// Allocation in a pool, released on destruction. Empty ranges have no pool.
+class GeometryRange : NonCopyable {
+
+    public:
+        GeometryRange() = default;
+        GeometryRange(GeometryPool* pool, u32 count);
+        ~GeometryRange();
+
+        GeometryRange(GeometryRange&& other);
+        GeometryRange& operator=(GeometryRange&& other);
+
+        void write(u32 stream, const void* data, StagingBuffer* staging = nullptr);
+
+        GeometryPool* pool() const;
+        u32 offset() const;
+        u32 count() const;
+
+    private:
+        GeometryPool* _pool = nullptr;
+        u32 _id = 0;
+};
+
+// Owns the pools of every mesh: one per vertex format, with the positions only stream after
+// the streams of the format, and one for the indices.
+class GeometryArena : NonMovable {
+
+    public:
+        static GeometryArena& global();
+
+        GeometryPool& vertex_pool(const VertexFormat& format);
+        GeometryPool& index_pool();
+
+    private:
+        std::vector<std::pair<VertexFormat, std::unique_ptr<GeometryPool>>> _vertex_pools;
+        std::unique_ptr<GeometryPool> _index_pool;
+};
+
+}
+
+#endif // GEOMETRYARENA_H
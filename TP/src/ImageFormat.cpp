@@ -2,6 +2,16 @@
 
 #include <glad/glad.h>
 
+// S3TC is not part of core OpenGL, but every desktop implementation supports it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
 namespace OM3D {
 
 ImageFormatGL image_format_to_gl(ImageFormat format) {
@@ -13,9 +23,61 @@ ImageFormatGL image_format_to_gl(ImageFormat format) {
         case ImageFormat::RGBA16_FLOAT:     return ImageFormatGL{ GL_RGBA, GL_RGBA16F, GL_FLOAT };
         case ImageFormat::Depth32_FLOAT:    return ImageFormatGL{ GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT32F, GL_FLOAT };
         case ImageFormat::RG16_FLOAT:       return ImageFormatGL{ GL_RG, GL_RG16F, GL_FLOAT };
+
+        case ImageFormat::BC1_UNORM:        return ImageFormatGL{ GL_RGB, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_UNSIGNED_BYTE };
+        case ImageFormat::BC1_sRGB:         return ImageFormatGL{ GL_RGB, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, GL_UNSIGNED_BYTE };
+        case ImageFormat::BC3_UNORM:        return ImageFormatGL{ GL_RGBA, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_UNSIGNED_BYTE };
+        case ImageFormat::BC3_sRGB:         return ImageFormatGL{ GL_RGBA, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, GL_UNSIGNED_BYTE };
+        case ImageFormat::BC5_UNORM:        return ImageFormatGL{ GL_RG, GL_COMPRESSED_RG_RGTC2, GL_UNSIGNED_BYTE };
     }
 
     FATAL("Unknown image format");
 }
 
+u32 bytes_per_pixel(ImageFormat format) {
+    switch(format) {
+        case ImageFormat::RGBA8_UNORM:
+        case ImageFormat::RGBA8_sRGB:
+        case ImageFormat::Depth32_FLOAT:
+        case ImageFormat::RG16_FLOAT:
+            return 4;
+        case ImageFormat::RGB8_UNORM:
+        case ImageFormat::RGB8_sRGB:
+            return 3;
+        case ImageFormat::RGBA16_FLOAT:
+            return 8;
+        default:
+            FATAL("Compressed formats have no pixel size");
+    }
+
+    FATAL("Unknown image format");
+}
+
+bool is_sRGB(ImageFormat format) {
+    return format == ImageFormat::RGBA8_sRGB || format == ImageFormat::RGB8_sRGB ||
+           format == ImageFormat::BC1_sRGB || format == ImageFormat::BC3_sRGB;
+}
+
+bool is_compressed(ImageFormat format) {
+    switch(format) {
+        case ImageFormat::BC1_UNORM:
+        case ImageFormat::BC1_sRGB:
+        case ImageFormat::BC3_UNORM:
+        case ImageFormat::BC3_sRGB:
+        case ImageFormat::BC5_UNORM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t image_byte_size(ImageFormat format, u32 width, u32 height) {
+    if(!is_compressed(format)) {
+        return size_t(width) * height * bytes_per_pixel(format);
+    }
+
+    const size_t block_bytes = format == ImageFormat::BC1_UNORM || format == ImageFormat::BC1_sRGB ? 8 : 16;
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * block_bytes;
+}
+
 }
@@ -14,7 +14,14 @@ enum class ImageFormat {
     RGBA16_FLOAT,
     Depth32_FLOAT,
 
-    RG16_FLOAT
+    RG16_FLOAT,
+
+    // Block compressed, 4x4 texels per block
+    BC1_UNORM,
+    BC1_sRGB,
+    BC3_UNORM,
+    BC3_sRGB,
+    BC5_UNORM,
 };
 
 
@@ -26,6 +33,13 @@ struct ImageFormatGL {
 
 ImageFormatGL image_format_to_gl(ImageFormat format);
 
+u32 bytes_per_pixel(ImageFormat format);
+bool is_sRGB(ImageFormat format);
+
+bool is_compressed(ImageFormat format);
+// Bytes of a width x height image, compressed images are made of whole blocks
+size_t image_byte_size(ImageFormat format, u32 width, u32 height);
+
 }
 
 #endif // IMAGEFORMAT_H
@@ -0,0 +1,359 @@
+#include "InstanceBatches.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+namespace OM3D {
+
+void InstanceBatches::add(u32 object, std::shared_ptr<StaticMesh> mesh,
+                          std::shared_ptr<Material> material, const glm::mat4& transform) {
+    if (object >= _object_batch.size()) {
+        _object_batch.resize(object + 1, invalid_index);
+        _object_rank.resize(object + 1, invalid_index);
+        _object_material.resize(object + 1, invalid_index);
+        _transforms.resize(object + 1, glm::mat4(1.0f));
+    }
+    DEBUG_ASSERT(_object_batch[object] == invalid_index);
+
+    const u32 material_id = material_index(std::move(material));
+    const std::shared_ptr<Material>& group = _materials[_material_groups[material_id]];
+
+    const std::pair<const StaticMesh*, const Material*> key(mesh.get(), group.get());
+    auto it = _batch_indices.find(key);
+    if (it == _batch_indices.end()) {
+        it = _batch_indices.emplace(key, u32(_batches.size())).first;
+        Batch& batch = _batches.emplace_back();
+        batch.mesh = std::move(mesh);
+        batch.material = group;
+    }
+
+    Batch& batch = _batches[it->second];
+    _object_batch[object] = it->second;
+    _object_rank[object] = u32(batch.objects.size());
+    _object_material[object] = material_id;
+    _transforms[object] = transform;
+    batch.objects.push_back(object);
+
+    if (batch.objects.size() > batch.capacity) {
+        _layout_dirty = true;
+    } else {
+        write_slot(object);
+    }
+}
+
+void InstanceBatches::set_transform(u32 object, const glm::mat4& transform) {
+    if (object >= _object_batch.size() || _object_batch[object] == invalid_index) {
+        return;
+    }
+
+    _transforms[object] = transform;
+    if (!_layout_dirty) {
+        write_slot(object);
+    }
+}
+
+void InstanceBatches::remove(u32 object) {
+    if (object >= _object_batch.size() || _object_batch[object] == invalid_index) {
+        return;
+    }
+
+    // The last object of the batch takes the slot of the removed one
+    Batch& batch = _batches[_object_batch[object]];
+    const u32 rank = _object_rank[object];
+    const u32 last = batch.objects.back();
+    batch.objects[rank] = last;
+    _object_rank[last] = rank;
+    batch.objects.pop_back();
+
+    if (last != object && !_layout_dirty) {
+        write_slot(last);
+    }
+
+    _object_batch[object] = invalid_index;
+    _object_rank[object] = invalid_index;
+    _object_material[object] = invalid_index;
+}
+
+void InstanceBatches::move(u32 from, u32 to) {
+    if (from >= _object_batch.size() || _object_batch[from] == invalid_index) {
+        return;
+    }
+    DEBUG_ASSERT(_object_batch[to] == invalid_index);
+
+    _object_batch[to] = _object_batch[from];
+    _object_rank[to] = _object_rank[from];
+    _object_material[to] = _object_material[from];
+    _transforms[to] = _transforms[from];
+    _batches[_object_batch[to]].objects[_object_rank[to]] = to;
+
+    _object_batch[from] = invalid_index;
+    _object_rank[from] = invalid_index;
+    _object_material[from] = invalid_index;
+}
+
+size_t InstanceBatches::batch_count() const {
+    return _batches.size();
+}
+
+u32 InstanceBatches::slot(u32 object) const {
+    return _batches[_object_batch[object]].first_slot + _object_rank[object];
+}
+
+void InstanceBatches::write_slot(u32 object) {
+    const u32 s = slot(object);
+    _slots[s].model = _transforms[object];
+    _slots[s].material = _object_material[object];
+    _dirty_slots.push_back(s);
+}
+
+u32 InstanceBatches::material_index(std::shared_ptr<Material> material) {
+    if (const auto it = _material_indices.find(material.get()); it != _material_indices.end()) {
+        return it->second;
+    }
+
+    const u32 index = u32(_materials.size());
+    u32 group = index;
+    for (u32 i = 0; i != index; ++i) {
+        if (_material_groups[i] == i && _materials[i]->can_batch_with(*material)) {
+            group = i;
+            break;
+        }
+    }
+
+    _material_indices.emplace(material.get(), index);
+    _materials.push_back(std::move(material));
+    _material_groups.push_back(group);
+    _materials_dirty = true;
+    return index;
+}
+
+// Give every batch a range with some room to grow, so that adding objects rarely moves ranges
+void InstanceBatches::layout() {
+    u32 slot_count = 0;
+    for (Batch& batch : _batches) {
+        const u32 size = u32(batch.objects.size());
+        batch.first_slot = slot_count;
+        batch.capacity = std::max(4u, size + size / 2);
+        slot_count += batch.capacity;
+    }
+
+    _slots.assign(slot_count, shader::InstanceData{});
+    for (const Batch& batch : _batches) {
+        for (const u32 object : batch.objects) {
+            write_slot(object);
+        }
+    }
+
+    _instance_buffer = TypedBuffer<shader::InstanceData>(_slots);
+    _dirty_slots.clear();
+    _layout_dirty = false;
+
+    _draw_order.resize(_batches.size());
+    for (u32 i = 0; i != _batches.size(); ++i) {
+        _draw_order[i] = i;
+    }
+    std::sort(_draw_order.begin(), _draw_order.end(), [&](u32 lhs, u32 rhs) {
+        const Batch& l = _batches[lhs];
+        const Batch& r = _batches[rhs];
+        if (l.material != r.material) {
+            return std::less<const Material*>()(l.material.get(), r.material.get());
+        }
+        return std::less<const GeometryPool*>()(l.mesh->vertex_pool(), r.mesh->vertex_pool());
+    });
+}
+
+void InstanceBatches::upload() {
+    if (_materials_dirty) {
+        std::vector<shader::MaterialData> entries;
+        for (const std::shared_ptr<Material>& material : _materials) {
+            entries.push_back(material->table_entry());
+        }
+        _material_buffer = TypedBuffer<shader::MaterialData>(entries);
+        _materials_dirty = false;
+    }
+
+    if (_layout_dirty) {
+        layout();
+        return;
+    }
+
+    if (_dirty_slots.empty()) {
+        return;
+    }
+
+    // Upload contiguous runs of dirty slots
+    std::sort(_dirty_slots.begin(), _dirty_slots.end());
+    _dirty_slots.erase(std::unique(_dirty_slots.begin(), _dirty_slots.end()), _dirty_slots.end());
+    for (size_t i = 0; i != _dirty_slots.size();) {
+        size_t end = i + 1;
+        while (end != _dirty_slots.size() && _dirty_slots[end] == _dirty_slots[end - 1] + 1) {
+            ++end;
+        }
+        _instance_buffer.write(&_slots[_dirty_slots[i]], end - i, _dirty_slots[i]);
+        i = end;
+    }
+    _dirty_slots.clear();
+}
+
+void InstanceBatches::draw(const std::vector<u32>& visible, const std::vector<u8>& lods,
+                           const Camera& camera, Program* depth_program) {
+    if (_batches.empty()) {
+        return;
+    }
+
+    upload();
+
+    // Bucket the visible objects per batch and level
+    for (Batch& batch : _batches) {
+        std::fill(std::begin(batch.visible_count), std::end(batch.visible_count), 0u);
+    }
+    for (const u32 object : visible) {
+        if (object < _object_batch.size() && _object_batch[object] != invalid_index) {
+            ++_batches[_object_batch[object]].visible_count[lods[object]];
+        }
+    }
+
+    u32 visible_count = 0;
+    for (Batch& batch : _batches) {
+        for (u32 level = 0; level != StaticMesh::max_lod_count; ++level) {
+            batch.visible_first[level] = visible_count;
+            visible_count += batch.visible_count[level];
+            batch.visible_count[level] = 0;
+        }
+    }
+
+    if (!visible_count) {
+        return;
+    }
+
+    _visible_slots.resize(visible_count);
+    _visible_objects.resize(visible_count);
+    for (const u32 object : visible) {
+        if (object < _object_batch.size() && _object_batch[object] != invalid_index) {
+            Batch& batch = _batches[_object_batch[object]];
+            const u8 level = lods[object];
+            const u32 instance = batch.visible_first[level] + batch.visible_count[level]++;
+            _visible_slots[instance] = slot(object);
+            _visible_objects[instance] = object;
+        }
+    }
+
+    // Every instance gets its own cluster ranges, its base instance selects its slot
+    const FrustumPlanes frustum = FrustumPlanes::from_camera(camera);
+    const glm::vec3 camera_position = camera.position();
+    _commands.clear();
+    for (Batch& batch : _batches) {
+        batch.command_first = u32(_commands.size());
+        const std::vector<Meshlet>& meshlets = batch.mesh->meshlets();
+        if (!meshlets.empty()) {
+            const u32 base_index = batch.mesh->base_index();
+            const i32 base_vertex = i32(batch.mesh->base_vertex());
+            for (u32 i = 0; i != batch.visible_count[0]; ++i) {
+                const u32 instance = batch.visible_first[0] + i;
+                _ranges.clear();
+                cull_meshlets(meshlets, frustum, _transforms[_visible_objects[instance]],
+                              camera_position, _ranges);
+                for (const IndexRange& range : _ranges) {
+                    _commands.push_back({range.index_count, 1, base_index + range.first_index,
+                                         base_vertex, instance});
+                }
+            }
+        }
+        batch.command_count = u32(_commands.size()) - batch.command_first;
+    }
+
+    if (!_commands.empty()) {
+        if (_command_buffer.element_count() < _commands.size()) {
+            const size_t capacity =
+                std::max<size_t>(_commands.size(), 2 * _command_buffer.element_count());
+            _command_buffer = TypedBuffer<DrawCommand>(nullptr, capacity);
+        }
+        _command_buffer.write(_commands.data(), _commands.size());
+        _command_buffer.bind(BufferUsage::Indirect);
+    }
+
+    if (_visible_buffer.element_count() < visible_count) {
+        const size_t capacity = std::max<size_t>(visible_count, 2 * _visible_buffer.element_count());
+        std::vector<u32> storage(capacity);
+        _visible_buffer = TypedBuffer<u32>(storage);
+    }
+    _visible_buffer.write(_visible_slots.data(), visible_count);
+
+    _instance_buffer.bind(BufferUsage::Storage, 2);
+    _material_buffer.bind(BufferUsage::Storage, 3);
+
+    // Per instance slot in the transform buffer
+    _visible_buffer.bind(BufferUsage::Attribute);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(u32), nullptr);
+    glEnableVertexAttribArray(5);
+    glVertexAttribDivisor(5, 1);
+    glDisableVertexAttribArray(6);
+    glDisableVertexAttribArray(7);
+    glDisableVertexAttribArray(8);
+
+    if (depth_program) {
+        depth_program->bind();
+    }
+
+    // Meshes of the same pool share their buffers and attribute setup, and batches of the same
+    // materials their program and textures
+    const GeometryPool* bound_pool = nullptr;
+    const Material* bound_material = nullptr;
+    for (const u32 index : _draw_order) {
+        const Batch& batch = _batches[index];
+        if (std::all_of(std::begin(batch.visible_count), std::end(batch.visible_count),
+                        [](u32 count) { return !count; })) {
+            continue;
+        }
+        // Blended batches do not write depth, they must be skipped before their pool is recorded
+        // as bound since their buffers are never bound
+        if (depth_program && batch.material->blend_mode() != BlendMode::None) {
+            continue;
+        }
+
+        const bool bind = batch.mesh->vertex_pool() != bound_pool;
+        bound_pool = batch.mesh->vertex_pool();
+        if (depth_program) {
+            batch.mesh->set_vertex_uniforms(*depth_program);
+            if (bind) {
+                batch.mesh->bind_positions();
+            }
+        } else {
+            if (batch.material.get() != bound_material) {
+                batch.material->bind(RenderMode::INSTANCED);
+                bound_material = batch.material.get();
+            }
+            batch.mesh->set_vertex_uniforms(*batch.material, RenderMode::INSTANCED);
+            if (bind) {
+                batch.mesh->bind_vertices();
+            }
+        }
+
+        const u32 base_index = batch.mesh->base_index();
+        const i32 base_vertex = i32(batch.mesh->base_vertex());
+
+        for (u32 level = 0; level != batch.mesh->lod_count(); ++level) {
+            if (!batch.visible_count[level]) {
+                continue;
+            }
+            if (level == 0 && !batch.mesh->meshlets().empty()) {
+                if (batch.command_count) {
+                    glMultiDrawElementsIndirect(
+                        GL_TRIANGLES, GL_UNSIGNED_INT,
+                        reinterpret_cast<void*>(batch.command_first * sizeof(DrawCommand)),
+                        int(batch.command_count), 0);
+                }
+                continue;
+            }
+
+            const StaticMesh::LodRange& range = batch.mesh->lod(level);
+            glDrawElementsInstancedBaseVertexBaseInstance(
+                GL_TRIANGLES, int(range.index_count), GL_UNSIGNED_INT,
+                reinterpret_cast<void*>((base_index + range.first_index) * sizeof(u32)),
+                int(batch.visible_count[level]), base_vertex, batch.visible_first[level]);
+        }
+    }
+}
+
+}
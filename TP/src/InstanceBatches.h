@@ -0,0 +1,127 @@
+#ifndef INSTANCEBATCHES_H
+#define INSTANCEBATCHES_H
+
+#include <StaticMesh.h>
+#include <Material.h>
+#include <TypedBuffer.h>
+#include <Camera.h>
+#include <Meshlet.h>
+#include <shader_structs.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace OM3D {
+
+// Persistent table of instanced draws, one batch per mesh and group of materials that can be drawn
+// together (see Material::can_batch_with), and one draw per level of detail of the mesh.
+// Each batch owns a contiguous range of a GPU resident instance buffer, which holds the transform
+// and the index in the material table of every object. Only instances that changed are uploaded,
+// and each frame only the slots of the visible objects are sent.
+class InstanceBatches : NonCopyable {
+
+    static constexpr u32 invalid_index = u32(-1);
+
+    struct Batch {
+        std::shared_ptr<StaticMesh> mesh;
+        // First material of the group, the one that is bound
+        std::shared_ptr<Material> material;
+        std::vector<u32> objects;
+
+        u32 first_slot = 0;
+        u32 capacity = 0;
+
+        // Visible instances of every level of detail
+        u32 visible_first[StaticMesh::max_lod_count] = {};
+        u32 visible_count[StaticMesh::max_lod_count] = {};
+
+        // Indirect draws of the clusters of the full detail instances
+        u32 command_first = 0;
+        u32 command_count = 0;
+    };
+
+    // Layout of GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+    struct DrawCommand {
+        u32 index_count;
+        u32 instance_count;
+        u32 first_index;
+        i32 base_vertex;
+        u32 base_instance;
+    };
+
+    struct BatchKeyHasher {
+        size_t operator()(const std::pair<const StaticMesh*, const Material*>& key) const {
+            size_t seed = std::hash<const void*>()(key.first);
+            hash_combine(seed, std::hash<const void*>()(key.second));
+            return seed;
+        }
+    };
+
+    public:
+        InstanceBatches() = default;
+
+        void add(u32 object, std::shared_ptr<StaticMesh> mesh, std::shared_ptr<Material> material,
+                 const glm::mat4& transform);
+        void set_transform(u32 object, const glm::mat4& transform);
+
+        // Objects are removed by moving the last one in the hole: move() renames an object
+        // without touching its slot
+        void remove(u32 object);
+        void move(u32 from, u32 to);
+
+        // Issue one instanced draw per batch and level of detail that has visible objects.
+        // lods holds the level of every object, indexed by object.
+        // Meshes split in meshlets are drawn at full detail with one multi-draw of the clusters
+        // that face the camera and intersect the frustum.
+        // With a depth program, opaque batches are drawn with it from their position stream and
+        // the material state is left to the caller.
+        void draw(const std::vector<u32>& visible, const std::vector<u8>& lods,
+                  const Camera& camera, Program* depth_program = nullptr);
+
+        size_t batch_count() const;
+
+    private:
+        u32 slot(u32 object) const;
+        void write_slot(u32 object);
+        u32 material_index(std::shared_ptr<Material> material);
+        void layout();
+        void upload();
+
+        std::vector<Batch> _batches;
+        std::unordered_map<std::pair<const StaticMesh*, const Material*>, u32, BatchKeyHasher> _batch_indices;
+        // Batches sorted by material then vertex pool, to bind them as few times as possible
+        std::vector<u32> _draw_order;
+
+        std::vector<u32> _object_batch;
+        std::vector<u32> _object_rank;
+        std::vector<u32> _object_material;
+        std::vector<glm::mat4> _transforms;
+
+        // Material table, in the order materials were first seen. Materials are kept alive so that
+        // their address is not reused by another one.
+        std::vector<std::shared_ptr<Material>> _materials;
+        std::unordered_map<const Material*, u32> _material_indices;
+        // Index of the first material of the group of each material
+        std::vector<u32> _material_groups;
+        bool _materials_dirty = false;
+        TypedBuffer<shader::MaterialData> _material_buffer;
+
+        // CPU mirror of the GPU instance buffer, indexed by slot
+        std::vector<shader::InstanceData> _slots;
+        std::vector<u32> _dirty_slots;
+        bool _layout_dirty = false;
+        TypedBuffer<shader::InstanceData> _instance_buffer;
+
+        std::vector<u32> _visible_slots;
+        std::vector<u32> _visible_objects;
+        TypedBuffer<u32> _visible_buffer;
+
+        std::vector<IndexRange> _ranges;
+        std::vector<DrawCommand> _commands;
+        TypedBuffer<DrawCommand> _command_buffer;
+};
+
+}
+
+#endif // INSTANCEBATCHES_H
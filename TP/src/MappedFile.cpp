@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+
+#ifdef OS_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+namespace OM3D {
+
+MappedFile::MappedFile(MappedFile&& other) {
+    swap(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    swap(other);
+    return *this;
+}
+
+void MappedFile::swap(MappedFile& other) {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+#ifdef OS_WIN
+    std::swap(_mapping, other._mapping);
+#endif
+}
+
+#ifdef OS_WIN
+MappedFile::~MappedFile() {
+    if (_data) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping) {
+        CloseHandle(_mapping);
+    }
+}
+
+Result<MappedFile> MappedFile::open(const std::string& file_name) {
+    const HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return {false, {}};
+    }
+    DEFER(CloseHandle(file));
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(file, &size) || !size.QuadPart) {
+        return {false, {}};
+    }
+
+    MappedFile mapped;
+    mapped._mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapped._mapping) {
+        return {false, {}};
+    }
+
+    mapped._data = static_cast<const u8*>(MapViewOfFile(mapped._mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mapped._data) {
+        return {false, {}};
+    }
+    mapped._size = size_t(size.QuadPart);
+
+    return {true, std::move(mapped)};
+}
+#else
+MappedFile::~MappedFile() {
+    if (_data) {
+        munmap(const_cast<u8*>(_data), _size);
+    }
+}
+
+Result<MappedFile> MappedFile::open(const std::string& file_name) {
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return {false, {}};
+    }
+    DEFER(::close(fd));
+
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        return {false, {}};
+    }
+
+    const size_t size = size_t(info.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return {false, {}};
+    }
+
+    // The whole file is read right after opening
+    madvise(data, size, MADV_WILLNEED);
+
+    MappedFile mapped;
+    mapped._data = static_cast<const u8*>(data);
+    mapped._size = size;
+    return {true, std::move(mapped)};
+}
+#endif
+
+const u8* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
+
+}
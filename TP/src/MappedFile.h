@@ -0,0 +1,36 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <utils.h>
+
+#include <string>
+
+namespace OM3D {
+
+// Read only view of a whole file, mapped in memory
+class MappedFile : NonCopyable {
+
+    public:
+        MappedFile() = default;
+        MappedFile(MappedFile&& other);
+        MappedFile& operator=(MappedFile&& other);
+        ~MappedFile();
+
+        static Result<MappedFile> open(const std::string& file_name);
+
+        const u8* data() const;
+        size_t size() const;
+
+    private:
+        void swap(MappedFile& other);
+
+        const u8* _data = nullptr;
+        size_t _size = 0;
+#ifdef OS_WIN
+        void* _mapping = nullptr;
+#endif
+};
+
+}
+
+#endif // MAPPEDFILE_H
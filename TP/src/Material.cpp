@@ -3,12 +3,13 @@
 #include <glad/glad.h>
 
 #include <algorithm>
+#include <atomic>
 
 namespace OM3D {
 
 Material::Material() {
-    static int i = 0;
-    uid = ++i;
+    static std::atomic<int> next_uid = 0;
+    uid = ++next_uid;
 }
 
 void Material::set_program(std::shared_ptr<Program> prog) {
@@ -27,14 +28,46 @@ void Material::set_depth_mask_mode(DepthMaskMode mask) {
     _depth_mask_mode = mask;
 }
 
-void Material::set_texture(u32 slot, std::shared_ptr<Texture> tex) {
+BlendMode Material::blend_mode() const {
+    return _blend_mode;
+}
+
+void Material::set_texture(u32 slot, std::shared_ptr<Texture> tex, u32 layer) {
+    DEBUG_ASSERT(tex->is_array() && layer < tex->layers());
     if (const auto it = std::find_if(_textures.begin(), _textures.end(),
-                                     [&](const auto& t) { return t.second == tex; });
+                                     [&](const auto& t) { return t.slot == slot; });
         it != _textures.end()) {
-        it->second = std::move(tex);
+        it->texture = std::move(tex);
+        it->layer = layer;
     } else {
-        _textures.emplace_back(slot, std::move(tex));
+        _textures.push_back({slot, std::move(tex), layer});
+    }
+}
+
+bool Material::can_batch_with(const Material& other) const {
+    if (_program != other._program || _program2 != other._program2 ||
+        _program3 != other._program3 || _blend_mode != other._blend_mode ||
+        _depth_test_mode != other._depth_test_mode || _depth_mask_mode != other._depth_mask_mode ||
+        _textures.size() != other._textures.size()) {
+        return false;
+    }
+    for (size_t i = 0; i != _textures.size(); ++i) {
+        if (_textures[i].slot != other._textures[i].slot ||
+            _textures[i].texture != other._textures[i].texture) {
+            return false;
+        }
+    }
+    return true;
+}
+
+shader::MaterialData Material::table_entry() const {
+    shader::MaterialData entry = {};
+    for (const TextureBinding& texture : _textures) {
+        if (texture.slot < 4) {
+            entry.texture_layers[texture.slot] = texture.layer;
+        }
     }
+    return entry;
 }
 
 void Material::bind(RenderMode render) const {
@@ -94,17 +127,19 @@ void Material::bind(RenderMode render) const {
             break;
     }
 
-    for (const auto& texture : _textures) {
-        texture.second->bind(texture.first);
+    for (const TextureBinding& texture : _textures) {
+        texture.texture->bind(texture.slot);
     }
     switch (render) {
         case RenderMode::INSTANCED:
             _program->bind();
             break;
         case RenderMode::NON_INSTANCED:
+            _program2->set_uniform(HASH("texture_layers"), table_entry().texture_layers);
             _program2->bind();
             break;
         case RenderMode::OCC_DEBUG:
+            _program3->set_uniform(HASH("texture_layers"), table_entry().texture_layers);
             _program3->bind();
             break;
     }
@@ -3,6 +3,7 @@
 
 #include <Program.h>
 #include <Texture.h>
+#include <shader_structs.h>
 
 #include <memory>
 #include <vector>
@@ -33,7 +34,15 @@ public:
     void set_blend_mode(BlendMode blend);
     void set_depth_test_mode(DepthTestMode depth);
     void set_depth_mask_mode(DepthMaskMode mask);
-    void set_texture(u32 slot, std::shared_ptr<Texture> tex);
+    // Textures are sampled as arrays, the material reads one layer of each
+    void set_texture(u32 slot, std::shared_ptr<Texture> tex, u32 layer = 0);
+
+    BlendMode blend_mode() const;
+
+    // Materials with the same programs, states and textures can be drawn together, even when they
+    // sample different layers. Instanced draws read the layers from the material table.
+    bool can_batch_with(const Material& other) const;
+    shader::MaterialData table_entry() const;
 
     template <typename... Args>
     void set_uniform(RenderMode render, Args&&... args) {
@@ -56,10 +65,16 @@ public:
     static Material textured_normal_mapped_material();
 
 private:
+    struct TextureBinding {
+        u32 slot = 0;
+        std::shared_ptr<Texture> texture;
+        u32 layer = 0;
+    };
+
     std::shared_ptr<Program> _program;
     std::shared_ptr<Program> _program2;
     std::shared_ptr<Program> _program3;
-    std::vector<std::pair<u32, std::shared_ptr<Texture>>> _textures;
+    std::vector<TextureBinding> _textures;
 
     BlendMode _blend_mode = BlendMode::None;
     DepthTestMode _depth_test_mode = DepthTestMode::Standard;
@@ -0,0 +1,49 @@
+#include "MeshCache.h"
+
+#include <cstring>
+
+namespace OM3D {
+
+// FNV-1a over 32 bit words, the vertices only contain floats
+static u64 hash_words(const void* data, size_t size, u64 hash) {
+    DEBUG_ASSERT(size % sizeof(u32) == 0);
+    const byte* bytes = static_cast<const byte*>(data);
+    for (size_t i = 0; i != size; i += sizeof(u32)) {
+        u32 word = 0;
+        std::memcpy(&word, bytes + i, sizeof(u32));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return hash;
+}
+
+MeshKey MeshKey::from_data(const MeshData& data) {
+    static_assert(sizeof(Vertex) % sizeof(u32) == 0);
+    u64 hash = 14695981039346656037ull;
+    hash = hash_words(data.vertices.data(), data.vertices.size() * sizeof(Vertex), hash);
+    hash = hash_words(data.indices.data(), data.indices.size() * sizeof(u32), hash);
+    return {hash, data.vertices.size(), data.indices.size()};
+}
+
+MeshCache& MeshCache::global() {
+    static MeshCache cache;
+    return cache;
+}
+
+std::shared_ptr<StaticMesh> MeshCache::find(const MeshKey& key) {
+    const auto it = _meshes.find(key);
+    if (it == _meshes.end()) {
+        return nullptr;
+    }
+
+    auto mesh = it->second.lock();
+    if (!mesh) {
+        _meshes.erase(it);
+    }
+    return mesh;
+}
+
+void MeshCache::add(const MeshKey& key, std::shared_ptr<StaticMesh> mesh) {
+    _meshes[key] = std::move(mesh);
+}
+
+}
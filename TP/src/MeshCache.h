@@ -0,0 +1,50 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <StaticMesh.h>
+
+#include <memory>
+#include <unordered_map>
+
+namespace OM3D {
+
+// Identifies mesh content before import processing.
+// The sizes guard against hash collisions.
+struct MeshKey {
+    u64 hash = 0;
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+
+    static MeshKey from_data(const MeshData& data);
+
+    bool operator==(const MeshKey& other) const {
+        return hash == other.hash && vertex_count == other.vertex_count &&
+               index_count == other.index_count;
+    }
+};
+
+// Shares the GPU geometry of identical meshes, even across files, so that their objects end up
+// in the same instanced batches.
+// Meshes are only kept alive by the objects that use them.
+class MeshCache : NonMovable {
+
+    struct KeyHasher {
+        size_t operator()(const MeshKey& key) const {
+            return size_t(key.hash);
+        }
+    };
+
+    public:
+        static MeshCache& global();
+
+        // Returns null if no living mesh was imported from the same data
+        std::shared_ptr<StaticMesh> find(const MeshKey& key);
+        void add(const MeshKey& key, std::shared_ptr<StaticMesh> mesh);
+
+    private:
+        std::unordered_map<MeshKey, std::weak_ptr<StaticMesh>, KeyHasher> _meshes;
+};
+
+}
+
+#endif // MESHCACHE_H
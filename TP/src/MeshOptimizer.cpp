@@ -0,0 +1,320 @@
+#include "MeshOptimizer.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace OM3D {
+
+static constexpr u32 invalid_index = u32(-1);
+
+VertexCacheStats analyze_vertex_cache(const std::vector<u32>& indices, size_t vertex_count,
+                                      u32 cache_size) {
+    VertexCacheStats stats;
+
+    // Time at which every vertex entered the cache
+    std::vector<u64> cache_time(vertex_count, 0);
+    std::vector<u8> referenced(vertex_count, 0);
+    u64 time = u64(cache_size) + 1;
+    for (const u32 index : indices) {
+        if (time - cache_time[index] > cache_size) {
+            cache_time[index] = time++;
+            ++stats.misses;
+        }
+        stats.vertices += !referenced[index];
+        referenced[index] = 1;
+    }
+
+    stats.triangles = indices.size() / 3;
+    return stats;
+}
+
+void VertexCacheStats::add(const VertexCacheStats& other) {
+    misses += other.misses;
+    triangles += other.triangles;
+    vertices += other.vertices;
+}
+
+float VertexCacheStats::acmr() const {
+    return triangles ? float(misses) / float(triangles) : 0.0f;
+}
+
+float VertexCacheStats::atvr() const {
+    return vertices ? float(misses) / float(vertices) : 0.0f;
+}
+
+static u32 hash_vertex(const Vertex& vertex) {
+    // FNV-1a over the bytes of the vertex
+    const u8* bytes = reinterpret_cast<const u8*>(&vertex);
+    u32 hash = 2166136261u;
+    for (size_t i = 0; i != sizeof(Vertex); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void weld_vertices(MeshData& mesh) {
+    static_assert(sizeof(Vertex) == 15 * sizeof(float), "Vertex must not have padding");
+
+    const size_t vertex_count = mesh.vertices.size();
+    size_t table_size = 1;
+    while (table_size < 2 * vertex_count) {
+        table_size *= 2;
+    }
+
+    // Open addressing table of unique vertex indices
+    std::vector<u32> table(table_size, invalid_index);
+    std::vector<u32> remap(vertex_count);
+    std::vector<Vertex> unique;
+    unique.reserve(vertex_count);
+    for (size_t v = 0; v != vertex_count; ++v) {
+        const Vertex& vertex = mesh.vertices[v];
+        size_t slot = hash_vertex(vertex) & (table_size - 1);
+        while (table[slot] != invalid_index &&
+               std::memcmp(&unique[table[slot]], &vertex, sizeof(Vertex))) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == invalid_index) {
+            table[slot] = u32(unique.size());
+            unique.push_back(vertex);
+        }
+        remap[v] = table[slot];
+    }
+
+    if (unique.size() == vertex_count) {
+        return;
+    }
+
+    mesh.vertices = std::move(unique);
+    for (u32& index : mesh.indices) {
+        index = remap[index];
+    }
+    for (MeshLod& level : mesh.lods) {
+        for (u32& index : level.indices) {
+            index = remap[index];
+        }
+    }
+}
+
+void optimize_vertex_cache(u32* indices, size_t index_count, size_t vertex_count, u32 cache_size,
+                           std::vector<u32>* clusters) {
+    const u32 triangle_count = u32(index_count / 3);
+    if (!triangle_count) {
+        return;
+    }
+
+    // Vertex to triangle adjacency and number of triangles still to emit per vertex
+    std::vector<u32> offsets(vertex_count + 1, 0);
+    for (size_t i = 0; i != index_count; ++i) {
+        ++offsets[indices[i] + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<u32> adjacency(index_count);
+    std::vector<u32> live(vertex_count, 0);
+    {
+        std::vector<u32> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i != index_count; ++i) {
+            adjacency[cursor[indices[i]]++] = u32(i / 3);
+            ++live[indices[i]];
+        }
+    }
+
+    std::vector<u32> cache_time(vertex_count, 0);
+    std::vector<u8> emitted(triangle_count, 0);
+    std::vector<u32> dead_ends;
+    std::vector<u32> candidates;
+    std::vector<u32> output;
+    output.reserve(index_count);
+    u32 time = cache_size + 1;
+    u32 cursor = 0;
+
+    // Next vertex with live triangles, first from the dead-end stack, then in input order
+    const auto skip_dead_end = [&](bool& jumped) {
+        while (!dead_ends.empty()) {
+            const u32 v = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[v]) {
+                return v;
+            }
+        }
+        jumped = true;
+        for (; cursor != vertex_count; ++cursor) {
+            if (live[cursor]) {
+                return cursor;
+            }
+        }
+        return invalid_index;
+    };
+
+    bool jumped = false;
+    u32 fanning = skip_dead_end(jumped);
+    while (fanning != invalid_index) {
+        if (jumped && clusters) {
+            clusters->push_back(u32(output.size()));
+        }
+
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (u32 a = offsets[fanning]; a != offsets[fanning + 1]; ++a) {
+            const u32 triangle = adjacency[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = 1;
+            for (u32 c = 0; c != 3; ++c) {
+                const u32 v = indices[triangle * 3 + c];
+                output.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cache_time[v] > cache_size) {
+                    cache_time[v] = time++;
+                }
+            }
+        }
+
+        // Prefer the candidate that entered the cache first among those that will still be in
+        // it once all their triangles are emitted
+        u32 next = invalid_index;
+        u32 best = 0;
+        for (const u32 v : candidates) {
+            if (!live[v]) {
+                continue;
+            }
+            u32 priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+                priority = time - cache_time[v];
+            }
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        jumped = false;
+        fanning = next != invalid_index ? next : skip_dead_end(jumped);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimize_meshlets(std::vector<u32>& indices, size_t vertex_count,
+                       const std::vector<Meshlet>& meshlets, u32 cache_size) {
+    // Meshlets only reference a few vertices, remap them to a small local range
+    std::vector<u32> local;
+    std::vector<u32> global;
+    std::vector<u32> local_index(vertex_count, invalid_index);
+    for (const Meshlet& meshlet : meshlets) {
+        u32* range = indices.data() + meshlet.first_index;
+        local.resize(meshlet.index_count);
+        global.clear();
+        for (u32 i = 0; i != meshlet.index_count; ++i) {
+            u32& l = local_index[range[i]];
+            if (l == invalid_index) {
+                l = u32(global.size());
+                global.push_back(range[i]);
+            }
+            local[i] = l;
+        }
+
+        optimize_vertex_cache(local.data(), local.size(), global.size(), cache_size);
+
+        for (u32 i = 0; i != meshlet.index_count; ++i) {
+            range[i] = global[local[i]];
+        }
+        for (const u32 v : global) {
+            local_index[v] = invalid_index;
+        }
+    }
+}
+
+void optimize_overdraw(const std::vector<Vertex>& vertices, std::vector<u32>& indices,
+                       u32 cache_size) {
+    std::vector<u32> cluster_starts;
+    optimize_vertex_cache(indices.data(), indices.size(), vertices.size(), cache_size,
+                          &cluster_starts);
+    if (cluster_starts.size() < 2) {
+        return;
+    }
+    cluster_starts.push_back(u32(indices.size()));
+
+    glm::vec3 mesh_center = glm::vec3(0.0f);
+    float mesh_area = 0.0f;
+
+    struct Cluster {
+        u32 first = 0;
+        u32 end = 0;
+        glm::vec3 center = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        float area = 0.0f;
+        float sort_key = 0.0f;
+    };
+
+    // Area weighted centroid and normal of every cluster
+    std::vector<Cluster> clusters(cluster_starts.size() - 1);
+    for (size_t c = 0; c != clusters.size(); ++c) {
+        Cluster& cluster = clusters[c];
+        cluster.first = cluster_starts[c];
+        cluster.end = cluster_starts[c + 1];
+        for (u32 i = cluster.first; i != cluster.end; i += 3) {
+            const glm::vec3& p0 = vertices[indices[i + 0]].position;
+            const glm::vec3& p1 = vertices[indices[i + 1]].position;
+            const glm::vec3& p2 = vertices[indices[i + 2]].position;
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(n);
+            cluster.center += (p0 + p1 + p2) * (area / 3.0f);
+            cluster.normal += n;
+            cluster.area += area;
+        }
+        mesh_center += cluster.center;
+        mesh_area += cluster.area;
+        if (cluster.area > 0.0f) {
+            cluster.center /= cluster.area;
+        }
+    }
+    if (mesh_area > 0.0f) {
+        mesh_center /= mesh_area;
+    }
+
+    for (Cluster& cluster : clusters) {
+        const float length = glm::length(cluster.normal);
+        cluster.sort_key =
+            length > 0.0f ? glm::dot(cluster.center - mesh_center, cluster.normal / length) : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& lhs, const Cluster& rhs) {
+        return lhs.sort_key > rhs.sort_key;
+    });
+
+    std::vector<u32> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        sorted.insert(sorted.end(), indices.begin() + cluster.first, indices.begin() + cluster.end);
+    }
+    indices = std::move(sorted);
+}
+
+void optimize_vertex_fetch(MeshData& mesh) {
+    std::vector<u32> remap(mesh.vertices.size(), invalid_index);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    const auto fetch = [&](std::vector<u32>& indices) {
+        for (u32& index : indices) {
+            if (remap[index] == invalid_index) {
+                remap[index] = u32(vertices.size());
+                vertices.push_back(mesh.vertices[index]);
+            }
+            index = remap[index];
+        }
+    };
+
+    fetch(mesh.indices);
+    for (MeshLod& level : mesh.lods) {
+        fetch(level.indices);
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <StaticMesh.h>
+
+#include <vector>
+
+namespace OM3D {
+
+// Post-transform vertex cache efficiency of an index list, for a FIFO cache
+struct VertexCacheStats {
+    u64 misses = 0;
+    u64 triangles = 0;
+    u64 vertices = 0;
+
+    void add(const VertexCacheStats& other);
+
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 at best
+    float acmr() const;
+    // Average transform to vertex ratio: transformed vertices per referenced vertex, 1 at best
+    float atvr() const;
+};
+
+// Typical size of the post-transform cache on current hardware
+static constexpr u32 vertex_cache_size = 16;
+
+VertexCacheStats analyze_vertex_cache(const std::vector<u32>& indices, size_t vertex_count,
+                                      u32 cache_size = vertex_cache_size);
+
+// Merge the vertices that are identical in every attribute
+void weld_vertices(MeshData& mesh);
+
+// Reorder triangles for vertex cache locality with Tipsify (Sander et al.), in place.
+// If clusters is not null, it receives the first index of every cluster of triangles that was
+// started away from the previous one.
+void optimize_vertex_cache(u32* indices, size_t index_count, size_t vertex_count,
+                           u32 cache_size = vertex_cache_size, std::vector<u32>* clusters = nullptr);
+
+// Reorder the triangles of every meshlet for vertex cache locality, meshlets keep their range
+void optimize_meshlets(std::vector<u32>& indices, size_t vertex_count,
+                       const std::vector<Meshlet>& meshlets, u32 cache_size = vertex_cache_size);
+
+// Reorder triangles for vertex cache locality, then sort the Tipsify clusters so that the ones
+// facing out of the mesh are drawn first, which hides the others behind them
+void optimize_overdraw(const std::vector<Vertex>& vertices, std::vector<u32>& indices,
+                       u32 cache_size = vertex_cache_size);
+
+// Reorder vertices in order of first use by the indices, then by the levels of detail.
+// Vertices that are not referenced are dropped.
+void optimize_vertex_fetch(MeshData& mesh);
+
+}
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,359 @@
+#include "MeshSimplifier.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+namespace OM3D {
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes, weighted by area
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    void add_plane(const glm::dvec3& n, double d, double w) {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a22 += w * n.z * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00;
+        a01 += q.a01;
+        a02 += q.a02;
+        a11 += q.a11;
+        a12 += q.a12;
+        a22 += q.a22;
+        b0 += q.b0;
+        b1 += q.b1;
+        b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    // Mean squared distance of p to the planes
+    double error(const glm::dvec3& p) const {
+        if (weight <= 0.0) {
+            return 0.0;
+        }
+        const double e = p.x * (a00 * p.x + 2.0 * (a01 * p.y + a02 * p.z + b0)) +
+                         p.y * (a11 * p.y + 2.0 * (a12 * p.z + b1)) +
+                         p.z * (a22 * p.z + 2.0 * b2) + c;
+        return std::max(e, 0.0) / weight;
+    }
+};
+
+// Collapsing across different normals or uvs costs as much as moving this fraction of the radius
+static constexpr double attribute_weight = 0.05;
+
+// Triangles whose normal turns by more than about 75 degrees are considered flipped
+static constexpr double flip_threshold = 0.25;
+
+static u64 edge_key(u32 a, u32 b) {
+    return a < b ? (u64(a) << 32) | b : (u64(b) << 32) | a;
+}
+
+// Group vertices sharing a position, every vertex is mapped to the first one of its group
+static std::vector<u32> position_remap(const std::vector<Vertex>& vertices) {
+    std::vector<u32> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0u);
+    const auto less = [&](u32 lhs, u32 rhs) {
+        const glm::vec3& a = vertices[lhs].position;
+        const glm::vec3& b = vertices[rhs].position;
+        if (a.x != b.x) {
+            return a.x < b.x;
+        }
+        if (a.y != b.y) {
+            return a.y < b.y;
+        }
+        if (a.z != b.z) {
+            return a.z < b.z;
+        }
+        return lhs < rhs;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    std::vector<u32> remap(vertices.size());
+    for (size_t i = 0; i != order.size(); ++i) {
+        const bool same = i && vertices[order[i]].position == vertices[order[i - 1]].position;
+        remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+    }
+    return remap;
+}
+
+std::vector<u32> simplify_mesh(const std::vector<Vertex>& vertices,
+                               const std::vector<u32>& indices, size_t target_index_count,
+                               float max_error, float* error) {
+    const size_t vertex_count = vertices.size();
+    std::vector<u32> result = indices;
+    double result_error = 0.0;
+
+    if (result.size() <= target_index_count || !vertex_count) {
+        if (error) {
+            *error = 0.0f;
+        }
+        return result;
+    }
+
+    const std::vector<u32> remap = position_remap(vertices);
+
+    // Vertices that share their position with another one sit on an attribute seam
+    std::vector<u8> locked(vertex_count, 0);
+    for (u32 v = 0; v != vertex_count; ++v) {
+        if (remap[v] != v) {
+            locked[v] = 1;
+            locked[remap[v]] = 1;
+        }
+    }
+
+    // Border and non manifold edges have one or more than two triangles
+    {
+        std::vector<u64> edges;
+        edges.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (u32 e = 0; e != 3; ++e) {
+                edges.push_back(edge_key(remap[result[i + e]], remap[result[i + (e + 1) % 3]]));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i != edges.size();) {
+            size_t end = i + 1;
+            while (end != edges.size() && edges[end] == edges[i]) {
+                ++end;
+            }
+            if (end - i != 2) {
+                locked[u32(edges[i] >> 32)] = 1;
+                locked[u32(edges[i])] = 1;
+            }
+            i = end;
+        }
+        // Propagate to every vertex of the group
+        for (u32 v = 0; v != vertex_count; ++v) {
+            locked[v] |= locked[remap[v]];
+        }
+    }
+
+    double radius_sq = 0.0;
+    for (const Vertex& vertex : vertices) {
+        radius_sq = std::max(radius_sq, double(glm::dot(vertex.position, vertex.position)));
+    }
+    const double attribute_scale = attribute_weight * attribute_weight * radius_sq;
+
+    // Quadrics are shared by the vertices of a group
+    std::vector<Quadric> quadrics(vertex_count);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const glm::dvec3 p0 = vertices[result[i + 0]].position;
+        const glm::dvec3 p1 = vertices[result[i + 1]].position;
+        const glm::dvec3 p2 = vertices[result[i + 2]].position;
+        const glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        const double length = glm::length(n);
+        if (length <= 0.0) {
+            continue;
+        }
+        const glm::dvec3 normal = n / length;
+        const double d = -glm::dot(normal, p0);
+        for (u32 c = 0; c != 3; ++c) {
+            quadrics[remap[result[i + c]]].add_plane(normal, d, length * 0.5);
+        }
+    }
+
+    const auto collapse_cost = [&](u32 from, u32 to) {
+        const Vertex& a = vertices[from];
+        const Vertex& b = vertices[to];
+        const glm::vec3 dn = a.normal - b.normal;
+        const glm::vec2 duv = a.uv - b.uv;
+        const glm::vec3 dc = a.color - b.color;
+        const double attributes = glm::dot(dn, dn) + glm::dot(duv, duv) + glm::dot(dc, dc);
+        return quadrics[remap[from]].error(glm::dvec3(b.position)) + attribute_scale * attributes;
+    };
+
+    const double max_error_sq = double(max_error) * double(max_error);
+
+    // Vertex to triangle adjacency, rebuilt every pass
+    std::vector<u32> adjacency_offsets(vertex_count + 1);
+    std::vector<u32> adjacency;
+
+    std::vector<u32> best_target(vertex_count);
+    std::vector<double> best_cost(vertex_count);
+    std::vector<u32> candidates;
+    std::vector<u32> collapse(vertex_count);
+    std::vector<u8> touched(vertex_count);
+
+    while (result.size() > target_index_count) {
+        std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0u);
+        for (const u32 index : result) {
+            ++adjacency_offsets[index + 1];
+        }
+        std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(),
+                         adjacency_offsets.begin());
+        adjacency.resize(result.size());
+        {
+            std::vector<u32> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+            for (size_t i = 0; i != result.size(); ++i) {
+                adjacency[cursor[result[i]]++] = u32(i / 3);
+            }
+        }
+
+        // Cheapest collapse of every vertex that can move
+        std::fill(best_cost.begin(), best_cost.end(), DBL_MAX);
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (u32 e = 0; e != 3; ++e) {
+                const u32 edge[2] = {result[i + e], result[i + (e + 1) % 3]};
+                for (u32 side = 0; side != 2; ++side) {
+                    const u32 from = edge[side];
+                    const u32 to = edge[1 - side];
+                    if (locked[from]) {
+                        continue;
+                    }
+                    const double cost = collapse_cost(from, to);
+                    if (cost < best_cost[from]) {
+                        best_cost[from] = cost;
+                        best_target[from] = to;
+                    }
+                }
+            }
+        }
+
+        candidates.clear();
+        for (u32 v = 0; v != vertex_count; ++v) {
+            if (best_cost[v] <= max_error_sq) {
+                candidates.push_back(v);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [&](u32 lhs, u32 rhs) { return best_cost[lhs] < best_cost[rhs]; });
+
+        // A collapse removes about two triangles, do not overshoot the target
+        const size_t triangle_count = result.size() / 3;
+        const size_t target_triangles = target_index_count / 3;
+        const size_t max_collapses = (triangle_count - target_triangles) / 2 + 1;
+
+        std::iota(collapse.begin(), collapse.end(), 0u);
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t collapses = 0;
+        for (const u32 from : candidates) {
+            if (collapses == max_collapses) {
+                break;
+            }
+            const u32 to = best_target[from];
+            if (touched[from] || touched[to]) {
+                continue;
+            }
+
+            // Reject collapses that flip any remaining triangle around the vertex
+            const glm::dvec3 target = vertices[to].position;
+            bool flipped = false;
+            for (u32 a = adjacency_offsets[from]; a != adjacency_offsets[from + 1]; ++a) {
+                const u32 tri = adjacency[a] * 3;
+                u32 corners[3] = {collapse[result[tri]], collapse[result[tri + 1]],
+                                  collapse[result[tri + 2]]};
+                if (corners[0] == to || corners[1] == to || corners[2] == to) {
+                    continue;
+                }
+
+                glm::dvec3 p[3];
+                for (u32 c = 0; c != 3; ++c) {
+                    p[c] = vertices[corners[c]].position;
+                }
+                const glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (u32 c = 0; c != 3; ++c) {
+                    if (corners[c] == from) {
+                        p[c] = target;
+                    }
+                }
+                const glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                if (glm::dot(before, after) <=
+                    flip_threshold * glm::length(before) * glm::length(after)) {
+                    flipped = true;
+                    break;
+                }
+            }
+            if (flipped) {
+                continue;
+            }
+
+            collapse[from] = to;
+            touched[from] = 1;
+            touched[to] = 1;
+            quadrics[remap[to]].add(quadrics[remap[from]]);
+            result_error = std::max(result_error, best_cost[from]);
+            ++collapses;
+        }
+
+        if (!collapses) {
+            break;
+        }
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const u32 a = collapse[result[i]];
+            const u32 b = collapse[result[i + 1]];
+            const u32 c = collapse[result[i + 2]];
+            if (a == b || b == c || c == a) {
+                continue;
+            }
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+
+    if (error) {
+        *error = float(std::sqrt(result_error));
+    }
+    return result;
+}
+
+// Levels stop when they would have less than this many triangles
+static constexpr size_t min_lod_triangles = 32;
+
+// Levels that remove less than this fraction of the previous one are not worth a draw range
+static constexpr float min_lod_reduction = 0.8f;
+
+void generate_lods(MeshData& mesh) {
+    mesh.lods.clear();
+
+    float radius = 0.0f;
+    for (const Vertex& vertex : mesh.vertices) {
+        radius = std::max(radius, glm::length(vertex.position));
+    }
+
+    // Levels are simplified from the previous one, their errors add up.
+    // Levels point to each other, they must not be reallocated.
+    mesh.lods.reserve(StaticMesh::max_lod_count - 1);
+    const std::vector<u32>* previous = &mesh.indices;
+    float error = 0.0f;
+    while (mesh.lods.size() + 1 < StaticMesh::max_lod_count) {
+        const size_t target = previous->size() / 6 * 3;
+        if (target < 3 * min_lod_triangles) {
+            break;
+        }
+
+        float level_error = 0.0f;
+        std::vector<u32> indices =
+            simplify_mesh(mesh.vertices, *previous, target, 0.5f * radius, &level_error);
+        if (float(indices.size()) > min_lod_reduction * float(previous->size())) {
+            break;
+        }
+
+        error += level_error;
+        mesh.lods.push_back({std::move(indices), error});
+        previous = &mesh.lods.back().indices;
+    }
+}
+
+}
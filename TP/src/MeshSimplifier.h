@@ -0,0 +1,25 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <StaticMesh.h>
+
+#include <vector>
+
+namespace OM3D {
+
+// Quadric error metric edge collapse (Garland & Heckbert).
+// Vertices are collapsed onto one of their neighbours instead of a new position, so the result
+// indexes the original vertices. Vertices on borders and attribute seams never move, and attribute
+// differences are added to the cost of a collapse.
+// Stops once the index count is at most target_index_count or the next collapse would move the
+// surface by more than max_error. Writes the reached error, in mesh units, to error.
+std::vector<u32> simplify_mesh(const std::vector<Vertex>& vertices,
+                               const std::vector<u32>& indices, size_t target_index_count,
+                               float max_error, float* error = nullptr);
+
+// Fill mesh.lods with successively coarser index lists, each about half of the previous one
+void generate_lods(MeshData& mesh);
+
+}
+
+#endif // MESHSIMPLIFIER_H
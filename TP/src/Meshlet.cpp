@@ -0,0 +1,225 @@
+#include "Meshlet.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+namespace OM3D {
+
+static constexpr u32 invalid_index = u32(-1);
+
+// Normals spread over more than about 84 degrees from the axis can not be culled as a whole
+static constexpr float min_cone_spread = 0.1f;
+
+static void compute_bounds(const std::vector<Vertex>& vertices, const std::vector<u32>& indices,
+                           Meshlet& meshlet) {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    for (u32 i = 0; i != meshlet.index_count; ++i) {
+        const glm::vec3& p = vertices[indices[meshlet.first_index + i]].position;
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    meshlet.center = (min + max) * 0.5f;
+
+    float radius_sq = 0.0f;
+    glm::vec3 axis = glm::vec3(0.0f);
+    for (u32 i = 0; i < meshlet.index_count; i += 3) {
+        const glm::vec3& p0 = vertices[indices[meshlet.first_index + i + 0]].position;
+        const glm::vec3& p1 = vertices[indices[meshlet.first_index + i + 1]].position;
+        const glm::vec3& p2 = vertices[indices[meshlet.first_index + i + 2]].position;
+        for (const glm::vec3& p : {p0, p1, p2}) {
+            radius_sq = std::max(radius_sq, glm::dot(p - meshlet.center, p - meshlet.center));
+        }
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(n);
+        if (length > 0.0f) {
+            axis += n / length;
+        }
+    }
+    meshlet.radius = std::sqrt(radius_sq);
+
+    const float axis_length = glm::length(axis);
+    if (axis_length <= 0.0f) {
+        return;
+    }
+    axis /= axis_length;
+
+    // Smallest cosine between the axis and a normal, and the apex behind every triangle plane
+    float min_dot = 1.0f;
+    float max_t = 0.0f;
+    for (u32 i = 0; i < meshlet.index_count; i += 3) {
+        const glm::vec3& p0 = vertices[indices[meshlet.first_index + i + 0]].position;
+        const glm::vec3& p1 = vertices[indices[meshlet.first_index + i + 1]].position;
+        const glm::vec3& p2 = vertices[indices[meshlet.first_index + i + 2]].position;
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(n);
+        if (length <= 0.0f) {
+            continue;
+        }
+        const glm::vec3 normal = n / length;
+        const float d = glm::dot(normal, axis);
+        min_dot = std::min(min_dot, d);
+        if (d > min_cone_spread) {
+            max_t = std::max(max_t, glm::dot(meshlet.center - p0, normal) / d);
+        }
+    }
+
+    if (min_dot <= min_cone_spread) {
+        return;
+    }
+    meshlet.cone_axis = axis;
+    meshlet.cone_apex = meshlet.center - axis * max_t;
+    meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+std::vector<Meshlet> build_meshlets(const std::vector<Vertex>& vertices,
+                                    std::vector<u32>& indices) {
+    const u32 triangle_count = u32(indices.size() / 3);
+
+    // Vertex to triangle adjacency
+    std::vector<u32> offsets(vertices.size() + 1, 0);
+    for (const u32 index : indices) {
+        ++offsets[index + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<u32> adjacency(indices.size());
+    {
+        std::vector<u32> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i != indices.size(); ++i) {
+            adjacency[cursor[indices[i]]++] = u32(i / 3);
+        }
+    }
+
+    std::vector<Meshlet> meshlets;
+    std::vector<u32> ordered;
+    ordered.reserve(indices.size());
+
+    // Marks hold the id of the last meshlet that used a vertex or looked at a triangle
+    std::vector<u32> vertex_mark(vertices.size(), invalid_index);
+    std::vector<u32> triangle_mark(triangle_count, invalid_index);
+    std::vector<u8> emitted(triangle_count, 0);
+    std::vector<u32> frontier;
+
+    u32 seed = 0;
+    for (;;) {
+        while (seed != triangle_count && emitted[seed]) {
+            ++seed;
+        }
+        if (seed == triangle_count) {
+            break;
+        }
+
+        const u32 id = u32(meshlets.size());
+        Meshlet& meshlet = meshlets.emplace_back();
+        meshlet.first_index = u32(ordered.size());
+        u32 vertex_count = 0;
+        u32 meshlet_triangles = 0;
+        frontier.clear();
+
+        // Grow the meshlet with the neighbouring triangle that adds the fewest vertices
+        for (u32 triangle = seed; triangle != invalid_index;) {
+            emitted[triangle] = 1;
+            ++meshlet_triangles;
+            for (u32 c = 0; c != 3; ++c) {
+                const u32 v = indices[triangle * 3 + c];
+                ordered.push_back(v);
+                if (vertex_mark[v] == id) {
+                    continue;
+                }
+                vertex_mark[v] = id;
+                ++vertex_count;
+                for (u32 a = offsets[v]; a != offsets[v + 1]; ++a) {
+                    const u32 neighbour = adjacency[a];
+                    if (!emitted[neighbour] && triangle_mark[neighbour] != id) {
+                        triangle_mark[neighbour] = id;
+                        frontier.push_back(neighbour);
+                    }
+                }
+            }
+
+            if (meshlet_triangles == Meshlet::max_triangles) {
+                break;
+            }
+
+            u32 best = invalid_index;
+            u32 best_new = 4;
+            size_t kept = 0;
+            for (const u32 candidate : frontier) {
+                if (emitted[candidate]) {
+                    continue;
+                }
+                frontier[kept++] = candidate;
+                u32 new_vertices = 0;
+                for (u32 c = 0; c != 3; ++c) {
+                    new_vertices += vertex_mark[indices[candidate * 3 + c]] != id;
+                }
+                if (new_vertices < best_new) {
+                    best_new = new_vertices;
+                    best = candidate;
+                }
+            }
+            frontier.resize(kept);
+
+            if (best == invalid_index || vertex_count + best_new > Meshlet::max_vertices) {
+                break;
+            }
+            triangle = best;
+        }
+
+        meshlet.index_count = u32(ordered.size()) - meshlet.first_index;
+    }
+
+    indices = std::move(ordered);
+    for (Meshlet& meshlet : meshlets) {
+        compute_bounds(vertices, indices, meshlet);
+    }
+    return meshlets;
+}
+
+void cull_meshlets(const std::vector<Meshlet>& meshlets, const FrustumPlanes& frustum,
+                   const glm::mat4& transform, const glm::vec3& camera_position,
+                   std::vector<IndexRange>& ranges) {
+    const float scale = max_scale(transform);
+
+    // Cones are tested in mesh space, which keeps angles only for uniform scales
+    const float sx = glm::length(glm::vec3(transform[0]));
+    const float sy = glm::length(glm::vec3(transform[1]));
+    const float sz = glm::length(glm::vec3(transform[2]));
+    const bool uniform = std::max(sx, std::max(sy, sz)) <= 1.01f * std::min(sx, std::min(sy, sz));
+    const glm::vec3 local_camera =
+        glm::vec3(glm::inverse(transform) * glm::vec4(camera_position, 1.0f));
+
+    const size_t first_range = ranges.size();
+    for (const Meshlet& meshlet : meshlets) {
+        if (uniform && meshlet.cone_cutoff < 1.0f) {
+            const glm::vec3 direction = glm::normalize(meshlet.cone_apex - local_camera);
+            if (glm::dot(direction, meshlet.cone_axis) >= meshlet.cone_cutoff) {
+                continue;
+            }
+        }
+
+        const glm::vec3 center = glm::vec3(transform * glm::vec4(meshlet.center, 1.0f));
+        const float radius = meshlet.radius * scale;
+        bool inside = true;
+        for (u32 p = 0; p != FrustumPlanes::plane_count; ++p) {
+            const float dist = center.x * frustum.nx[p] + center.y * frustum.ny[p] +
+                               center.z * frustum.nz[p] + frustum.d[p] + radius;
+            inside &= dist >= 0.0f;
+        }
+        if (!inside) {
+            continue;
+        }
+
+        if (ranges.size() != first_range &&
+            ranges.back().first_index + ranges.back().index_count == meshlet.first_index) {
+            ranges.back().index_count += meshlet.index_count;
+        } else {
+            ranges.push_back({meshlet.first_index, meshlet.index_count});
+        }
+    }
+}
+
+}
@@ -0,0 +1,49 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <Culling.h>
+#include <Vertex.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// Cluster of neighbouring triangles, stored as a contiguous range of the mesh index buffer
+struct Meshlet {
+    static constexpr u32 max_vertices = 64;
+    static constexpr u32 max_triangles = 124;
+
+    u32 first_index = 0;
+    u32 index_count = 0;
+
+    // Bounding sphere in mesh space
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // Every triangle faces away from the points p with
+    // dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff. A cutoff of 1 disables the test.
+    glm::vec3 cone_apex = glm::vec3(0.0f);
+    glm::vec3 cone_axis = glm::vec3(0.0f);
+    float cone_cutoff = 1.0f;
+};
+
+struct IndexRange {
+    u32 first_index = 0;
+    u32 index_count = 0;
+};
+
+// Split the triangles into meshlets, reordering indices so that every meshlet is contiguous
+std::vector<Meshlet> build_meshlets(const std::vector<Vertex>& vertices, std::vector<u32>& indices);
+
+// Append the index ranges of the meshlets that might be visible from camera_position, for a mesh
+// drawn with transform. Consecutive meshlets are merged into a single range.
+void cull_meshlets(const std::vector<Meshlet>& meshlets, const FrustumPlanes& frustum,
+                   const glm::mat4& transform, const glm::vec3& camera_position,
+                   std::vector<IndexRange>& ranges);
+
+}
+
+#endif // MESHLET_H
@@ -0,0 +1,89 @@
+#include "ObjectStore.h"
+
+namespace OM3D {
+
+ObjectHandle ObjectStore::add(u32 transform, std::shared_ptr<StaticMesh> mesh,
+                              std::shared_ptr<Material> material, u8 flags) {
+    u32 slot = _free_slot;
+    if (slot == ObjectHandle::invalid_index) {
+        slot = u32(_slots.size());
+        _slots.emplace_back();
+    } else {
+        _free_slot = _slots[slot].index;
+    }
+
+    const u32 index = u32(_dense_slots.size());
+    _slots[slot].index = index;
+    _dense_slots.push_back(slot);
+    _transforms.push_back(transform);
+    _meshes.emplace_back(std::move(mesh));
+    _materials.emplace_back(std::move(material));
+    _flags.push_back(flags);
+
+    return {slot, _slots[slot].generation};
+}
+
+u32 ObjectStore::remove(ObjectHandle object) {
+    ALWAYS_ASSERT(is_alive(object), "Removing an object that does not exist");
+
+    const u32 index = _slots[object.index].index;
+    const u32 last = u32(_dense_slots.size() - 1);
+    if (index != last) {
+        _dense_slots[index] = _dense_slots[last];
+        _transforms[index] = _transforms[last];
+        _meshes[index] = std::move(_meshes[last]);
+        _materials[index] = std::move(_materials[last]);
+        _flags[index] = _flags[last];
+        _slots[_dense_slots[index]].index = index;
+    }
+
+    _dense_slots.pop_back();
+    _transforms.pop_back();
+    _meshes.pop_back();
+    _materials.pop_back();
+    _flags.pop_back();
+
+    Slot& slot = _slots[object.index];
+    ++slot.generation;
+    slot.index = _free_slot;
+    _free_slot = object.index;
+
+    return index;
+}
+
+bool ObjectStore::is_alive(ObjectHandle object) const {
+    return object.index < _slots.size() && _slots[object.index].generation == object.generation;
+}
+
+u32 ObjectStore::index(ObjectHandle object) const {
+    DEBUG_ASSERT(is_alive(object));
+    return _slots[object.index].index;
+}
+
+ObjectHandle ObjectStore::handle(u32 index) const {
+    DEBUG_ASSERT(index < _dense_slots.size());
+    const u32 slot = _dense_slots[index];
+    return {slot, _slots[slot].generation};
+}
+
+size_t ObjectStore::size() const {
+    return _dense_slots.size();
+}
+
+const std::vector<u32>& ObjectStore::transforms() const {
+    return _transforms;
+}
+
+const std::vector<std::shared_ptr<StaticMesh>>& ObjectStore::meshes() const {
+    return _meshes;
+}
+
+const std::vector<std::shared_ptr<Material>>& ObjectStore::materials() const {
+    return _materials;
+}
+
+const std::vector<u8>& ObjectStore::flags() const {
+    return _flags;
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef OBJECTSTORE_H
+#define OBJECTSTORE_H
+
+#include <StaticMesh.h>
+#include <Material.h>
+
+#include <memory>
+#include <vector>
+
+namespace OM3D {
+
+// Stable reference to an object, invalidated when the object is removed
+struct ObjectHandle {
+    static constexpr u32 invalid_index = u32(-1);
+
+    u32 index = invalid_index;
+    u32 generation = 0;
+
+    bool is_valid() const {
+        return index != invalid_index;
+    }
+
+    bool operator==(const ObjectHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const ObjectHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+enum ObjectFlags : u8 {
+    Drawable = 1 << 0,
+    Moving = 1 << 1,
+};
+
+// Scene objects stored as dense columns, one entry per live object.
+// Handles go through a slot table holding the dense index and a generation, which is bumped on
+// removal so that stale handles are detected. Removing swaps the last object into the hole:
+// dense indices are not stable, handles are.
+class ObjectStore : NonCopyable {
+
+    public:
+        ObjectStore() = default;
+
+        ObjectHandle add(u32 transform, std::shared_ptr<StaticMesh> mesh,
+                         std::shared_ptr<Material> material, u8 flags);
+
+        // Returns the dense index of the removed object, which now holds the previous last object
+        // unless the removed object was the last one
+        u32 remove(ObjectHandle object);
+
+        bool is_alive(ObjectHandle object) const;
+        u32 index(ObjectHandle object) const;
+        ObjectHandle handle(u32 index) const;
+        size_t size() const;
+
+        // Columns, indexed by dense index
+        const std::vector<u32>& transforms() const;
+        const std::vector<std::shared_ptr<StaticMesh>>& meshes() const;
+        const std::vector<std::shared_ptr<Material>>& materials() const;
+        const std::vector<u8>& flags() const;
+
+    private:
+        struct Slot {
+            u32 index = 0;
+            u32 generation = 0;
+        };
+
+        // Free slots are chained through their index
+        std::vector<Slot> _slots;
+        u32 _free_slot = ObjectHandle::invalid_index;
+
+        std::vector<u32> _dense_slots;
+        std::vector<u32> _transforms;
+        std::vector<std::shared_ptr<StaticMesh>> _meshes;
+        std::vector<std::shared_ptr<Material>> _materials;
+        std::vector<u8> _flags;
+};
+
+}
+
+#endif // OBJECTSTORE_H
@@ -0,0 +1,73 @@
+#include "OcclusionProxies.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+namespace OM3D {
+
+OcclusionProxies::OcclusionProxies()
+    : _program(Program::from_files("occlusion_proxy.frag", "occlusion_proxy.vert")),
+      _cube(StaticMesh::CubeMesh()) {
+}
+
+void OcclusionProxies::clear() {
+    _boxes.clear();
+}
+
+u32 OcclusionProxies::add(const AABB& bounds) {
+    _boxes.push_back({bounds.center(), bounds.extent()});
+    return u32(_boxes.size() - 1);
+}
+
+size_t OcclusionProxies::size() const {
+    return _boxes.size();
+}
+
+void OcclusionProxies::begin() {
+    if (_box_buffer.element_count() < _boxes.size()) {
+        const size_t capacity = std::max(_boxes.size(), 2 * _box_buffer.element_count());
+        std::vector<Box> storage(capacity);
+        _box_buffer = TypedBuffer<Box>(storage);
+    }
+    _box_buffer.write(_boxes.data(), _boxes.size());
+
+    _program->bind();
+    glDisable(GL_BLEND);
+    // The camera can be inside of a box
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    // We are using reverse-Z
+    glDepthFunc(GL_GEQUAL);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+
+    _cube.bind_positions();
+
+    // Box center and half extent, selected by the base instance of each draw
+    _box_buffer.bind(BufferUsage::Attribute);
+    glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Box), nullptr);
+    glVertexAttribPointer(2, 3, GL_FLOAT, false, sizeof(Box),
+                          reinterpret_cast<void*>(offsetof(Box, extent)));
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+}
+
+void OcclusionProxies::draw(u32 proxy) const {
+    glDrawElementsInstancedBaseVertexBaseInstance(
+        GL_TRIANGLES, int(_cube.lod(0).index_count), GL_UNSIGNED_INT,
+        reinterpret_cast<void*>(_cube.base_index() * sizeof(u32)), 1, int(_cube.base_vertex()),
+        proxy);
+}
+
+void OcclusionProxies::end() {
+    // Attributes 1 and 2 are per vertex for every other draw
+    glVertexAttribDivisor(1, 0);
+    glVertexAttribDivisor(2, 0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+}
+
+}
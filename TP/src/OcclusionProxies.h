@@ -0,0 +1,45 @@
+#ifndef OCCLUSIONPROXIES_H
+#define OCCLUSIONPROXIES_H
+
+#include <AABB.h>
+#include <Program.h>
+#include <StaticMesh.h>
+#include <TypedBuffer.h>
+
+#include <memory>
+#include <vector>
+
+namespace OM3D {
+
+// World space bounding boxes drawn as instances of a unit cube with a depth only program.
+// Used to test hidden objects with an occlusion query for a few triangles instead of their mesh.
+class OcclusionProxies : NonCopyable {
+
+    struct Box {
+        glm::vec3 center;
+        glm::vec3 extent;
+    };
+
+    public:
+        OcclusionProxies();
+
+        void clear();
+        u32 add(const AABB& bounds);
+        size_t size() const;
+
+        // Upload the boxes and set up depth tested draws without any write
+        void begin();
+        void draw(u32 proxy) const;
+        void end();
+
+    private:
+        std::shared_ptr<Program> _program;
+        StaticMesh _cube;
+
+        std::vector<Box> _boxes;
+        TypedBuffer<Box> _box_buffer;
+};
+
+}
+
+#endif // OCCLUSIONPROXIES_H
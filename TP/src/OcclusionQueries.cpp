@@ -0,0 +1,123 @@
+#include "OcclusionQueries.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+namespace OM3D {
+
+// Queries are generated in blocks to avoid a GL call per object
+static constexpr u32 pool_growth = 64;
+
+OcclusionQueries::~OcclusionQueries() {
+    if (!_all.empty()) {
+        glDeleteQueries(GLsizei(_all.size()), _all.data());
+    }
+}
+
+void OcclusionQueries::resize(size_t object_count) {
+    _rings.resize(object_count);
+}
+
+void OcclusionQueries::remove(u32 object) {
+    if (object >= _rings.size()) {
+        return;
+    }
+
+    const Ring& ring = _rings[object];
+    for (u32 i = 0; i != ring.count; ++i) {
+        _retired.push_back(ring.queries[(ring.first + i) % frame_latency]);
+    }
+
+    // Only objects with queries in flight are pending, this list stays short
+    const u32 last = u32(_rings.size() - 1);
+    if (ring.count) {
+        _pending.erase(std::find(_pending.begin(), _pending.end(), object));
+    }
+    if (object != last && _rings[last].count) {
+        *std::find(_pending.begin(), _pending.end(), last) = object;
+    }
+
+    _rings[object] = _rings[last];
+    _rings.pop_back();
+}
+
+u32 OcclusionQueries::acquire() {
+    if (_free.empty()) {
+        _free.resize(pool_growth);
+        glGenQueries(pool_growth, _free.data());
+        _all.insert(_all.end(), _free.begin(), _free.end());
+    }
+    const u32 query = _free.back();
+    _free.pop_back();
+    return query;
+}
+
+void OcclusionQueries::poll() {
+    size_t still_retired = 0;
+    for (const u32 query : _retired) {
+        u32 available = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            _free.push_back(query);
+        } else {
+            _retired[still_retired++] = query;
+        }
+    }
+    _retired.resize(still_retired);
+
+    size_t still_pending = 0;
+    for (const u32 object : _pending) {
+        Ring& ring = _rings[object];
+
+        // Queries complete in order, stop at the first one that is not available
+        while (ring.count) {
+            const u32 query = ring.queries[ring.first];
+            u32 available = 0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+
+            u32 samples = 0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+            ring.visible = samples != 0;
+
+            _free.push_back(query);
+            ring.first = (ring.first + 1) % frame_latency;
+            --ring.count;
+        }
+
+        if (ring.count) {
+            _pending[still_pending++] = object;
+        }
+    }
+    _pending.resize(still_pending);
+}
+
+bool OcclusionQueries::is_visible(u32 object) const {
+    return _rings[object].visible;
+}
+
+u32 OcclusionQueries::begin(u32 object) {
+    Ring& ring = _rings[object];
+    if (ring.count == frame_latency) {
+        return 0;
+    }
+    if (!ring.count) {
+        _pending.push_back(object);
+    }
+
+    const u32 query = acquire();
+    ring.queries[(ring.first + ring.count) % frame_latency] = query;
+    ++ring.count;
+
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    return query;
+}
+
+void OcclusionQueries::end() {
+    glEndQuery(GL_SAMPLES_PASSED);
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef OCCLUSIONQUERIES_H
+#define OCCLUSIONQUERIES_H
+
+#include <utils.h>
+
+#include <vector>
+
+namespace OM3D {
+
+// GL_SAMPLES_PASSED queries for scene objects, allocated from a shared pool.
+// Every object has a ring of up to frame_latency queries in flight. Results are only read once
+// the GPU reports them available, so the CPU never waits for a query.
+class OcclusionQueries : NonCopyable {
+
+    public:
+        static constexpr u32 frame_latency = 3;
+
+        OcclusionQueries() = default;
+        ~OcclusionQueries();
+
+        void resize(size_t object_count);
+
+        // Forget the object and move the last object in its place
+        void remove(u32 object);
+
+        // Read back every query result that is available
+        void poll();
+
+        // Result of the latest query read back, objects are visible until proven otherwise
+        bool is_visible(u32 object) const;
+
+        // Start a query for the object and return it, or 0 if all its queries are still in flight
+        u32 begin(u32 object);
+        void end();
+
+    private:
+        struct Ring {
+            u32 queries[frame_latency] = {};
+            u32 first = 0;
+            u32 count = 0;
+            bool visible = true;
+        };
+
+        u32 acquire();
+
+        std::vector<Ring> _rings;
+        std::vector<u32> _pending;
+        // Queries of removed objects, still in flight
+        std::vector<u32> _retired;
+        std::vector<u32> _free;
+        std::vector<u32> _all;
+};
+
+}
+
+#endif // OCCLUSIONQUERIES_H
@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 
 #include <algorithm>
+#include <mutex>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -181,7 +182,10 @@ bool Program::is_compute() const {
 }
 
 std::shared_ptr<Program> Program::from_file(const std::string& comp, Span<const std::string> defines) {
+    // Lookups can come from loader threads, programs are only created on the GL thread
+    static std::mutex lock;
     static std::unordered_map<std::vector<std::string>, std::weak_ptr<Program>, CollectionHasher<std::vector<std::string>>> loaded;
+    std::unique_lock guard(lock);
 
     std::vector<std::string> key(defines.begin(), defines.end());
     key.emplace_back(comp);
@@ -196,7 +200,9 @@ std::shared_ptr<Program> Program::from_file(const std::string& comp, Span<const
 }
 
 std::shared_ptr<Program> Program::from_files(const std::string& frag, const std::string& vert, Span<const std::string> defines) {
+    static std::mutex lock;
     static std::unordered_map<std::vector<std::string>, std::weak_ptr<Program>, CollectionHasher<std::vector<std::string>>> loaded;
+    std::unique_lock guard(lock);
 
     std::vector<std::string> key(defines.begin(), defines.end());
     key.emplace_back(frag);
@@ -248,6 +254,12 @@ void Program::set_uniform(u32 name_hash, glm::vec4 value) {
     }
 }
 
+void Program::set_uniform(u32 name_hash, glm::uvec4 value) {
+    if(const int loc = find_location(name_hash); loc >= 0) {
+        glProgramUniform4ui(_handle.get(), loc, value.x, value.y, value.z, value.w);
+    }
+}
+
 void Program::set_uniform(u32 name_hash, const glm::mat2& value) {
     if(const int loc = find_location(name_hash); loc >= 0) {
         glProgramUniformMatrix2fv(_handle.get(), loc, 1, false, reinterpret_cast<const float*>(&value));
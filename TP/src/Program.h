@@ -50,6 +50,7 @@ class Program : NonCopyable {
         void set_uniform(u32 name_hash, glm::vec2 value);
         void set_uniform(u32 name_hash, glm::vec3 value);
         void set_uniform(u32 name_hash, glm::vec4 value);
+        void set_uniform(u32 name_hash, glm::uvec4 value);
         void set_uniform(u32 name_hash, const glm::mat2& value);
         void set_uniform(u32 name_hash, const glm::mat3& value);
         void set_uniform(u32 name_hash, const glm::mat4& value);
@@ -0,0 +1,77 @@
+#include "RadixSort.h"
+
+namespace OM3D {
+
+static constexpr u32 digit_bits = 11;
+static constexpr u32 digit_count = 3;
+static constexpr u32 bucket_count = 1 << digit_bits;
+
+static u32 digit(u64 value, u32 pass) {
+    return u32(value >> (32 + pass * digit_bits)) & (bucket_count - 1);
+}
+
+void radix_sort(std::vector<u64>& values, std::vector<u64>& scratch) {
+    const size_t count = values.size();
+    if (count < 2) {
+        return;
+    }
+
+    // All histograms are built in a single pass over the keys
+    std::vector<u32> histograms(digit_count * bucket_count, 0);
+    for (const u64 value : values) {
+        for (u32 pass = 0; pass != digit_count; ++pass) {
+            ++histograms[pass * bucket_count + digit(value, pass)];
+        }
+    }
+
+    scratch.resize(count);
+    u64* src = values.data();
+    u64* dst = scratch.data();
+    for (u32 pass = 0; pass != digit_count; ++pass) {
+        u32* histogram = histograms.data() + pass * bucket_count;
+
+        // Every key has the same digit, this pass would not move anything
+        if (histogram[digit(src[0], pass)] == count) {
+            continue;
+        }
+
+        u32 offset = 0;
+        for (u32 i = 0; i != bucket_count; ++i) {
+            const u32 c = histogram[i];
+            histogram[i] = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i != count; ++i) {
+            dst[histogram[digit(src[i], pass)]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != values.data()) {
+        values.swap(scratch);
+    }
+}
+
+bool insertion_sort(std::vector<u64>& values, size_t max_moves) {
+    const size_t count = values.size();
+    size_t moves = 0;
+    for (size_t i = 1; i < count; ++i) {
+        const u64 value = values[i];
+        const u32 key = u32(value >> 32);
+        size_t j = i;
+        while (j && u32(values[j - 1] >> 32) > key) {
+            values[j] = values[j - 1];
+            --j;
+        }
+        values[j] = value;
+
+        moves += i - j;
+        if (moves > max_moves) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
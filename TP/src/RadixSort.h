@@ -0,0 +1,36 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <utils.h>
+
+#include <cstring>
+#include <vector>
+
+namespace OM3D {
+
+// Sort key/payload pairs packed as (key << 32 | payload)
+inline constexpr u64 pack_sort_key(u32 key, u32 payload) {
+    return (u64(key) << 32) | payload;
+}
+
+inline constexpr u32 sort_payload(u64 value) {
+    return u32(value);
+}
+
+// Map a float to an unsigned integer with the same ordering
+inline u32 float_sort_key(float f) {
+    u32 bits = 0;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits ^ ((bits >> 31) ? 0xFFFFFFFF : 0x80000000);
+}
+
+// Stable LSD radix sort on the upper 32 bits, scratch is used as temporary storage
+void radix_sort(std::vector<u64>& values, std::vector<u64>& scratch);
+
+// Insertion sort on the upper 32 bits that gives up after max_moves element moves.
+// Returns true if values are sorted. Cheap when values are almost sorted already.
+bool insertion_sort(std::vector<u64>& values, size_t max_moves);
+
+}
+
+#endif // RADIXSORT_H
@@ -1,46 +1,381 @@
 #include "Scene.h"
 
 #include <TypedBuffer.h>
+#include <RadixSort.h>
 #include "graphics.h"
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/norm.hpp>
 #include <iostream>
-#include <map>
 #include <shader_structs.h>
 #include <algorithm>
+#include <cfloat>
+#include <limits>
 
 namespace OM3D {
 
 Scene::Scene() {
 }
 
-void Scene::add_object(SceneObject obj) {
-    _objects.emplace_back(std::move(obj));
+u32 Scene::add_node(const glm::mat4& local, u32 parent) {
+    // Ids of removed transforms are reused
+    const u32 node = _transforms.add(local, parent);
+    _transform_objects.resize(_transforms.size(), invalid_object);
+    _transform_objects[node] = invalid_object;
+    return node;
+}
+
+ObjectHandle Scene::add_object(SceneObject obj, u32 parent) {
+    const u32 index = u32(_objects.size());
+    const u32 transform = add_node(obj.transform(), parent);
+    _transform_objects[transform] = index;
+
+    u8 flags = 0;
+    if (obj._mesh && obj._material) {
+        // Objects that can not be drawn keep empty bounds and are never visible
+        _transforms.set_local_bounds(transform, obj._mesh->aabb, obj._mesh->boundingSphereRadius);
+        _batches.add(index, obj._mesh, obj._material, obj.transform());
+        flags |= ObjectFlags::Drawable;
+    }
+    if (obj.mark) {
+        _moving.push_back(transform);
+        flags |= ObjectFlags::Moving;
+    }
+    const ObjectHandle handle =
+        _objects.add(transform, std::move(obj._mesh), std::move(obj._material), flags);
+    // remove() moves the last ring, which must be the one of the last object of the store
+    _queries.resize(_objects.size());
+
+    // The new transform is dirty, so the next update computes the bounds of the new slot
+    _bounding_spheres.resize(_objects.size());
+    _object_bounds.emplace_back();
+    if (_uses_bvh && (flags & ObjectFlags::Drawable)) {
+        _bvh.insert(_object_bounds[index], index);
+    }
+    return handle;
+}
+
+void Scene::remove_object(ObjectHandle object) {
+    const u32 index = _objects.index(object);
+    const u32 last = u32(_objects.size() - 1);
+    const u32 transform = _objects.transforms()[index];
+
+    if (_objects.flags()[index] & ObjectFlags::Moving) {
+        _moving.erase(std::find(_moving.begin(), _moving.end(), transform));
+    }
+    _transforms.remove(transform);
+    _transform_objects[transform] = invalid_object;
+
+    // Every per object array follows the store, which moves the last object in the hole
+    _batches.remove(index);
+    _queries.remove(index);
+    if (_uses_bvh) {
+        _bvh.remove(index);
+    }
+    if (index != last) {
+        _batches.move(last, index);
+        _transform_objects[_objects.transforms()[last]] = index;
+        _bounding_spheres.set(index, _bounding_spheres.center(last),
+                              _bounding_spheres.radius(last));
+        _object_bounds[index] = _object_bounds[last];
+        if (_uses_bvh) {
+            _bvh.move(last, index);
+        }
+    }
+    _objects.remove(object);
+    _bounding_spheres.resize(last);
+    _object_bounds.pop_back();
+
+    _draw_order.clear();
+    _draw_rank.clear();
+    _visible_ready = false;
+}
+
+bool Scene::is_alive(ObjectHandle object) const {
+    return _objects.is_alive(object);
+}
+
+size_t Scene::object_count() const {
+    return _objects.size();
+}
+
+ObjectHandle Scene::object(size_t index) const {
+    return _objects.handle(u32(index));
+}
+
+const glm::mat4& Scene::local_transform(ObjectHandle object) const {
+    return _transforms.local(_objects.transforms()[_objects.index(object)]);
+}
+
+void Scene::set_local_transform(ObjectHandle object, const glm::mat4& local) {
+    _transforms.set_local(_objects.transforms()[_objects.index(object)], local);
+}
+
+AnimationPlayer& Scene::animations() {
+    return _animations;
+}
+
+void Scene::animate(double time) {
+    if (!_animations.is_empty()) {
+        _animations.update(time, _transforms);
+    }
+}
+
+const glm::mat4& Scene::object_transform(u32 index) const {
+    return _transforms.world(_objects.transforms()[index]);
+}
+
+void Scene::update_object_bounds(u32 index) {
+    const u32 transform = _objects.transforms()[index];
+    _bounding_spheres.set(index, _transforms.sphere_center(transform),
+                          _transforms.sphere_radius(transform));
+    _object_bounds[index] = _transforms.world_bounds(transform);
 }
 
 void Scene::add_object(PointLight obj) {
     _point_lights.emplace_back(std::move(obj));
 }
 
+// Below this many objects a linear SIMD pass is faster than walking the BVH
+static constexpr size_t bvh_min_objects = 256;
+// Scenes that shrink keep their BVH a little longer, so that adding and removing objects around
+// the threshold does not rebuild it every time
+static constexpr size_t bvh_drop_objects = bvh_min_objects / 2;
+
+static bool wants_bvh(size_t object_count, bool uses_bvh) {
+    return object_count >= (uses_bvh ? bvh_drop_objects : bvh_min_objects);
+}
+
 void Scene::sortObjects(const Camera& camera) {
-    std::sort(_objects.begin(), _objects.end(),
-              [&](const SceneObject& lhs, const SceneObject& rhs) {
-                  return lhs.distToCam(camera.position(), glm::normalize(camera.forward())) <
-                         rhs.distToCam(camera.position(), glm::normalize(camera.forward()));
-              });
+    update_bounds();
+    compute_depth_keys(camera.position(), camera.forward(), _bounding_spheres, _depth_keys);
+
+    // Objects keep their index (the BVH refers to them), only their rank is sorted.
+    // The camera moves little between frames, so last frame's order is usually almost sorted.
+    const size_t count = _objects.size();
+    bool sorted = false;
+    _sort_values.resize(count);
+    if (_draw_order.size() == count) {
+        for (size_t i = 0; i != count; ++i) {
+            _sort_values[i] = pack_sort_key(_depth_keys[_draw_order[i]], _draw_order[i]);
+        }
+        sorted = insertion_sort(_sort_values, 4 * count);
+    } else {
+        for (size_t i = 0; i != count; ++i) {
+            _sort_values[i] = pack_sort_key(_depth_keys[i], u32(i));
+        }
+    }
+    if (!sorted) {
+        radix_sort(_sort_values, _sort_scratch);
+    }
+
+    _draw_order.resize(count);
+    _draw_rank.resize(count);
+    for (size_t i = 0; i != count; ++i) {
+        _draw_order[i] = sort_payload(_sort_values[i]);
+        _draw_rank[_draw_order[i]] = u32(i);
+    }
 }
 
 void Scene::moveObjects(double time, std::function<glm::vec3(double)> func) {
-    for (auto& obj : _objects) {
-        /* if (obj._move) {
-            obj.set_transform(glm::translate(obj.transform(), obj._move(time)));
-        } */
-        if (obj.mark) {
-            obj.set_transform(glm::translate(obj.transform(), func(time)));
+    if (_moving.empty()) {
+        return;
+    }
+
+    // Every moving object gets the same offset
+    const glm::vec3 offset = func(time);
+    for (const u32 transform : _moving) {
+        _transforms.set_local(transform, glm::translate(_transforms.local(transform), offset));
+    }
+}
+
+void Scene::build_bvh() {
+    _uses_bvh = wants_bvh(_objects.size(), _uses_bvh);
+    if (!_uses_bvh) {
+        _bvh.clear();
+        return;
+    }
+
+    const std::vector<u8>& flags = _objects.flags();
+    std::vector<u32> drawable;
+    drawable.reserve(flags.size());
+    for (size_t i = 0; i != flags.size(); ++i) {
+        if (flags[i] & ObjectFlags::Drawable) {
+            drawable.push_back(u32(i));
         }
     }
+    _bvh.build(_object_bounds, drawable);
+}
+
+void Scene::update_bounds() {
+    // Only transforms that changed since last frame, or whose parent did, are recomputed
+    _transforms.update(_changed);
+    _changed_objects.clear();
+    for (const u32 transform : _changed) {
+        const u32 index = _transform_objects[transform];
+        if (index != invalid_object) {
+            _changed_objects.push_back(index);
+            _batches.set_transform(index, _transforms.world(transform));
+        }
+    }
+
+    for (const u32 index : _changed_objects) {
+        update_object_bounds(index);
+    }
+
+    if (wants_bvh(_objects.size(), _uses_bvh) != _uses_bvh) {
+        build_bvh();
+    } else if (_uses_bvh) {
+        _bvh.refit(_object_bounds, _changed_objects);
+        if (_bvh.needs_rebuild()) {
+            build_bvh();
+        }
+    }
+}
+
+std::vector<u32>& Scene::cull(const Camera& camera) {
+    update_bounds();
+    _visible_ready = false;
+
+    const FrustumPlanes frustum = FrustumPlanes::from_camera(camera);
+    if (!_uses_bvh) {
+        frustum_cull(frustum, _bounding_spheres, _visible);
+    } else {
+        _visible.clear();
+        _bvh.cull(frustum, _visible);
+    }
+    return _visible;
+}
+
+const std::vector<u32>& Scene::visible_objects(const Camera& camera) {
+    if (_visible_ready && !_transforms.has_changes() &&
+        camera.view_proj_matrix() == _visible_view_proj) {
+        return _visible;
+    }
+
+    std::vector<u32>& visible = cull(camera);
+    select_lods(camera, visible);
+    if (_software_occlusion) {
+        occlusion_cull(camera, visible);
+    }
+    _visible_ready = true;
+    _visible_view_proj = camera.view_proj_matrix();
+    return visible;
+}
+
+void Scene::set_software_occlusion(bool enabled) {
+    if (enabled != _software_occlusion) {
+        _visible_ready = false;
+    }
+    _software_occlusion = enabled;
+}
+
+TextureStreamer& Scene::texture_streamer() {
+    if (!_texture_streamer) {
+        _texture_streamer = std::make_unique<TextureStreamer>();
+    }
+    return *_texture_streamer;
+}
+
+bool Scene::streams_textures() const {
+    return bool(_texture_streamer);
+}
+
+void Scene::update_textures() {
+    if (_texture_streamer) {
+        _texture_streamer->update();
+    }
+    // The streamer only keeps the requests of one frame, the next one culls again to make them
+    _visible_ready = false;
+}
+
+// Occluders are the opaque visible objects that cover the largest part of the screen
+static constexpr size_t max_occluders = 32;
+static constexpr size_t max_occluder_triangles = 4096;
+static constexpr float min_occluder_size = 0.05f;
+
+void Scene::occlusion_cull(const Camera& camera, std::vector<u32>& visible) {
+    const glm::vec3 position = camera.position();
+
+    const std::vector<std::shared_ptr<StaticMesh>>& meshes = _objects.meshes();
+    const std::vector<std::shared_ptr<Material>>& materials = _objects.materials();
+
+    _occluders.clear();
+    for (const u32 index : visible) {
+        // Blended materials are not back face culled and do not hide what is behind them
+        if (materials[index]->blend_mode() != BlendMode::None ||
+            meshes[index]->_data.indices.size() > 3 * max_occluder_triangles) {
+            continue;
+        }
+
+        // Bounding sphere radius over distance, roughly proportional to the projected size
+        const float radius = _bounding_spheres.radius(index);
+        const float distance = glm::length(_bounding_spheres.center(index) - position);
+        if (radius < min_occluder_size * distance) {
+            continue;
+        }
+        _occluders.push_back(pack_sort_key(float_sort_key(-radius / distance), index));
+    }
+
+    if (_occluders.size() > max_occluders) {
+        std::nth_element(_occluders.begin(), _occluders.begin() + max_occluders, _occluders.end());
+        _occluders.resize(max_occluders);
+    }
+    std::sort(_occluders.begin(), _occluders.end());
+
+    _occlusion.begin_frame(camera.view_proj_matrix());
+    for (const u64 occluder : _occluders) {
+        const u32 index = sort_payload(occluder);
+        const StaticMesh& mesh = *meshes[index];
+        _occlusion.add_occluder(mesh._data.vertices, mesh._data.indices, object_transform(index));
+    }
+    _occlusion.rasterize(ThreadPool::global());
+
+    visible.erase(std::remove_if(visible.begin(), visible.end(),
+                                 [&](u32 index) {
+                                     return !_occlusion.is_visible(_object_bounds[index]);
+                                 }),
+                  visible.end());
+}
+
+// Objects whose bounding sphere covers less than this radius on screen are not drawn
+static constexpr float min_pixel_radius = 0.5f;
+
+void Scene::select_lods(const Camera& camera, std::vector<u32>& visible) {
+    _object_lods.resize(_objects.size());
+    const std::vector<std::shared_ptr<StaticMesh>>& meshes = _objects.meshes();
+    const std::vector<std::shared_ptr<Material>>& materials = _objects.materials();
+
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    // Projected radius in pixels of a unit sphere at unit distance
+    const float pixel_scale = camera.projection_matrix()[1][1] * 0.5f * float(viewport[3]);
+    const glm::vec3 position = camera.position();
+
+    size_t kept = 0;
+    for (const u32 index : visible) {
+        const float radius = _bounding_spheres.radius(index);
+        const float distance = glm::length(_bounding_spheres.center(index) - position);
+
+        u8 level = 0;
+        // From inside the bounding sphere, textures need their finest mips
+        float pixels_per_uv = std::numeric_limits<float>::infinity();
+        if (distance > radius) {
+            const float radius_pixels = radius * pixel_scale / distance;
+            if (radius_pixels < min_pixel_radius) {
+                continue;
+            }
+            level = u8(meshes[index]->select_lod(radius_pixels));
+            pixels_per_uv = radius_pixels / meshes[index]->uv_radius();
+        }
+        if (_texture_streamer) {
+            _texture_streamer->request(materials[index].get(), pixels_per_uv);
+        }
+        _object_lods[index] = level;
+        visible[kept++] = index;
+    }
+    visible.resize(kept);
 }
 
 static inline TypedBuffer<shader::FrameData> fill_and_bind_frame_data_buffer(
@@ -105,8 +440,6 @@ void Scene::renderShadingSpheres(const Camera& camera, std::shared_ptr<Program>
     light_buffer.bind(BufferUsage::Storage, 1);
 
     static auto sphereMeshp = meshFromGltf(std::string(data_path) + "sphere.glb").value;
-    sphereMeshp->_vertex_buffer.bind(BufferUsage::Attribute);
-    sphereMeshp->_index_buffer.bind(BufferUsage::Index);
 
     auto mat = Material();
     mat.set_blend_mode(BlendMode::Additive);
@@ -114,27 +447,8 @@ void Scene::renderShadingSpheres(const Camera& camera, std::shared_ptr<Program>
     mat.set_depth_mask_mode(DepthMaskMode::False);
     mat.set_program(programp);
     mat.bind(RenderMode::INSTANCED);
-
-    // Vertex position
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-    // Vertex normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(3 * sizeof(float)));
-    // Vertex uv
-    glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(6 * sizeof(float)));
-    // Tangent / bitangent sign
-    glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(8 * sizeof(float)));
-    // Vertex color
-    glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(12 * sizeof(float)));
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
+    sphereMeshp->set_vertex_uniforms(mat, RenderMode::INSTANCED);
+    sphereMeshp->bind_vertices();
 
     std::vector<LightInstance> instanceVertices;
     for (auto& pointLight : this->_point_lights) {
@@ -174,8 +488,10 @@ void Scene::renderShadingSpheres(const Camera& camera, std::shared_ptr<Program>
     glVertexAttribDivisor(10, 1);
     glVertexAttribDivisor(11, 1);
 
-    glDrawElementsInstanced(GL_TRIANGLES, int(sphereMeshp->_index_buffer.element_count()),
-                            GL_UNSIGNED_INT, 0, instanceVertices.size());
+    glDrawElementsInstancedBaseVertex(
+        GL_TRIANGLES, int(sphereMeshp->lod(0).index_count), GL_UNSIGNED_INT,
+        reinterpret_cast<void*>(sphereMeshp->base_index() * sizeof(u32)),
+        GLsizei(instanceVertices.size()), GLint(sphereMeshp->base_vertex()));
 }
 
 void Scene::renderShadingDirectional(const Camera& camera,
@@ -231,7 +547,7 @@ void Scene::renderTAA(const Camera& camera, std::shared_ptr<Program> programp) c
     glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
-void Scene::render(const Camera& camera) const {
+void Scene::render(const Camera& camera) {
     // Fill and bind frame data buffer
     auto buffer = fill_and_bind_frame_data_buffer(camera, _point_lights, _sun_direction);
 
@@ -247,88 +563,70 @@ void Scene::render(const Camera& camera) const {
     }
     light_buffer.bind(BufferUsage::Storage, 1);
 
-    // INSTANCED DRAW (stupid)
-    struct InstanceDrawData {
-        std::vector<Instance> instanceVertices;
-        std::shared_ptr<StaticMesh> mesh;
-        std::shared_ptr<Material> mat;
-    };
-
-    std::map<int, InstanceDrawData> instanceGroups;
-    // getting each unique material
-    for (const SceneObject& obj : _objects) {
-        int isCulled = false;
-        auto transform = obj.transform();
-        glm::vec3 center = glm::vec3(transform * glm::vec4(0.0, 0.0, 0.0, 1.0)) - camera.position();
-        float scaling =
-            std::sqrt(std::pow(transform[0][0], 2.0f) + std::pow(transform[0][1], 2.0f) +
-                      std::pow(transform[0][2], 2.0f));
-        auto frustum = camera.build_frustum();
-        auto normals = std::vector<glm::vec3>{frustum._bottom_normal, frustum._left_normal,
-                                              frustum._near_normal, frustum._right_normal,
-                                              frustum._top_normal};
-        for (auto normal : normals) {
-            if (glm::dot(normal, center + normal * obj._mesh->boundingSphereRadius * scaling) < 0)
-                isCulled = true;
+    _batches.draw(visible_objects(camera), _object_lods, camera);
+}
+
+void Scene::renderDepth(const Camera& camera) {
+    auto buffer = fill_and_bind_frame_data_buffer(camera, _point_lights, _sun_direction);
+
+    if (!_depth_program) {
+        _depth_program = Program::from_files("depth.frag", "depth.vert");
+    }
+
+    const std::vector<u32>& visible = visible_objects(camera);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glEnable(GL_DEPTH_TEST);
+    // We are using reverse-Z
+    glDepthFunc(GL_GEQUAL);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    _batches.draw(visible, _object_lods, camera, _depth_program.get());
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Draw a single object with its non instanced program
+void Scene::draw_object(u32 index, RenderMode mode, const FrustumPlanes& frustum,
+                        const glm::vec3& camera_position) {
+    const StaticMesh& mesh = *_objects.meshes()[index];
+    Material& material = *_objects.materials()[index];
+    const glm::mat4& transform = object_transform(index);
+    const u32 level = _object_lods[index];
+
+    material.bind(mode);
+    material.set_uniform(mode, HASH("model"), transform);
+    mesh.set_vertex_uniforms(material, mode);
+    mesh.bind_vertices();
+
+    const u32 base_index = mesh.base_index();
+    const i32 base_vertex = i32(mesh.base_vertex());
+
+    // Only the clusters facing the camera inside the frustum are drawn
+    if (level == 0 && !mesh.meshlets().empty()) {
+        _meshlet_ranges.clear();
+        cull_meshlets(mesh.meshlets(), frustum, transform, camera_position, _meshlet_ranges);
+        _meshlet_counts.resize(_meshlet_ranges.size());
+        _meshlet_offsets.resize(_meshlet_ranges.size());
+        _meshlet_base_vertices.assign(_meshlet_ranges.size(), base_vertex);
+        for (size_t i = 0; i != _meshlet_ranges.size(); ++i) {
+            _meshlet_counts[i] = i32(_meshlet_ranges[i].index_count);
+            _meshlet_offsets[i] = reinterpret_cast<void*>(
+                (base_index + _meshlet_ranges[i].first_index) * sizeof(u32));
         }
-        if (isCulled) continue;
-        instanceGroups[obj._material->uid].instanceVertices.push_back({obj.transform()});
-        instanceGroups[obj._material->uid].mat = obj._material;
-        instanceGroups[obj._material->uid].mesh = obj._mesh;
-    }
-
-    for (auto& [key, value] : instanceGroups) {
-        if (!value.mat || !value.mesh) continue;
-        value.mat->bind(RenderMode::INSTANCED);
-        TypedBuffer<Instance> instanceBuffer(value.instanceVertices);
-
-        value.mesh->_vertex_buffer.bind(BufferUsage::Attribute);
-        value.mesh->_index_buffer.bind(BufferUsage::Index);
-
-        // Vertex position
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-        // Vertex normal
-        glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex),
-                              reinterpret_cast<void*>(3 * sizeof(float)));
-        // Vertex uv
-        glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex),
-                              reinterpret_cast<void*>(6 * sizeof(float)));
-        // Tangent / bitangent sign
-        glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex),
-                              reinterpret_cast<void*>(8 * sizeof(float)));
-        // Vertex color
-        glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex),
-                              reinterpret_cast<void*>(12 * sizeof(float)));
-
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glEnableVertexAttribArray(3);
-        glEnableVertexAttribArray(4);
-
-        instanceBuffer.bind(BufferUsage::Attribute);
-
-        glVertexAttribPointer(5, 4, GL_FLOAT, false, sizeof(Instance), 0);
-        glVertexAttribPointer(6, 4, GL_FLOAT, false, sizeof(Instance),
-                              (void*)(4 * sizeof(GLfloat)));
-        glVertexAttribPointer(7, 4, GL_FLOAT, false, sizeof(Instance),
-                              (void*)(8 * sizeof(GLfloat)));
-        glVertexAttribPointer(8, 4, GL_FLOAT, false, sizeof(Instance),
-                              (void*)(12 * sizeof(GLfloat)));
-
-        glEnableVertexAttribArray(5);
-        glEnableVertexAttribArray(6);
-        glEnableVertexAttribArray(7);
-        glEnableVertexAttribArray(8);
-
-        glVertexAttribDivisor(5, 1);
-        glVertexAttribDivisor(6, 1);
-        glVertexAttribDivisor(7, 1);
-        glVertexAttribDivisor(8, 1);
-
-        glDrawElementsInstanced(GL_TRIANGLES, int(value.mesh->_index_buffer.element_count()),
-                                GL_UNSIGNED_INT, 0, value.instanceVertices.size());
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, _meshlet_counts.data(), GL_UNSIGNED_INT,
+                                      _meshlet_offsets.data(), GLsizei(_meshlet_counts.size()),
+                                      _meshlet_base_vertices.data());
+        return;
     }
+
+    const StaticMesh::LodRange& range = mesh.lod(level);
+    const void* offset = reinterpret_cast<void*>((base_index + range.first_index) * sizeof(u32));
+    glDrawElementsBaseVertex(GL_TRIANGLES, int(range.index_count), GL_UNSIGNED_INT, offset,
+                             base_vertex);
 }
 
 void Scene::renderOcclusion(const Camera& camera, bool debug) {
@@ -347,134 +645,72 @@ void Scene::renderOcclusion(const Camera& camera, bool debug) {
     }
     light_buffer.bind(BufferUsage::Storage, 1);
 
-    // Render every object
-    int a = 0;
-    for (SceneObject& obj : _objects) {
-        a++;
-        if (!obj._material || !obj._mesh) {
+    _queries.resize(_objects.size());
+    _queries.poll();
+
+    // Render every object that passes frustum culling, front to back
+    std::vector<u32>& visible = cull(camera);
+    select_lods(camera, visible);
+    if (_draw_rank.size() == _objects.size()) {
+        std::sort(visible.begin(), visible.end(),
+                  [&](u32 lhs, u32 rhs) { return _draw_rank[lhs] < _draw_rank[rhs]; });
+    }
+
+    if (!_proxies) {
+        _proxies = std::make_unique<OcclusionProxies>();
+    }
+    _proxies->clear();
+    _proxy_objects.clear();
+
+    // Query results lag a few frames behind. Objects that were visible are drawn as usual and
+    // tested by their own draw.
+    const FrustumPlanes frustum = FrustumPlanes::from_camera(camera);
+    const glm::vec3 camera_position = camera.position();
+    for (const u32 index : visible) {
+        const AABB& bounds = _object_bounds[index];
+
+        // The proxy of an object that contains the camera is clipped by the near plane
+        const bool contains_camera = glm::all(glm::greaterThanEqual(camera_position, bounds.min)) &&
+                                     glm::all(glm::lessThanEqual(camera_position, bounds.max));
+        if (!contains_camera && !_queries.is_visible(index)) {
+            _proxy_objects.push_back(index);
+            _proxies->add(bounds);
             continue;
         }
 
-        // frustum culling
-        int isCulled = false;
-        auto transform = obj.transform();
-        glm::vec3 center = glm::vec3(transform * glm::vec4(0.0, 0.0, 0.0, 1.0)) - camera.position();
-        float scaling =
-            std::sqrt(std::pow(transform[0][0], 2.0f) + std::pow(transform[0][1], 2.0f) +
-                      std::pow(transform[0][2], 2.0f));
-        auto frustum = camera.build_frustum();
-        auto normals = std::vector<glm::vec3>{frustum._bottom_normal, frustum._left_normal,
-                                              frustum._near_normal, frustum._right_normal,
-                                              frustum._top_normal};
-        for (auto normal : normals) {
-            if (glm::dot(normal, center + normal * obj._mesh->boundingSphereRadius * scaling) < 0)
-                isCulled = true;
+        const u32 query = _queries.begin(index);
+        draw_object(index, RenderMode::NON_INSTANCED, frustum, camera_position);
+        if (query) {
+            _queries.end();
         }
-        if (isCulled) continue;
+    }
 
-        // occlusion culling
+    if (_proxy_objects.empty()) {
+        return;
+    }
 
-        int samplesPassed = 0;
-        int resultAvailable = 0;
-        if (obj._queryActive) {
-            glGetQueryObjectiv(obj._queryId, GL_QUERY_RESULT, &samplesPassed);
+    // Hidden objects are tested against everything drawn so far with their bounding box
+    _proxy_queries.resize(_proxy_objects.size());
+    _proxies->begin();
+    for (u32 i = 0; i != _proxy_objects.size(); ++i) {
+        _proxy_queries[i] = _queries.begin(_proxy_objects[i]);
+        if (_proxy_queries[i]) {
+            _proxies->draw(i);
+            _queries.end();
         }
-        glBeginQuery(GL_SAMPLES_PASSED, obj._queryId);
-        obj._queryActive = true;
-        if (samplesPassed != 0) {
-            obj._material->bind(RenderMode::NON_INSTANCED);
-            obj._material->set_uniform(RenderMode::NON_INSTANCED, HASH("model"), obj.transform());
-            obj._mesh->_vertex_buffer.bind(BufferUsage::Attribute);
-            obj._mesh->_index_buffer.bind(BufferUsage::Index);
-
-            // Vertex position
-            glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-            // Vertex normal
-            glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(3 * sizeof(float)));
-            // Vertex uv
-            glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(6 * sizeof(float)));
-            // Tangent / bitangent sign
-            glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(8 * sizeof(float)));
-            // Vertex color
-            glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(12 * sizeof(float)));
-
-            glEnableVertexAttribArray(0);
-            glEnableVertexAttribArray(1);
-            glEnableVertexAttribArray(2);
-            glEnableVertexAttribArray(3);
-            glEnableVertexAttribArray(4);
-            glDrawElements(GL_TRIANGLES, int(obj._mesh->_index_buffer.element_count()),
-                           GL_UNSIGNED_INT, nullptr);
-        } else if (samplesPassed == 0) {
-            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            glDepthMask(GL_FALSE);
-
-            obj._material->bind(RenderMode::NON_INSTANCED);
-            obj._material->set_uniform(RenderMode::NON_INSTANCED, HASH("model"), obj.transform());
-            obj._mesh->_vertex_buffer.bind(BufferUsage::Attribute);
-            obj._mesh->_index_buffer.bind(BufferUsage::Index);
-
-            // Vertex position
-            glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-            // Vertex normal
-            glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(3 * sizeof(float)));
-            // Vertex uv
-            glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(6 * sizeof(float)));
-            // Tangent / bitangent sign
-            glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(8 * sizeof(float)));
-            // Vertex color
-            glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(12 * sizeof(float)));
-
-            glEnableVertexAttribArray(0);
-            glEnableVertexAttribArray(1);
-            glEnableVertexAttribArray(2);
-            glEnableVertexAttribArray(3);
-            glEnableVertexAttribArray(4);
-            glDrawElements(GL_TRIANGLES, int(obj._mesh->_index_buffer.element_count()),
-                           GL_UNSIGNED_INT, nullptr);
-
-            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-            glDepthMask(GL_TRUE);
+    }
+    _proxies->end();
+
+    // The GPU draws the objects that passed the test right away, without a CPU round-trip
+    for (u32 i = 0; i != _proxy_objects.size(); ++i) {
+        const u32 index = _proxy_objects[i];
+        if (_proxy_queries[i]) {
+            glBeginConditionalRender(_proxy_queries[i], GL_QUERY_WAIT);
+            draw_object(index, RenderMode::NON_INSTANCED, frustum, camera_position);
+            glEndConditionalRender();
         }
-
-        glEndQuery(GL_SAMPLES_PASSED);
-
-        if (debug && samplesPassed == 0) {
-            obj._material->bind(RenderMode::OCC_DEBUG);
-            obj._material->set_uniform(RenderMode::OCC_DEBUG, HASH("model"), obj.transform());
-            obj._mesh->_vertex_buffer.bind(BufferUsage::Attribute);
-            obj._mesh->_index_buffer.bind(BufferUsage::Index);
-
-            // Vertex position
-            glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-            // Vertex normal
-            glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(3 * sizeof(float)));
-            // Vertex uv
-            glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(6 * sizeof(float)));
-            // Tangent / bitangent sign
-            glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(8 * sizeof(float)));
-            // Vertex color
-            glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex),
-                                  reinterpret_cast<void*>(12 * sizeof(float)));
-
-            glEnableVertexAttribArray(0);
-            glEnableVertexAttribArray(1);
-            glEnableVertexAttribArray(2);
-            glEnableVertexAttribArray(3);
-            glEnableVertexAttribArray(4);
-            glDrawElements(GL_TRIANGLES, int(obj._mesh->_index_buffer.element_count()),
-                           GL_UNSIGNED_INT, nullptr);
+        if (debug) {
+            draw_object(index, RenderMode::OCC_DEBUG, frustum, camera_position);
         }
     }
 }
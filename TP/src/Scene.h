@@ -2,8 +2,18 @@
 #define SCENE_H
 
 #include <SceneObject.h>
+#include <ObjectStore.h>
 #include <PointLight.h>
 #include <Camera.h>
+#include <Culling.h>
+#include <BVH.h>
+#include <InstanceBatches.h>
+#include <SoftwareOcclusion.h>
+#include <OcclusionQueries.h>
+#include <OcclusionProxies.h>
+#include <TransformSystem.h>
+#include <Animation.h>
+#include <TextureStreamer.h>
 #include "Vertex.h"
 
 #include <glad/glad.h>
@@ -27,25 +37,108 @@ class Scene : NonMovable {
         void renderShadingSpheres(const Camera &camera, std::shared_ptr<Program> programp) const;
         void renderShadingDirectional(const Camera &camera, std::shared_ptr<Program> programp) const;
         void renderTAA(const Camera& camera, std::shared_ptr<Program> programp) const;
-        void render(const Camera& camera) const;
+        void render(const Camera& camera);
+        // Fill the depth buffer with the opaque objects, reading only their positions, so that
+        // render() shades every pixel once
+        void renderDepth(const Camera& camera);
         void renderOcclusion(const Camera& camera, bool debug);
 
-        void add_object(SceneObject obj);
+        // Nodes only carry a transform, objects can be attached to them
+        u32 add_node(const glm::mat4& local, u32 parent = TransformSystem::no_parent);
+        ObjectHandle add_object(SceneObject obj, u32 parent = TransformSystem::no_parent);
         void add_object(PointLight obj);
+        void remove_object(ObjectHandle object);
+
+        bool is_alive(ObjectHandle object) const;
+        size_t object_count() const;
+        // Objects in storage order, which changes when objects are removed
+        ObjectHandle object(size_t index) const;
+
+        const glm::mat4& local_transform(ObjectHandle object) const;
+        void set_local_transform(ObjectHandle object, const glm::mat4& local);
+
         void sortObjects(const Camera &camera);
         void moveObjects(double time, std::function<glm::vec3(double)> func);
-        
-        std::vector<SceneObject> _objects;
-        void deleteQueries() {
-            for (auto& obj : _objects) {
-                glDeleteQueries(1, &obj._queryId);
-            }
-        }
+
+        AnimationPlayer& animations();
+        void animate(double time);
+
+        // Test frustum culled objects against occluders rasterized on the CPU before drawing
+        void set_software_occlusion(bool enabled);
+
+        // Streams the mips of the texture arrays it is given from the screen size of the objects
+        // drawn, created on first use
+        TextureStreamer& texture_streamer();
+        bool streams_textures() const;
+        // Stream the texture mips needed by the objects drawn this frame, once per frame
+        void update_textures();
 
     private:
+        void update_bounds();
+        std::vector<u32>& cull(const Camera& camera);
+        // Frustum and occlusion culled objects with their levels of detail, computed once per
+        // frame and camera and shared by the depth prepass and the main pass
+        const std::vector<u32>& visible_objects(const Camera& camera);
+        void build_bvh();
+        void update_object_bounds(u32 index);
+        const glm::mat4& object_transform(u32 index) const;
+        void occlusion_cull(const Camera& camera, std::vector<u32>& visible);
+        // Pick the level of detail of the visible objects and drop those smaller than a pixel
+        void select_lods(const Camera& camera, std::vector<u32>& visible);
+        void draw_object(u32 index, RenderMode mode, const FrustumPlanes& frustum,
+                         const glm::vec3& camera_position);
+
+        ObjectStore _objects;
         std::vector<PointLight> _point_lights;
-        TypedBuffer<Instance> _instanceBuffer;
+        InstanceBatches _batches;
         glm::vec3 _sun_direction = glm::vec3(0.2f, 1.0f, 0.1f);
+
+        // Front to back order of the objects and rank of each object in it, filled by sortObjects
+        std::vector<u32> _draw_order;
+        std::vector<u32> _draw_rank;
+        std::vector<u32> _depth_keys;
+        std::vector<u64> _sort_values;
+        std::vector<u64> _sort_scratch;
+
+        static constexpr u32 invalid_object = u32(-1);
+
+        // Every object has its own transform, possibly child of a node.
+        // Transforms of the objects marked as moving are listed once.
+        TransformSystem _transforms;
+        std::vector<u32> _transform_objects;
+        std::vector<u32> _moving;
+        std::vector<u32> _changed;
+        std::vector<u32> _changed_objects;
+        AnimationPlayer _animations;
+
+        // Culling caches indexed like the object store, updated slot by slot when objects are
+        // added, removed or moved
+        BoundingSpheres _bounding_spheres;
+        std::vector<AABB> _object_bounds;
+        BVH _bvh;
+        bool _uses_bvh = false;
+        std::vector<u32> _visible;
+        std::vector<u8> _object_lods;
+        bool _visible_ready = false;
+        glm::mat4 _visible_view_proj = glm::mat4(0.0f);
+
+        bool _software_occlusion = false;
+        SoftwareOcclusion _occlusion;
+        std::vector<u64> _occluders;
+
+        std::shared_ptr<Program> _depth_program;
+
+        OcclusionQueries _queries;
+        std::unique_ptr<OcclusionProxies> _proxies;
+        std::vector<u32> _proxy_objects;
+        std::vector<u32> _proxy_queries;
+
+        std::vector<IndexRange> _meshlet_ranges;
+        std::vector<i32> _meshlet_counts;
+        std::vector<const void*> _meshlet_offsets;
+        std::vector<i32> _meshlet_base_vertices;
+
+        std::unique_ptr<TextureStreamer> _texture_streamer;
 };
 
 }
@@ -0,0 +1,173 @@
+#include "SceneLoader.h"
+
+#include <Scene.h>
+
+#include <chrono>
+#include <iostream>
+
+namespace OM3D {
+
+static constexpr size_t payload_queue_size = 256;
+
+size_t SceneLoader::Payload::byte_size() const {
+    switch (type) {
+        case Type::Mesh: {
+            size_t indices = mesh.data.indices.size();
+            for (const MeshLod& level : mesh.data.lods) {
+                indices += level.indices.size();
+            }
+            return mesh.data.vertices.size() * sizeof(Vertex) + indices * sizeof(u32);
+        }
+        case Type::Texture: {
+            size_t bytes = 0;
+            for (const BakedTexture& texture : texture_layers) {
+                bytes += texture.mip_chain.size();
+            }
+            return bytes;
+        }
+        default:
+            return 0;
+    }
+}
+
+SceneLoader::SceneLoader(size_t staging_size) :
+    _queue(payload_queue_size),
+    _staging(staging_size) {
+}
+
+SceneLoader::~SceneLoader() {
+    _cancel = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+bool SceneLoader::load(const std::string& file_name) {
+    if (_loading) {
+        return false;
+    }
+
+    // The previous worker is done once its last payload has been received
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+
+    _loading = true;
+    _file_name = file_name;
+    // Not a pool task: the worker waits on the queue, and uses the pool itself while baking
+    _thread = std::thread([this, file_name] { run(file_name); });
+    return true;
+}
+
+bool SceneLoader::is_loading() const {
+    return _loading;
+}
+
+const std::string& SceneLoader::file_name() const {
+    return _file_name;
+}
+
+bool SceneLoader::push(Payload&& payload) {
+    while (!_queue.try_push(std::move(payload))) {
+        if (_cancel) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void SceneLoader::run(const std::string& file_name) {
+    auto baked = bake_scene_file(file_name);
+    if (!baked.is_ok) {
+        Payload failed;
+        failed.type = Payload::Type::Failed;
+        push(std::move(failed));
+        return;
+    }
+
+    auto scene = std::make_unique<BakedScene>(std::move(baked.value));
+
+    for (size_t i = 0; i != scene->meshes.size(); ++i) {
+        Payload payload;
+        payload.type = Payload::Type::Mesh;
+        payload.index = u32(i);
+        payload.mesh.key = scene->meshes[i].key;
+        payload.mesh.data = std::move(scene->meshes[i].data);
+        if (!push(std::move(payload))) {
+            return;
+        }
+    }
+
+    const std::vector<BakedTextureArray> arrays = pack_texture_arrays(*scene);
+    for (size_t i = 0; i != arrays.size(); ++i) {
+        Payload payload;
+        payload.type = Payload::Type::Texture;
+        payload.index = u32(i);
+        for (const u32 texture : arrays[i].textures) {
+            payload.texture_layers.push_back(scene->textures[texture]);
+        }
+        if (!push(std::move(payload))) {
+            return;
+        }
+    }
+
+    Payload last;
+    last.type = Payload::Type::Scene;
+    last.scene = std::move(scene);
+    push(std::move(last));
+}
+
+std::unique_ptr<Scene> SceneLoader::update(size_t budget) {
+    DEFER(_staging.end_frame());
+
+    std::unique_ptr<Scene> scene;
+    size_t uploaded = 0;
+    while (Payload* payload = _queue.front()) {
+        const size_t size = payload->byte_size();
+        if (uploaded && uploaded + size > budget) {
+            break;
+        }
+        uploaded += size;
+
+        switch (payload->type) {
+            case Payload::Type::Mesh:
+                DEBUG_ASSERT(payload->index == _meshes.size());
+                _meshes.push_back(create_baked_mesh(payload->mesh, &_staging));
+                break;
+
+            case Payload::Type::Texture:
+                DEBUG_ASSERT(payload->index == _texture_arrays.size());
+                _texture_arrays.push_back(
+                    create_baked_texture_array(payload->texture_layers, &_staging));
+                break;
+
+            case Payload::Type::Scene:
+                scene =
+                    instantiate_baked_scene(std::move(payload->scene), _meshes, _texture_arrays);
+                break;
+
+            case Payload::Type::Failed:
+                std::cerr << "Unable to load scene (" << _file_name << ")" << std::endl;
+                break;
+
+            case Payload::Type::None:
+                break;
+        }
+
+        const bool done =
+            payload->type == Payload::Type::Scene || payload->type == Payload::Type::Failed;
+        _queue.pop();
+
+        if (done) {
+            _loading = false;
+            _meshes.clear();
+            _texture_arrays.clear();
+            break;
+        }
+    }
+
+    return scene;
+}
+
+}
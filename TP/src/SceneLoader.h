@@ -0,0 +1,73 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <BakedScene.h>
+#include <SpscQueue.h>
+#include <StagingBuffer.h>
+#include <Texture.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace OM3D {
+
+class Scene;
+
+// Loads scenes in the background while the current scene keeps rendering.
+// A worker thread reads or bakes the scene (see bake_scene_file), then hands its meshes and
+// texture arrays one by one to the render thread over a lock free queue. update() uploads them
+// through a staging buffer under a byte budget per frame, and returns the scene once it is
+// complete.
+class SceneLoader : NonMovable {
+
+    public:
+        SceneLoader(size_t staging_size = 64 << 20);
+        ~SceneLoader();
+
+        // Start loading a scene, returns false if one is already loading
+        bool load(const std::string& file_name);
+
+        bool is_loading() const;
+        const std::string& file_name() const;
+
+        // To be called once per frame on the GL thread. Uploads payloads for up to budget bytes,
+        // at least one, and returns the scene once all of them are uploaded.
+        std::unique_ptr<Scene> update(size_t budget);
+
+    private:
+        struct Payload {
+            enum class Type { None, Mesh, Texture, Scene, Failed };
+
+            Type type = Type::None;
+            u32 index = 0;
+            BakedMesh mesh;
+            // Layers of a texture array, see pack_texture_arrays
+            std::vector<BakedTexture> texture_layers;
+            // Sent last, it owns the memory the texture payloads point to
+            std::unique_ptr<BakedScene> scene;
+
+            size_t byte_size() const;
+        };
+
+        void run(const std::string& file_name);
+        bool push(Payload&& payload);
+
+        SpscQueue<Payload> _queue;
+        StagingBuffer _staging;
+
+        std::thread _thread;
+        std::atomic<bool> _cancel = false;
+
+        // Render thread side
+        bool _loading = false;
+        std::string _file_name;
+        std::vector<std::shared_ptr<StaticMesh>> _meshes;
+        std::vector<std::shared_ptr<Texture>> _texture_arrays;
+};
+
+}
+
+#endif // SCENELOADER_H
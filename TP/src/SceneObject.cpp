@@ -2,13 +2,11 @@
 
 #include <glad/glad.h>
 #include <glm/gtc/matrix_transform.hpp>
-#include <limits>
 
 namespace OM3D {
 
 SceneObject::SceneObject(std::shared_ptr<StaticMesh> mesh, std::shared_ptr<Material> material)
     : _mesh(mesh), _material(std::move(material)) {
-        glGenQueries(1, &_queryId);
 }
 
 void SceneObject::render(const Frustum& frustum, const glm::vec3& camPosition) const {
@@ -17,27 +15,11 @@ void SceneObject::render(const Frustum& frustum, const glm::vec3& camPosition) c
     }
 
     _material->set_uniform(RenderMode::INSTANCED, HASH("model"), transform());
+    _mesh->set_vertex_uniforms(*_material, RenderMode::INSTANCED);
     _material->bind(RenderMode::INSTANCED);
     _mesh->draw(frustum, _transform, camPosition);
 }
 
-float SceneObject::distToCam(const glm::vec3& camPos, const glm::vec3& camFront) const {
-    float minDist = std::numeric_limits<float>::max();
-    auto c = glm::vec3(this->transform() * glm::vec4(0.0, 0.0, 0.0, 1.0));
-    for (int x = -1; x <= 1; x += 2) {
-        for (int y = -1; y <= 1; y += 2) {
-            for (int z = -1; z <= 1; z += 2) {
-                auto t = glm::vec3(x * this->_mesh->lengthX / 2, y * this->_mesh->lengthY / 2,
-                                   z * this->_mesh->lengthZ / 2);
-                auto p = c + glm::mat3(transform()) * (t);
-                float dist = std::abs(glm::dot((p - camPos), camFront));
-                minDist = (dist < minDist ? dist : minDist);
-            }
-        }
-    }
-    return minDist;
-}
-
 void SceneObject::set_transform(const glm::mat4& tr) {
     _transform = tr;
 }
@@ -19,14 +19,11 @@ class SceneObject : NonCopyable {
 
         void render(const Frustum& frustum, const glm::vec3 &position) const;
 
-        float distToCam(const glm::vec3& camPos, const glm::vec3& camFront) const;
         void set_transform(const glm::mat4& tr);
         const glm::mat4& transform() const;
 
         std::shared_ptr<StaticMesh> _mesh;
         std::shared_ptr<Material> _material;
-        uint _queryId;
-        bool _queryActive = false;
         bool mark = false;
 
     private:
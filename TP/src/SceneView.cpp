@@ -43,6 +43,12 @@ void SceneView::render() const {
     }
 }
 
+void SceneView::renderDepth() const {
+    if(_scene) {
+        _scene->renderDepth(_camera);
+    }
+}
+
 void SceneView::renderOcclusion(bool debug) {
     if(_scene) {
         _scene->renderOcclusion(_camera, debug);
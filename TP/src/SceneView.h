@@ -18,6 +18,7 @@ class SceneView {
         void renderShadingDirectional(std::shared_ptr<Program> programp) const;
         void renderTAA(std::shared_ptr<Program> programp) const;
         void render() const;
+        void renderDepth() const;
         void renderOcclusion(bool debug);
 
     private:
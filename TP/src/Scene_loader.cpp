@@ -1,11 +1,21 @@
 #include "Scene.h"
 #include "StaticMesh.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
+#include "BakedScene.h"
+#include "ThreadPool.h"
+#include "TextureCache.h"
+#include "TextureCompression.h"
+#include "TextureFile.h"
 
 #include <glm/gtc/quaternion.hpp>
 
 #include <utils.h>
 
+#include <algorithm>
 #include <iostream>
+#include <unordered_set>
 
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -194,10 +204,38 @@ static Result<MeshData> build_mesh_data(const tinygltf::Model& gltf,
         }
     }
 
-    return {true, MeshData{std::move(vertices), std::move(indices)}};
+    return {true, MeshData{std::move(vertices), std::move(indices), {}, {}}};
+}
+
+// Keeps images encoded while parsing, so that they are decoded in parallel while baking
+static bool defer_image_decode(tinygltf::Image* image, int, std::string*, std::string*, int, int,
+                               const unsigned char* bytes, int size, void*) {
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
 }
 
 static Result<TextureData> build_texture_data(const tinygltf::Image& image, bool as_sRGB) {
+    if (image.as_is) {
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        u8* pixels = stbi_load_from_memory(image.image.data(), int(image.image.size()), &width,
+                                           &height, &channels, 4);
+        DEFER(stbi_image_free(pixels));
+        if (!pixels || width <= 0 || height <= 0) {
+            std::cerr << "Unable to decode image \"" << image.name << "\"" << std::endl;
+            return {false, {}};
+        }
+
+        const size_t bytes = size_t(width) * size_t(height) * 4;
+        auto data = std::make_unique<u8[]>(bytes);
+        std::copy_n(pixels, bytes, data.get());
+
+        const ImageFormat format = as_sRGB ? ImageFormat::RGBA8_sRGB : ImageFormat::RGBA8_UNORM;
+        return {true, TextureData{std::move(data), glm::uvec2(width, height), format}};
+    }
+
     if (image.bits != 8 && image.pixel_type != TINYGLTF_COMPONENT_TYPE_BYTE &&
         image.pixel_type != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
         std::cerr << "Unsupported image format (pixel type)" << std::endl;
@@ -225,39 +263,195 @@ static Result<TextureData> build_texture_data(const tinygltf::Image& image, bool
     return {true, TextureData{std::move(data), glm::uvec2(image.width, image.height), format}};
 }
 
-static glm::mat4 parse_node_matrix(const tinygltf::Node& node) {
-    glm::vec3 translation(0.0f, 0.0f, 0.0f);
+static void parse_node_trs(const tinygltf::Node& node, glm::vec3& translation, glm::quat& rotation,
+                           glm::vec3& scale) {
+    translation = glm::vec3(0.0f, 0.0f, 0.0f);
     for (u32 k = 0; k != node.translation.size(); ++k) {
         translation[k] = float(node.translation[k]);
     }
 
-    glm::vec3 scale(1.0f, 1.0f, 1.0f);
+    scale = glm::vec3(1.0f, 1.0f, 1.0f);
     for (u32 k = 0; k != node.scale.size(); ++k) {
         scale[k] = float(node.scale[k]);
     }
 
-    glm::vec4 rotation(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec4 q(0.0f, 0.0f, 0.0f, 1.0f);
     for (u32 k = 0; k != node.rotation.size(); ++k) {
-        rotation[k] = float(node.rotation[k]);
+        q[k] = float(node.rotation[k]);
     }
+    rotation = glm::quat(q.w, q.x, q.y, q.z);
+}
 
-    const glm::tquat<float> q(rotation.w, rotation.x, rotation.y, rotation.z);
-    return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(q) *
+static glm::mat4 parse_node_matrix(const tinygltf::Node& node) {
+    if (node.matrix.size() == 16) {
+        glm::mat4 matrix;
+        for (u32 k = 0; k != 16; ++k) {
+            matrix[k / 4][k % 4] = float(node.matrix[k]);
+        }
+        return matrix;
+    }
+
+    glm::vec3 translation;
+    glm::quat rotation;
+    glm::vec3 scale;
+    parse_node_trs(node, translation, rotation, scale);
+    return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) *
            glm::scale(glm::mat4(1.0f), scale);
 }
 
-static glm::mat4 base_transform() {
-    return glm::mat4(1.0f);
+// Nodes of the scene, or every node that is not a child if there is no default scene
+static std::vector<int> root_nodes(const tinygltf::Model& gltf) {
+    if (gltf.defaultScene >= 0) {
+        return gltf.scenes[gltf.defaultScene].nodes;
+    }
+
+    std::vector<bool> is_child(gltf.nodes.size(), false);
+    for (const tinygltf::Node& node : gltf.nodes) {
+        for (int child : node.children) {
+            is_child[child] = true;
+        }
+    }
+
+    std::vector<int> roots;
+    for (u32 i = 0; i != gltf.nodes.size(); ++i) {
+        if (!is_child[i]) {
+            roots.push_back(int(i));
+        }
+    }
+    return roots;
 }
 
-static void parse_node_transforms(int node_index, const tinygltf::Model& gltf,
-                                  std::unordered_map<int, glm::mat4>& node_transforms,
-                                  const glm::mat4& parent_transform = base_transform()) {
+// Add the node and its children to the baked scene, parents first
+static void bake_node_hierarchy(int node_index, const tinygltf::Model& gltf, BakedScene& baked,
+                                std::vector<u32>& baked_nodes,
+                                u32 parent = TransformSystem::no_parent) {
     const tinygltf::Node& node = gltf.nodes[node_index];
-    const glm::mat4 transform = parent_transform * parse_node_matrix(node);
-    node_transforms[node_index] = transform;
+    const u32 baked_node = u32(baked.nodes.size());
+    baked.nodes.push_back({parse_node_matrix(node), parent});
+    baked_nodes[node_index] = baked_node;
     for (int child : node.children) {
-        parse_node_transforms(child, gltf, node_transforms, transform);
+        bake_node_hierarchy(child, gltf, baked, baked_nodes, baked_node);
+    }
+}
+
+static Result<std::vector<float>> decode_float_accessor(const tinygltf::Model& gltf,
+                                                        const tinygltf::Accessor& accessor) {
+    const tinygltf::BufferView& buffer = gltf.bufferViews[accessor.bufferView];
+    const size_t components = component_count(accessor.type);
+
+    // Animation outputs can also be stored as normalized integers
+    auto decode = [&](auto zero, float scale) {
+        using value_type = decltype(zero);
+        const u8* in_begin =
+            gltf.buffers[buffer.buffer].data.data() + buffer.byteOffset + accessor.byteOffset;
+        const size_t input_stride =
+            buffer.byteStride ? buffer.byteStride : components * sizeof(value_type);
+
+        std::vector<float> values(accessor.count * components);
+        for (size_t i = 0; i != accessor.count; ++i) {
+            const value_type* in = reinterpret_cast<const value_type*>(in_begin + i * input_stride);
+            for (size_t k = 0; k != components; ++k) {
+                float value = float(in[k]) * scale;
+                if constexpr (std::is_integral_v<value_type> && std::is_signed_v<value_type>) {
+                    value = std::max(value, -1.0f);
+                }
+                values[i * components + k] = value;
+            }
+        }
+        return values;
+    };
+
+    switch (accessor.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return {true, decode(0.0f, 1.0f)};
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return {true, decode(i8(0), 1.0f / 127.0f)};
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return {true, decode(u8(0), 1.0f / 255.0f)};
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            return {true, decode(i16(0), 1.0f / 32767.0f)};
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return {true, decode(u16(0), 1.0f / 65535.0f)};
+        default:
+            std::cerr << "Unsupported animation component type (" << accessor.componentType << ")"
+                      << std::endl;
+            return {false, {}};
+    }
+}
+
+static void bake_animations(const tinygltf::Model& gltf, const std::vector<u32>& baked_nodes,
+                            BakedScene& baked) {
+    // Animated node index of every glTF node, created on first use
+    std::vector<u32> animated_nodes(gltf.nodes.size(), u32(-1));
+
+    for (const tinygltf::Animation& animation : gltf.animations) {
+        const size_t first_channel = baked.channels.size();
+        float duration = 0.0f;
+
+        for (const tinygltf::AnimationChannel& channel : animation.channels) {
+            const int node_index = channel.target_node;
+            if (node_index < 0 || baked_nodes[node_index] == TransformSystem::no_parent) {
+                continue;
+            }
+
+            AnimationPath path = AnimationPath::Translation;
+            if (channel.target_path == "rotation") {
+                path = AnimationPath::Rotation;
+            } else if (channel.target_path == "scale") {
+                path = AnimationPath::Scale;
+            } else if (channel.target_path != "translation") {
+                std::cerr << "Animation path \"" << channel.target_path << "\" is not supported"
+                          << std::endl;
+                continue;
+            }
+
+            const tinygltf::AnimationSampler& sampler = animation.samplers[channel.sampler];
+            const auto times = decode_float_accessor(gltf, gltf.accessors[sampler.input]);
+            const auto outputs = decode_float_accessor(gltf, gltf.accessors[sampler.output]);
+            if (!times.is_ok || !outputs.is_ok || times.value.empty()) {
+                continue;
+            }
+
+            // Cubic splines store an in tangent, a value and an out tangent per key.
+            // Only values are kept, and interpolated linearly.
+            const bool cubic = sampler.interpolation == "CUBICSPLINE";
+            const size_t components = component_count(gltf.accessors[sampler.output].type);
+            const size_t key_stride = (cubic ? 3 : 1) * components;
+            const size_t key_offset = cubic ? components : 0;
+            if (outputs.value.size() < times.value.size() * key_stride) {
+                continue;
+            }
+
+            BakedChannel& data = baked.channels.emplace_back();
+            data.path = path;
+            data.interpolation =
+                sampler.interpolation == "STEP" ? Interpolation::Step : Interpolation::Linear;
+            data.times = times.value;
+            data.values.resize(times.value.size(), glm::vec4(0.0f));
+            for (size_t i = 0; i != times.value.size(); ++i) {
+                for (size_t k = 0; k != std::min<size_t>(components, 4); ++k) {
+                    data.values[i][int(k)] = outputs.value[i * key_stride + key_offset + k];
+                }
+            }
+            duration = std::max(duration, times.value.back());
+
+            u32& animated = animated_nodes[node_index];
+            if (animated == u32(-1)) {
+                glm::vec3 translation;
+                glm::quat rotation;
+                glm::vec3 scale;
+                parse_node_trs(gltf.nodes[node_index], translation, rotation, scale);
+                animated = u32(baked.animated_nodes.size());
+                baked.animated_nodes.push_back(
+                    {baked_nodes[node_index], translation, rotation, scale});
+            }
+            data.animated_node = animated;
+        }
+
+        // Channels of an animation loop together
+        for (size_t i = first_channel; i != baked.channels.size(); ++i) {
+            baked.channels[i].duration = duration;
+        }
     }
 }
 
@@ -289,6 +483,63 @@ static void compute_tangents(MeshData& mesh) {
     }
 }
 
+// Meshes with fewer triangles are drawn whole, culling their clusters would not pay off
+static constexpr size_t meshlet_min_triangles = 1024;
+
+// Sort triangle clusters front to back from outside the mesh, at a small vertex cache cost
+static constexpr bool reorder_for_overdraw = true;
+
+// Upload imported meshes as CompactVertex, a third of the memory and bandwidth of Vertex
+static constexpr bool compact_vertex_format = true;
+
+// Store imported textures as BC1/BC3/BC5, 4 to 8 times smaller than RGBA8
+static constexpr bool compress_textures = true;
+
+// Import time processing shared by every mesh.
+// Vertex cache statistics of the full mesh before and after are added to stats.
+static void prepare_mesh_data(MeshData& mesh, VertexCacheStats* before = nullptr,
+                              VertexCacheStats* after = nullptr) {
+    if (before) {
+        before->add(analyze_vertex_cache(mesh.indices, mesh.vertices.size()));
+    }
+
+    weld_vertices(mesh);
+    generate_lods(mesh);
+
+    // Meshlets fix the order of their ranges, only their inside is reordered
+    if (mesh.indices.size() >= 3 * meshlet_min_triangles) {
+        mesh.meshlets = build_meshlets(mesh.vertices, mesh.indices);
+        optimize_meshlets(mesh.indices, mesh.vertices.size(), mesh.meshlets);
+    } else if (reorder_for_overdraw) {
+        optimize_overdraw(mesh.vertices, mesh.indices);
+    } else {
+        optimize_vertex_cache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+    }
+    for (MeshLod& level : mesh.lods) {
+        optimize_vertex_cache(level.indices.data(), level.indices.size(), mesh.vertices.size());
+    }
+    optimize_vertex_fetch(mesh);
+
+    if (after) {
+        after->add(analyze_vertex_cache(mesh.indices, mesh.vertices.size()));
+    }
+}
+
+// Returns the mesh built from data, shared with every identical mesh imported before
+static std::shared_ptr<StaticMesh> import_mesh(MeshData& data, VertexCacheStats* before,
+                                               VertexCacheStats* after) {
+    MeshCache& cache = MeshCache::global();
+    const MeshKey key = MeshKey::from_data(data);
+    if (auto mesh = cache.find(key)) {
+        return mesh;
+    }
+
+    prepare_mesh_data(data, before, after);
+    auto mesh = std::make_shared<StaticMesh>(data, compact_vertex_format);
+    cache.add(key, mesh);
+    return mesh;
+}
+
 Result<std::shared_ptr<StaticMesh>> Scene::meshFromGltf(const std::string& file_name) {
     tinygltf::TinyGLTF ctx;
     tinygltf::Model gltf;
@@ -313,29 +564,148 @@ Result<std::shared_ptr<StaticMesh>> Scene::meshFromGltf(const std::string& file_
         }
     }
 
-    auto scene = std::make_unique<Scene>();
+    for (const tinygltf::Node& node : gltf.nodes) {
+        if (node.mesh < 0) {
+            continue;
+        }
 
-    std::unordered_map<int, std::shared_ptr<Texture>> textures;
-    std::unordered_map<int, std::shared_ptr<Material>> materials;
-    std::unordered_map<int, glm::mat4> node_transforms;
+        const tinygltf::Mesh& mesh = gltf.meshes[node.mesh];
 
-    {
-        std::vector<int> node_indices;
-        if (gltf.defaultScene >= 0) {
-            node_indices = gltf.scenes[gltf.defaultScene].nodes;
-        } else {
-            for (u32 i = 0; i != gltf.nodes.size(); ++i) {
-                node_indices.push_back(i);
-                node_transforms[i] = base_transform();
+        for (size_t j = 0; j != mesh.primitives.size(); ++j) {
+            const tinygltf::Primitive& prim = mesh.primitives[j];
+
+            if (prim.mode != TINYGLTF_MODE_TRIANGLES) {
+                continue;
             }
+
+            auto mesh = build_mesh_data(gltf, prim);
+            if (!mesh.is_ok) {
+                return {false, {}};
+            }
+
+            if (mesh.value.vertices[0].tangent_bitangent_sign == glm::vec4(0.0f)) {
+                compute_tangents(mesh.value);
+            }
+            return {true, import_mesh(mesh.value, nullptr, nullptr)};
+        }
+    }
+
+    return {false, {}};
+}
+
+// KTX2 and DDS images that can be uploaded without decoding. Basis supercompressed ones can not.
+static bool is_stored_texture(const tinygltf::Image& image) {
+    return image.as_is && is_texture_file(image.image) && parse_texture_file(image.image).is_ok;
+}
+
+// Mip chain of an image in storage. KTX2 and DDS images are copied as they are, other images are
+// decoded and processed.
+static Result<BakedTexture> bake_image(const tinygltf::Image& image, TextureUsage usage,
+                                       std::vector<u8>& storage) {
+    const bool as_sRGB = usage == TextureUsage::Color;
+
+    BakedTexture baked;
+    if (image.as_is && is_texture_file(image.image)) {
+        const auto file = parse_texture_file(image.image, as_sRGB);
+        if (!file.is_ok) {
+            std::cerr << "Unable to read image \"" << image.name << "\"" << std::endl;
+            return {false, {}};
         }
 
-        for (int node : node_indices) {
-            parse_node_transforms(node, gltf, node_transforms);
+        baked.size = file.value.size;
+        baked.format = file.value.format;
+        baked.levels = u32(file.value.levels.size());
+        for (Span<const u8> level : file.value.levels) {
+            storage.insert(storage.end(), level.begin(), level.end());
         }
+    } else {
+        const auto texture = build_texture_data(image, as_sRGB);
+        if (!texture.is_ok) {
+            return {false, {}};
+        }
+
+        baked.size = texture.value.size;
+        baked.levels = Texture::mip_levels(baked.size);
+        if (compress_textures) {
+            CompressedTexture compressed = compress_texture(texture.value, usage);
+            baked.format = compressed.format;
+            storage = std::move(compressed.mip_chain);
+        } else {
+            baked.format = texture.value.format;
+            storage = build_mip_chain(texture.value);
+        }
+    }
+
+    baked.mip_chain = storage;
+    return {true, baked};
+}
+
+// Nodes, animations, processed meshes, mipped textures and materials of a file.
+// Primitives and images are decoded and processed on the thread pool, GL objects are only created
+// later by instantiate_scene. Returns false if a mesh could not be decoded.
+static bool bake_gltf(const tinygltf::Model& gltf, BakedScene& baked) {
+    std::vector<u32> baked_nodes(gltf.nodes.size(), TransformSystem::no_parent);
+    for (int node : root_nodes(gltf)) {
+        bake_node_hierarchy(node, gltf, baked, baked_nodes);
     }
+    bake_animations(gltf, baked_nodes, baked);
+
+    // Gather the work first, so that every primitive and image is decoded once
+    struct ImageSource {
+        int image;
+        TextureUsage usage;
+    };
+    std::vector<const tinygltf::Primitive*> primitives;
+    std::vector<ImageSource> images;
+
+    // Nodes that share a glTF mesh share its geometry
+    std::unordered_map<u64, u32> primitive_indices;
+    // Image index of every glTF image
+    std::unordered_map<int, i32> image_indices;
+    std::unordered_map<int, i32> materials;
+
+    auto add_image = [&](const auto& texture_info, TextureUsage usage) -> i32 {
+        if (texture_info.texCoord != 0) {
+            std::cerr << "Unsupported texture coordinate channel (" << texture_info.texCoord
+                      << ")" << std::endl;
+            return -1;
+        }
+
+        if (texture_info.index < 0) {
+            return -1;
+        }
+
+        // Precompressed images are preferred to their fallback, if they can be uploaded as stored
+        const tinygltf::Texture& texture = gltf.textures[texture_info.index];
+        int index = texture.source;
+        for (const char* extension : {"KHR_texture_basisu", "MSFT_texture_dds"}) {
+            const auto it = texture.extensions.find(extension);
+            if (it == texture.extensions.end() || !it->second.Has("source")) {
+                continue;
+            }
+            const int source = it->second.Get("source").GetNumberAsInt();
+            if (source >= 0 && source < int(gltf.images.size()) &&
+                is_stored_texture(gltf.images[source])) {
+                index = source;
+            }
+        }
+        if (index < 0 || index >= int(gltf.images.size())) {
+            return -1;
+        }
+
+        const auto it = image_indices.emplace(index, i32(images.size())).first;
+        if (it->second == i32(images.size())) {
+            images.push_back({index, usage});
+        }
+        return it->second;
+    };
+
+    // Objects point to primitives and images until they are processed
+    for (size_t node_index = 0; node_index != gltf.nodes.size(); ++node_index) {
+        if (baked_nodes[node_index] == TransformSystem::no_parent) {
+            continue;
+        }
 
-    for (auto [node_index, node_transform] : node_transforms) {
         const tinygltf::Node& node = gltf.nodes[node_index];
         if (node.mesh < 0) {
             continue;
@@ -350,28 +720,365 @@ Result<std::shared_ptr<StaticMesh>> Scene::meshFromGltf(const std::string& file_
                 continue;
             }
 
-            auto mesh = build_mesh_data(gltf, prim);
+            const u64 key = u64(node.mesh) << 32 | j;
+            const auto primitive =
+                primitive_indices.emplace(key, u32(primitives.size())).first->second;
+            if (primitive == primitives.size()) {
+                primitives.push_back(&prim);
+            }
+
+            i32 material = -1;
+            if (prim.material >= 0) {
+                auto material_it = materials.find(prim.material);
+                if (material_it == materials.end()) {
+                    const tinygltf::Material& gltf_material = gltf.materials[prim.material];
+                    BakedMaterial mat;
+                    const auto& pbr = gltf_material.pbrMetallicRoughness;
+                    mat.albedo = add_image(pbr.baseColorTexture, TextureUsage::Color);
+                    mat.normal = add_image(gltf_material.normalTexture, TextureUsage::NormalMap);
+
+                    material_it =
+                        materials.emplace(prim.material, i32(baked.materials.size())).first;
+                    baked.materials.push_back(mat);
+                }
+                material = material_it->second;
+            }
+
+            baked.objects.push_back({baked_nodes[node_index], primitive, material});
+        }
+    }
+
+    ThreadPool& pool = ThreadPool::global();
+
+    // Images with the same bytes and usage are baked once, and reused from other files
+    std::vector<TextureKey> image_keys(images.size());
+    pool.parallel_for(u32(images.size()), [&](u32 i) {
+        const tinygltf::Image& image = gltf.images[images[i].image];
+        image_keys[i] = TextureKey::from_image(image.image, images[i].usage);
+    });
+
+    TextureCache& texture_cache = TextureCache::global();
+    std::vector<std::shared_ptr<const SharedBakedTexture>> image_textures(images.size());
+    // First image with the same key
+    std::vector<u32> image_sources(images.size());
+    std::unordered_multimap<u64, u32> images_by_hash;
+    std::vector<u32> baked_images;
+    size_t reused_images = 0;
+    for (u32 i = 0; i != images.size(); ++i) {
+        const TextureKey& key = image_keys[i];
+        image_sources[i] = i;
+        const auto range = images_by_hash.equal_range(key.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (image_keys[it->second] == key) {
+                image_sources[i] = it->second;
+            }
+        }
+        if (image_sources[i] == i) {
+            images_by_hash.emplace(key.hash, i);
+            image_textures[i] = texture_cache.find(key);
+            if (image_textures[i]) {
+                ++reused_images;
+            } else {
+                baked_images.push_back(i);
+            }
+        }
+    }
+
+    // Decode every primitive and every image that is not cached
+    std::vector<Result<MeshData>> primitive_data(primitives.size());
+    std::vector<MeshKey> primitive_keys(primitives.size());
+    pool.parallel_for(u32(primitives.size() + baked_images.size()), [&](u32 i) {
+        if (i < primitives.size()) {
+            auto& mesh = primitive_data[i];
+            mesh = build_mesh_data(gltf, *primitives[i]);
             if (!mesh.is_ok) {
-                return {false, {}};
+                return;
             }
 
             if (mesh.value.vertices[0].tangent_bitangent_sign == glm::vec4(0.0f)) {
                 compute_tangents(mesh.value);
             }
+            primitive_keys[i] = MeshKey::from_data(mesh.value);
+        } else {
+            const u32 image = baked_images[i - primitives.size()];
+            const ImageSource& source = images[image];
+            auto texture = std::make_shared<SharedBakedTexture>();
+            const auto baked_texture =
+                bake_image(gltf.images[source.image], source.usage, texture->storage);
+            if (baked_texture.is_ok) {
+                texture->texture = baked_texture.value;
+                image_textures[image] = std::move(texture);
+            }
+        }
+    });
+    for (const u32 image : baked_images) {
+        if (image_textures[image]) {
+            texture_cache.add(image_keys[image], image_textures[image]);
+        }
+    }
 
-            auto staticMeshp = std::make_shared<StaticMesh>(mesh.value);
-            return {true, std::move(staticMeshp)};
+    // Identical primitives are only processed and stored once
+    std::vector<u32> primitive_meshes(primitives.size());
+    std::unordered_multimap<u64, u32> meshes_by_hash;
+    for (size_t i = 0; i != primitives.size(); ++i) {
+        if (!primitive_data[i].is_ok) {
+            return false;
         }
+
+        const MeshKey& key = primitive_keys[i];
+        u32 mesh_index = u32(baked.meshes.size());
+        const auto range = meshes_by_hash.equal_range(key.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (baked.meshes[it->second].key == key) {
+                mesh_index = it->second;
+            }
+        }
+        if (mesh_index == baked.meshes.size()) {
+            baked.meshes.push_back({key, std::move(primitive_data[i].value)});
+            meshes_by_hash.emplace(key.hash, mesh_index);
+        }
+        primitive_meshes[i] = mesh_index;
+    }
+    for (BakedObject& object : baked.objects) {
+        object.mesh = primitive_meshes[object.mesh];
     }
+
+    std::vector<VertexCacheStats> cache_before(baked.meshes.size());
+    std::vector<VertexCacheStats> cache_after(baked.meshes.size());
+    pool.parallel_for(u32(baked.meshes.size()), [&](u32 i) {
+        prepare_mesh_data(baked.meshes[i].data, &cache_before[i], &cache_after[i]);
+    });
+
+    // Images that could not be decoded are left out of their materials
+    std::vector<i32> texture_indices(images.size(), -1);
+    for (size_t i = 0; i != images.size(); ++i) {
+        const u32 source = image_sources[i];
+        if (source != i) {
+            texture_indices[i] = texture_indices[source];
+        } else if (image_textures[i]) {
+            texture_indices[i] = i32(baked.textures.size());
+            baked.textures.push_back(image_textures[i]->texture);
+            baked.texture_storage.push_back(std::move(image_textures[i]));
+        }
+    }
+    for (BakedMaterial& material : baked.materials) {
+        material.albedo = material.albedo < 0 ? -1 : texture_indices[material.albedo];
+        material.normal = material.normal < 0 ? -1 : texture_indices[material.normal];
+    }
+    std::cout << images.size() << " images baked to " << baked.textures.size() << " textures, "
+              << reused_images << " reused from other files" << std::endl;
+
+    VertexCacheStats total_before;
+    VertexCacheStats total_after;
+    for (size_t i = 0; i != baked.meshes.size(); ++i) {
+        total_before.add(cache_before[i]);
+        total_after.add(cache_after[i]);
+    }
+    std::cout << "Vertex cache ACMR " << total_before.acmr() << " -> " << total_after.acmr()
+              << ", ATVR " << total_before.atvr() << " -> " << total_after.atvr() << std::endl;
+
+    return true;
 }
 
-Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
+std::shared_ptr<StaticMesh> create_baked_mesh(const BakedMesh& baked_mesh,
+                                              StagingBuffer* staging) {
+    MeshCache& cache = MeshCache::global();
+    auto mesh = cache.find(baked_mesh.key);
+    if (!mesh) {
+        mesh = std::make_shared<StaticMesh>(baked_mesh.data, compact_vertex_format, staging);
+        cache.add(baked_mesh.key, mesh);
+    }
+    return mesh;
+}
+
+// Keep the finer mips of imported textures on the CPU until they are needed, see TextureStreamer
+static constexpr bool stream_textures = true;
+
+// Arrays are streamed as a whole: larger ones mean fewer draws, but coarser streaming
+static constexpr u32 max_array_layers = 16;
+
+static bool can_share_array(const BakedTexture& lhs, const BakedTexture& rhs) {
+    return lhs.size == rhs.size && lhs.format == rhs.format && lhs.levels == rhs.levels;
+}
+
+std::vector<BakedTextureArray> pack_texture_arrays(const BakedScene& scene) {
+    std::vector<BakedTextureArray> arrays;
+    for (u32 i = 0; i != scene.textures.size(); ++i) {
+        const auto it = std::find_if(arrays.begin(), arrays.end(), [&](const auto& array) {
+            return array.textures.size() < max_array_layers &&
+                   can_share_array(scene.textures[array.textures.front()], scene.textures[i]);
+        });
+        if (it == arrays.end()) {
+            arrays.emplace_back().textures.push_back(i);
+        } else {
+            it->textures.push_back(i);
+        }
+    }
+    return arrays;
+}
+
+std::shared_ptr<Texture> create_baked_texture_array(Span<const BakedTexture> layers,
+                                                    StagingBuffer* staging) {
+    DEBUG_ASSERT(!layers.is_empty());
+    const BakedTexture& first = layers[0];
+    const u32 first_level = stream_textures ? TextureStreamer::tail_level(first) : 0;
+
+    auto array = std::make_shared<Texture>(
+        Texture::array(Texture::mip_size(first.size, first_level), first.format,
+                       first.levels - first_level, u32(layers.size())));
+    for (u32 layer = 0; layer != layers.size(); ++layer) {
+        const BakedTexture& texture = layers[layer];
+        DEBUG_ASSERT(can_share_array(texture, first));
+        const auto levels = split_mip_chain(texture.mip_chain, texture.size, texture.format,
+                                            texture.levels);
+        for (u32 level = first_level; level != texture.levels; ++level) {
+            array->upload_level(level - first_level, layer, levels[level], staging);
+        }
+    }
+    return array;
+}
+
+std::unique_ptr<Scene> instantiate_baked_scene(
+    std::shared_ptr<const BakedScene> scene_data, Span<const std::shared_ptr<StaticMesh>> meshes,
+    Span<const std::shared_ptr<Texture>> texture_arrays) {
+    const BakedScene& baked = *scene_data;
+    const std::vector<BakedTextureArray> arrays = pack_texture_arrays(baked);
+    DEBUG_ASSERT(meshes.size() == baked.meshes.size());
+    DEBUG_ASSERT(texture_arrays.size() == arrays.size());
+
+    // Array and layer of every texture
+    std::vector<std::pair<u32, u32>> texture_layers(baked.textures.size());
+    for (u32 i = 0; i != arrays.size(); ++i) {
+        for (u32 layer = 0; layer != arrays[i].textures.size(); ++layer) {
+            texture_layers[arrays[i].textures[layer]] = {i, layer};
+        }
+    }
+    const auto set_texture = [&](Material& material, u32 slot, i32 texture) {
+        const auto [array, layer] = texture_layers[texture];
+        material.set_texture(slot, texture_arrays[array], layer);
+    };
+
+    auto scene = std::make_unique<Scene>();
+
+    std::vector<u32> transforms(baked.nodes.size());
+    for (size_t i = 0; i != baked.nodes.size(); ++i) {
+        const BakedNode& node = baked.nodes[i];
+        const u32 parent =
+            node.parent == TransformSystem::no_parent ? node.parent : transforms[node.parent];
+        transforms[i] = scene->add_node(node.local, parent);
+    }
+
+    AnimationPlayer& player = scene->animations();
+    std::vector<u32> animated_nodes(baked.animated_nodes.size());
+    for (size_t i = 0; i != baked.animated_nodes.size(); ++i) {
+        const BakedAnimatedNode& node = baked.animated_nodes[i];
+        animated_nodes[i] =
+            player.add_node(transforms[node.node], node.translation, node.rotation, node.scale);
+    }
+    for (const BakedChannel& channel : baked.channels) {
+        player.add_channel(animated_nodes[channel.animated_node], channel.path,
+                           channel.interpolation, channel.times, channel.values, channel.duration);
+    }
+
+    std::vector<std::shared_ptr<Material>> materials;
+    for (const BakedMaterial& baked_material : baked.materials) {
+        auto& mat = materials.emplace_back();
+        if (baked_material.albedo < 0) {
+            mat = Material::empty_material();
+        } else if (baked_material.normal < 0) {
+            mat = std::make_shared<Material>(Material::textured_material());
+            set_texture(*mat, 0u, baked_material.albedo);
+        } else {
+            mat = std::make_shared<Material>(Material::textured_normal_mapped_material());
+            set_texture(*mat, 0u, baked_material.albedo);
+            set_texture(*mat, 1u, baked_material.normal);
+        }
+    }
+
+    if (stream_textures && !texture_arrays.is_empty()) {
+        TextureStreamer& streamer = scene->texture_streamer();
+        const u32 first = streamer.add_textures(scene_data, arrays, texture_arrays);
+        for (size_t i = 0; i != materials.size(); ++i) {
+            std::vector<u32> sampled;
+            for (const i32 texture : {baked.materials[i].albedo, baked.materials[i].normal}) {
+                if (texture >= 0) {
+                    sampled.push_back(first + texture_layers[texture].first);
+                }
+            }
+            streamer.add_material(materials[i], sampled);
+        }
+    }
+
+    for (const BakedObject& object : baked.objects) {
+        auto material = object.material < 0 ? nullptr : materials[object.material];
+        auto scene_object = SceneObject(meshes[object.mesh], std::move(material));
+        scene->add_object(std::move(scene_object), transforms[object.node]);
+    }
+
+    std::unordered_set<const StaticMesh*> unique_meshes;
+    for (const std::shared_ptr<StaticMesh>& mesh : meshes) {
+        unique_meshes.insert(mesh.get());
+    }
+    std::cout << baked.objects.size() << " objects sharing " << unique_meshes.size() << " meshes"
+              << std::endl;
+
+    return scene;
+}
+
+// Scenes are baked next to their file on first load, and read back from there as long as the
+// file, the external buffers and images it references and the import switches do not change
+static constexpr bool use_baked_scenes = true;
+
+// Hash of the scene file and of the import switches that change what is baked from it
+static Result<u64> hash_scene_source(const std::string& file_name) {
+    const auto file_hash = hash_file(file_name);
+    if (!file_hash.is_ok) {
+        return {false, 0};
+    }
+    const u64 key[] = {file_hash.value, meshlet_min_triangles, reorder_for_overdraw,
+                       compact_vertex_format, compress_textures};
+    return {true, hash_bytes(Span<const u8>(reinterpret_cast<const u8*>(key), sizeof(key)))};
+}
+
+// External files of a .gltf scene, embedded data URIs are part of the file itself
+static std::vector<BakedDependency> scene_dependencies(const std::string& file_name,
+                                                       const tinygltf::Model& gltf) {
+    std::vector<BakedDependency> dependencies;
+    auto add_dependency = [&](const std::string& uri) {
+        if (!uri.empty() && !tinygltf::IsDataURI(uri)) {
+            dependencies.push_back(hash_dependency(file_name, uri));
+        }
+    };
+    for (const tinygltf::Buffer& buffer : gltf.buffers) {
+        add_dependency(buffer.uri);
+    }
+    for (const tinygltf::Image& image : gltf.images) {
+        add_dependency(image.uri);
+    }
+    return dependencies;
+}
+
+Result<BakedScene> bake_scene_file(const std::string& file_name) {
     const double time = program_time();
-    DEFER(std::cout << file_name << " loaded in "
-                    << std::round((program_time() - time) * 100.0) / 100.0 << "s" << std::endl);
+
+    const std::string baked_name = file_name + ".baked";
+    const auto source_hash = hash_scene_source(file_name);
+    if (!source_hash.is_ok) {
+        std::cerr << "Unable to read \"" << file_name << "\"" << std::endl;
+        return {false, {}};
+    }
+
+    if (use_baked_scenes) {
+        if (auto baked = read_baked_scene(baked_name, source_hash.value); baked.is_ok) {
+            std::cout << baked_name << " read in "
+                      << std::round((program_time() - time) * 100.0) / 100.0 << "s" << std::endl;
+            return baked;
+        }
+    }
 
     tinygltf::TinyGLTF ctx;
     tinygltf::Model gltf;
+    ctx.SetImageLoader(defer_image_decode, nullptr);
 
     {
         std::string err;
@@ -396,115 +1103,49 @@ Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
     std::cout << file_name << " parsed in " << std::round((program_time() - time) * 100.0) / 100.0
               << "s" << std::endl;
 
-    auto scene = std::make_unique<Scene>();
-
-    std::unordered_map<int, std::shared_ptr<Texture>> textures;
-    std::unordered_map<int, std::shared_ptr<Material>> materials;
-    std::unordered_map<int, glm::mat4> node_transforms;
-
-    {
-        std::vector<int> node_indices;
-        if (gltf.defaultScene >= 0) {
-            node_indices = gltf.scenes[gltf.defaultScene].nodes;
-        } else {
-            for (u32 i = 0; i != gltf.nodes.size(); ++i) {
-                node_indices.push_back(i);
-                node_transforms[i] = base_transform();
-            }
-        }
-
-        for (int node : node_indices) {
-            parse_node_transforms(node, gltf, node_transforms);
-        }
+    BakedScene baked;
+    if (!bake_gltf(gltf, baked)) {
+        return {false, {}};
     }
 
-    for (auto [node_index, node_transform] : node_transforms) {
-        const tinygltf::Node& node = gltf.nodes[node_index];
-        if (node.mesh < 0) {
-            continue;
-        }
-
-        const tinygltf::Mesh& mesh = gltf.meshes[node.mesh];
-
-        for (size_t j = 0; j != mesh.primitives.size(); ++j) {
-            const tinygltf::Primitive& prim = mesh.primitives[j];
-
-            if (prim.mode != TINYGLTF_MODE_TRIANGLES) {
-                continue;
-            }
+    if (use_baked_scenes &&
+        !write_baked_scene(baked_name, source_hash.value, scene_dependencies(file_name, gltf),
+                           baked)) {
+        std::cerr << "Unable to write \"" << baked_name << "\"" << std::endl;
+    }
 
-            auto mesh = build_mesh_data(gltf, prim);
-            if (!mesh.is_ok) {
-                return {false, {}};
-            }
+    return {true, std::move(baked)};
+}
 
-            if (mesh.value.vertices[0].tangent_bitangent_sign == glm::vec4(0.0f)) {
-                compute_tangents(mesh.value);
-            }
+Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
+    const double time = program_time();
+    DEFER(std::cout << file_name << " loaded in "
+                    << std::round((program_time() - time) * 100.0) / 100.0 << "s" << std::endl);
 
-            std::shared_ptr<Material> material;
-            if (prim.material >= 0) {
-                auto& mat = materials[prim.material];
-
-                if (!mat) {
-                    const auto& albedo_info =
-                        gltf.materials[prim.material].pbrMetallicRoughness.baseColorTexture;
-                    const auto& normal_info = gltf.materials[prim.material].normalTexture;
-
-                    auto load_texture = [&](auto texture_info,
-                                            bool as_sRGB) -> std::shared_ptr<Texture> {
-                        if (texture_info.texCoord != 0) {
-                            std::cerr << "Unsupported texture coordinate channel ("
-                                      << texture_info.texCoord << ")" << std::endl;
-                            return nullptr;
-                        }
-
-                        if (texture_info.index < 0) {
-                            return nullptr;
-                        }
-
-                        const int index = gltf.textures[texture_info.index].source;
-                        if (index < 0) {
-                            return nullptr;
-                        }
-
-                        auto& texture = textures[index];
-                        if (!texture) {
-                            if (const auto r = build_texture_data(gltf.images[index], as_sRGB);
-                                r.is_ok) {
-                                texture = std::make_shared<Texture>(r.value);
-                            }
-                        }
-                        return texture;
-                    };
-
-                    auto albedo = load_texture(albedo_info, true);
-                    auto normal = load_texture(normal_info, false);
-
-                    if (!albedo) {
-                        mat = Material::empty_material();
-                    } else if (!normal) {
-                        mat = std::make_shared<Material>(Material::textured_material());
-                        mat->set_texture(0u, albedo);
-                    } else {
-                        mat =
-                            std::make_shared<Material>(Material::textured_normal_mapped_material());
-                        mat->set_texture(0u, albedo);
-                        mat->set_texture(1u, normal);
-                    }
-                }
+    auto baked = bake_scene_file(file_name);
+    if (!baked.is_ok) {
+        return {false, {}};
+    }
 
-                material = mat;
-            }
+    // The scene may keep the baked textures to stream them, the geometry is not needed anymore
+    std::vector<std::shared_ptr<StaticMesh>> meshes;
+    for (BakedMesh& mesh : baked.value.meshes) {
+        meshes.push_back(create_baked_mesh(mesh));
+        mesh.data = {};
+    }
 
-            auto scene_object =
-                SceneObject(std::make_shared<StaticMesh>(mesh.value), std::move(material));
-            scene_object.set_transform(node_transform);
-            scene->add_object(std::move(scene_object));
+    std::vector<std::shared_ptr<Texture>> texture_arrays;
+    std::vector<BakedTexture> layers;
+    for (const BakedTextureArray& array : pack_texture_arrays(baked.value)) {
+        layers.clear();
+        for (const u32 texture : array.textures) {
+            layers.push_back(baked.value.textures[texture]);
         }
+        texture_arrays.push_back(create_baked_texture_array(layers));
     }
 
-    return {true, std::move(scene)};
+    auto scene_data = std::make_shared<const BakedScene>(std::move(baked.value));
+    return {true, instantiate_baked_scene(std::move(scene_data), meshes, texture_arrays)};
 }
 
 } // namespace OM3D
@@ -0,0 +1,294 @@
+#include "SoftwareOcclusion.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+namespace OM3D {
+
+static constexpr u32 full_mask = 0xFFFFFFFF;
+
+// Triangles and boxes crossing the near plane are not projected
+static constexpr float min_w = 0.001f;
+
+SoftwareOcclusion::SoftwareOcclusion(u32 width, u32 height) : _width(width), _height(height) {
+    ALWAYS_ASSERT(width % tile_width == 0 && height % tile_height == 0,
+                  "Occlusion buffer size must be a multiple of the tile size");
+    _tiles_x = width / tile_width;
+    _tiles_y = height / tile_height;
+    _far.resize(_tiles_x * _tiles_y);
+    _layer_far.resize(_tiles_x * _tiles_y);
+    _masks.resize(_tiles_x * _tiles_y);
+}
+
+u32 SoftwareOcclusion::width() const {
+    return _width;
+}
+
+u32 SoftwareOcclusion::height() const {
+    return _height;
+}
+
+size_t SoftwareOcclusion::triangle_count() const {
+    return _triangles.size();
+}
+
+void SoftwareOcclusion::begin_frame(const glm::mat4& view_proj) {
+    _view_proj = view_proj;
+    _triangles.clear();
+
+    // Depth 0 is infinitely far away
+    std::fill(_far.begin(), _far.end(), 0.0f);
+    std::fill(_layer_far.begin(), _layer_far.end(), FLT_MAX);
+    std::fill(_masks.begin(), _masks.end(), 0u);
+}
+
+void SoftwareOcclusion::add_occluder(const std::vector<Vertex>& vertices,
+                                     const std::vector<u32>& indices, const glm::mat4& transform) {
+    const glm::mat4 mvp = _view_proj * transform;
+    _clip_positions.resize(vertices.size());
+    for (size_t i = 0; i != vertices.size(); ++i) {
+        _clip_positions[i] = mvp * glm::vec4(vertices[i].position, 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        setup_triangle(_clip_positions[indices[i]], _clip_positions[indices[i + 1]],
+                       _clip_positions[indices[i + 2]]);
+    }
+}
+
+void SoftwareOcclusion::setup_triangle(const glm::vec4& p0, const glm::vec4& p1,
+                                       const glm::vec4& p2) {
+    if (p0.w < min_w || p1.w < min_w || p2.w < min_w) {
+        // Dropping an occluder triangle is always conservative
+        return;
+    }
+
+    // Setup is done in double: vertices can be far outside of the screen and edge constants
+    // would lose all their precision in float
+    const glm::dvec4 clip[3] = {p0, p1, p2};
+    double x[3];
+    double y[3];
+    double depth[3];
+    for (u32 i = 0; i != 3; ++i) {
+        const double inv_w = 1.0 / clip[i].w;
+        x[i] = (clip[i].x * inv_w * 0.5 + 0.5) * _width;
+        y[i] = (clip[i].y * inv_w * 0.5 + 0.5) * _height;
+        depth[i] = inv_w;
+    }
+
+    // Front faces are counter clockwise, as for GL back face culling
+    const double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(area > 0.0)) {
+        return;
+    }
+
+    const double min_x = std::min({x[0], x[1], x[2]});
+    const double max_x = std::max({x[0], x[1], x[2]});
+    const double min_y = std::min({y[0], y[1], y[2]});
+    const double max_y = std::max({y[0], y[1], y[2]});
+    if (max_x <= 0.0 || max_y <= 0.0 || min_x >= _width || min_y >= _height) {
+        return;
+    }
+
+    Triangle tri;
+    tri.min_tile_x = u32(std::max(min_x, 0.0)) / tile_width;
+    tri.min_tile_y = u32(std::max(min_y, 0.0)) / tile_height;
+    tri.max_tile_x = u32(std::min(max_x, _width - 1.0)) / tile_width;
+    tri.max_tile_y = u32(std::min(max_y, _height - 1.0)) / tile_height;
+
+    // Edge i goes from vertex i to vertex i + 1 and is positive inside the triangle
+    for (u32 i = 0; i != 3; ++i) {
+        const u32 j = (i + 1) % 3;
+        tri.edge_a[i] = float(y[i] - y[j]);
+        tri.edge_b[i] = float(x[j] - x[i]);
+        tri.edge_c[i] = float(x[i] * y[j] - x[j] * y[i]);
+    }
+
+    // 1/w is linear in screen space
+    const double depth_a =
+        ((depth[1] - depth[0]) * (y[2] - y[0]) - (depth[2] - depth[0]) * (y[1] - y[0])) / area;
+    const double depth_b =
+        ((depth[2] - depth[0]) * (x[1] - x[0]) - (depth[1] - depth[0]) * (x[2] - x[0])) / area;
+    tri.depth_a = float(depth_a);
+    tri.depth_b = float(depth_b);
+    tri.depth_c = float(depth[0] - depth_a * x[0] - depth_b * y[0]);
+    tri.min_depth = float(std::min({depth[0], depth[1], depth[2]}));
+
+    _triangles.push_back(tri);
+}
+
+// Bit (row * tile_width + column) is set if the center of that pixel is inside the triangle
+static u32 coverage_mask(const float (&a)[3], const float (&b)[3], const float (&c)[3],
+                         float tile_x, float tile_y) {
+    u32 mask = 0;
+#if defined(OCCLUSION_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 left = _mm_add_ps(_mm_set1_ps(tile_x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+    const __m128 right = _mm_add_ps(left, _mm_set1_ps(4.0f));
+
+    __m128 row_left[3];
+    __m128 row_right[3];
+    for (u32 e = 0; e != 3; ++e) {
+        const __m128 ea = _mm_set1_ps(a[e]);
+        const __m128 ec = _mm_set1_ps(c[e] + b[e] * (tile_y + 0.5f));
+        row_left[e] = _mm_add_ps(_mm_mul_ps(ea, left), ec);
+        row_right[e] = _mm_add_ps(_mm_mul_ps(ea, right), ec);
+    }
+
+    for (u32 row = 0; row != SoftwareOcclusion::tile_height; ++row) {
+        __m128 inside_left = _mm_cmpgt_ps(row_left[0], zero);
+        __m128 inside_right = _mm_cmpgt_ps(row_right[0], zero);
+        for (u32 e = 1; e != 3; ++e) {
+            inside_left = _mm_and_ps(inside_left, _mm_cmpgt_ps(row_left[e], zero));
+            inside_right = _mm_and_ps(inside_right, _mm_cmpgt_ps(row_right[e], zero));
+        }
+        const u32 bits =
+            u32(_mm_movemask_ps(inside_left)) | (u32(_mm_movemask_ps(inside_right)) << 4);
+        mask |= bits << (row * SoftwareOcclusion::tile_width);
+
+        for (u32 e = 0; e != 3; ++e) {
+            const __m128 eb = _mm_set1_ps(b[e]);
+            row_left[e] = _mm_add_ps(row_left[e], eb);
+            row_right[e] = _mm_add_ps(row_right[e], eb);
+        }
+    }
+#else
+    for (u32 row = 0; row != SoftwareOcclusion::tile_height; ++row) {
+        const float y = tile_y + float(row) + 0.5f;
+        for (u32 column = 0; column != SoftwareOcclusion::tile_width; ++column) {
+            const float x = tile_x + float(column) + 0.5f;
+            bool inside = true;
+            for (u32 e = 0; e != 3; ++e) {
+                inside &= a[e] * x + b[e] * y + c[e] > 0.0f;
+            }
+            mask |= u32(inside) << (row * SoftwareOcclusion::tile_width + column);
+        }
+    }
+#endif
+    return mask;
+}
+
+void SoftwareOcclusion::rasterize_rows(u32 first_row, u32 end_row) {
+    for (const Triangle& tri : _triangles) {
+        const u32 min_y = std::max(tri.min_tile_y, first_row);
+        const u32 max_y = std::min(tri.max_tile_y + 1, end_row);
+
+        for (u32 ty = min_y; ty < max_y; ++ty) {
+            const float tile_y = float(ty * tile_height);
+            for (u32 tx = tri.min_tile_x; tx <= tri.max_tile_x; ++tx) {
+                const float tile_x = float(tx * tile_width);
+                const u32 tile = ty * _tiles_x + tx;
+
+                // Farthest depth of the triangle over the tile: the plane is linear so its minimum
+                // is at a tile corner, and it can not go below the farthest vertex.
+                // Triangles that can not move the tile depth closer are skipped before coverage.
+                const float far_x = std::min(tri.depth_a * tile_x,
+                                             tri.depth_a * (tile_x + tile_width));
+                const float far_y = std::min(tri.depth_b * tile_y,
+                                             tri.depth_b * (tile_y + tile_height));
+                const float tri_far = std::max(tri.depth_c + far_x + far_y, tri.min_depth);
+                if (tri_far <= _far[tile]) {
+                    continue;
+                }
+
+                const u32 mask = coverage_mask(tri.edge_a, tri.edge_b, tri.edge_c, tile_x, tile_y);
+                if (!mask) {
+                    continue;
+                }
+
+                // Merge into the working layer, which replaces the tile depth once fully covered
+                const u32 layer_mask = _masks[tile] | mask;
+                const float layer_far = std::min(_layer_far[tile], tri_far);
+                if (layer_mask == full_mask) {
+                    _far[tile] = layer_far;
+                    _layer_far[tile] = FLT_MAX;
+                    _masks[tile] = 0;
+                } else {
+                    _layer_far[tile] = layer_far;
+                    _masks[tile] = layer_mask;
+                }
+            }
+        }
+    }
+}
+
+void SoftwareOcclusion::rasterize(ThreadPool& pool) {
+    if (_triangles.empty()) {
+        return;
+    }
+
+    // Bands of tile rows are independent, every band goes through the whole triangle list
+    const u32 band_count = std::min(_tiles_y, (pool.thread_count() + 1) * 2);
+    const u32 rows_per_band = (_tiles_y + band_count - 1) / band_count;
+    pool.parallel_for(band_count, [&](u32 band) {
+        const u32 first_row = band * rows_per_band;
+        rasterize_rows(first_row, std::min(first_row + rows_per_band, _tiles_y));
+    });
+}
+
+bool SoftwareOcclusion::is_visible(const AABB& bounds) const {
+    float min_x = FLT_MAX;
+    float min_y = FLT_MAX;
+    float max_x = -FLT_MAX;
+    float max_y = -FLT_MAX;
+    float nearest = 0.0f;
+    for (u32 i = 0; i != 8; ++i) {
+        const glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x,
+                               (i & 2) ? bounds.max.y : bounds.min.y,
+                               (i & 4) ? bounds.max.z : bounds.min.z);
+        const glm::vec4 clip = _view_proj * glm::vec4(corner, 1.0f);
+        if (clip.w < min_w) {
+            return true;
+        }
+
+        // w is linear, so the nearest point of the box is one of its corners
+        const float inv_w = 1.0f / clip.w;
+        const float x = (clip.x * inv_w * 0.5f + 0.5f) * float(_width);
+        const float y = (clip.y * inv_w * 0.5f + 0.5f) * float(_height);
+        min_x = std::min(min_x, x);
+        min_y = std::min(min_y, y);
+        max_x = std::max(max_x, x);
+        max_y = std::max(max_y, y);
+        nearest = std::max(nearest, inv_w);
+    }
+
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= float(_width) || min_y >= float(_height)) {
+        // Frustum culling is the one to decide for boxes outside of the buffer
+        return true;
+    }
+
+    const u32 min_tx = u32(std::max(min_x, 0.0f)) / tile_width;
+    const u32 min_ty = u32(std::max(min_y, 0.0f)) / tile_height;
+    const u32 max_tx = u32(std::min(max_x, float(_width - 1))) / tile_width;
+    const u32 max_ty = u32(std::min(max_y, float(_height - 1))) / tile_height;
+
+    // The box is hidden if it is behind the far depth of every tile it overlaps
+    for (u32 ty = min_ty; ty <= max_ty; ++ty) {
+        const float* row = _far.data() + ty * _tiles_x;
+        u32 tx = min_tx;
+#if defined(OCCLUSION_SSE)
+        const __m128 near4 = _mm_set1_ps(nearest);
+        for (; tx + 4 <= max_tx + 1; tx += 4) {
+            if (_mm_movemask_ps(_mm_cmpge_ps(near4, _mm_loadu_ps(row + tx)))) {
+                return true;
+            }
+        }
+#endif
+        for (; tx <= max_tx; ++tx) {
+            if (nearest >= row[tx]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}
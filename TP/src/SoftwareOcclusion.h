@@ -0,0 +1,81 @@
+#ifndef SOFTWAREOCCLUSION_H
+#define SOFTWAREOCCLUSION_H
+
+#include <AABB.h>
+#include <ThreadPool.h>
+#include <Vertex.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// Low resolution masked depth buffer rasterized on the CPU, in the style of
+// "Masked Software Occlusion Culling" (Hasselgren et al.).
+// The screen is split in 8x4 pixel tiles. Each tile stores a conservative far depth for the whole
+// tile plus a 32 bit coverage mask of a working layer, so triangles are merged without per pixel
+// depth. Depth is 1/w: larger values are closer, like the reverse-Z depth buffer.
+class SoftwareOcclusion : NonCopyable {
+
+    public:
+        static constexpr u32 tile_width = 8;
+        static constexpr u32 tile_height = 4;
+
+        SoftwareOcclusion(u32 width = 320, u32 height = 200);
+
+        u32 width() const;
+        u32 height() const;
+
+        // Clear the buffer and forget the occluders of the previous frame
+        void begin_frame(const glm::mat4& view_proj);
+
+        // Project the front facing triangles of an occluder, rasterize() draws them all at once
+        void add_occluder(const std::vector<Vertex>& vertices, const std::vector<u32>& indices,
+                          const glm::mat4& transform);
+        void rasterize(ThreadPool& pool);
+
+        // Returns false if the box is hidden behind the occluders for sure
+        bool is_visible(const AABB& bounds) const;
+
+        size_t triangle_count() const;
+
+    private:
+        // Edge functions and depth plane in pixel coordinates, with y going up
+        struct Triangle {
+            float edge_a[3];
+            float edge_b[3];
+            float edge_c[3];
+            float depth_a;
+            float depth_b;
+            float depth_c;
+            float min_depth;
+            u32 min_tile_x;
+            u32 min_tile_y;
+            u32 max_tile_x;
+            u32 max_tile_y;
+        };
+
+        void setup_triangle(const glm::vec4& p0, const glm::vec4& p1, const glm::vec4& p2);
+        void rasterize_rows(u32 first_row, u32 end_row);
+
+        u32 _width = 0;
+        u32 _height = 0;
+        u32 _tiles_x = 0;
+        u32 _tiles_y = 0;
+
+        glm::mat4 _view_proj = glm::mat4(1.0f);
+
+        std::vector<Triangle> _triangles;
+        std::vector<glm::vec4> _clip_positions;
+
+        // Per tile conservative far depth, working layer far depth and coverage mask
+        std::vector<float> _far;
+        std::vector<float> _layer_far;
+        std::vector<u32> _masks;
+};
+
+}
+
+#endif // SOFTWAREOCCLUSION_H
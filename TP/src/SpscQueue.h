@@ -0,0 +1,60 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <utils.h>
+
+#include <atomic>
+#include <vector>
+
+namespace OM3D {
+
+// Bounded lock free queue between exactly one producer thread and one consumer thread.
+// Each side only writes its own index: the producer publishes an element by moving the tail
+// forward, the consumer frees a slot by moving the head forward.
+template<typename T>
+class SpscQueue : NonMovable {
+
+    public:
+        SpscQueue(size_t capacity) : _slots(capacity + 1) {
+        }
+
+        // Producer side, returns false if the queue is full
+        bool try_push(T&& value) {
+            const size_t tail = _tail.load(std::memory_order_relaxed);
+            const size_t next = (tail + 1) % _slots.size();
+            if (next == _head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            _slots[tail] = std::move(value);
+            _tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side, returns null if the queue is empty.
+        // The element stays valid until pop() is called.
+        T* front() {
+            const size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &_slots[head];
+        }
+
+        void pop() {
+            const size_t head = _head.load(std::memory_order_relaxed);
+            DEBUG_ASSERT(head != _tail.load(std::memory_order_acquire));
+            _slots[head] = T();
+            _head.store((head + 1) % _slots.size(), std::memory_order_release);
+        }
+
+    private:
+        std::vector<T> _slots;
+
+        // Separate cache lines, so that both sides do not invalidate each other
+        alignas(64) std::atomic<size_t> _head = 0;
+        alignas(64) std::atomic<size_t> _tail = 0;
+};
+
+}
+
+#endif // SPSCQUEUE_H
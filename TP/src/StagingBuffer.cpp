@@ -0,0 +1,80 @@
+#include "StagingBuffer.h"
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+namespace OM3D {
+
+StagingBuffer::StagingBuffer(size_t size) : _buffer(ByteBuffer::persistent(size)) {
+}
+
+StagingBuffer::~StagingBuffer() {
+    for (const Frame& frame : _frames) {
+        glDeleteSync(static_cast<GLsync>(frame.fence));
+    }
+}
+
+void StagingBuffer::upload(ByteBuffer& dst, size_t dst_offset, const void* data, size_t size) {
+    if (const auto staged = stage(data, size); staged.is_ok) {
+        dst.copy(_buffer, staged.value, dst_offset, size);
+    } else {
+        dst.write(data, size, dst_offset);
+    }
+}
+
+Result<size_t> StagingBuffer::stage(const void* data, size_t size) {
+    retire_frames();
+
+    const size_t capacity = _buffer.byte_size();
+    const size_t aligned_size = (size + alignment - 1) / alignment * alignment;
+    if (!_used) {
+        _head = 0;
+    }
+
+    // Space is used in order: the free space is after the head, up to the oldest frame in flight
+    size_t offset = _head;
+    size_t padding = 0;
+    if (offset + aligned_size > capacity) {
+        padding = capacity - offset;
+        offset = 0;
+    }
+    if (!size || _used + padding + aligned_size > capacity) {
+        return {false, 0};
+    }
+
+    std::memcpy(_buffer.persistent_data() + offset, data, size);
+
+    _head = (offset + aligned_size) % capacity;
+    _used += padding + aligned_size;
+    _frame_size += padding + aligned_size;
+    return {true, offset};
+}
+
+const ByteBuffer& StagingBuffer::buffer() const {
+    return _buffer;
+}
+
+void StagingBuffer::end_frame() {
+    if (!_frame_size) {
+        return;
+    }
+
+    const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _frames.push_back({fence, _frame_size});
+    _frame_size = 0;
+}
+
+void StagingBuffer::retire_frames() {
+    while (!_frames.empty()) {
+        const GLsync fence = static_cast<GLsync>(_frames.front().fence);
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(fence);
+        _used -= _frames.front().size;
+        _frames.pop_front();
+    }
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef STAGINGBUFFER_H
+#define STAGINGBUFFER_H
+
+#include <ByteBuffer.h>
+
+#include <deque>
+
+namespace OM3D {
+
+// Persistently mapped ring buffer that uploads are copied through, so that the driver does not
+// have to copy or synchronize on its own.
+// Space written during a frame is reused once the GPU is done with the copies of that frame.
+// Uploads that do not fit in the free space are written directly instead of waiting.
+class StagingBuffer : NonMovable {
+
+    public:
+        static constexpr size_t alignment = 16;
+
+        StagingBuffer(size_t size);
+        ~StagingBuffer();
+
+        // Copy size bytes of data to dst at dst_offset
+        void upload(ByteBuffer& dst, size_t dst_offset, const void* data, size_t size);
+
+        // Copy data into the ring and return its offset in buffer(), fails if it is full
+        Result<size_t> stage(const void* data, size_t size);
+        const ByteBuffer& buffer() const;
+
+        // Fence the space used since the last call, to be called once per frame
+        void end_frame();
+
+    private:
+        void retire_frames();
+
+        struct Frame {
+            void* fence = nullptr;
+            size_t size = 0;
+        };
+
+        ByteBuffer _buffer;
+        std::deque<Frame> _frames;
+
+        // Next write offset, and bytes used by the frames in flight plus the current one
+        size_t _head = 0;
+        size_t _used = 0;
+        size_t _frame_size = 0;
+};
+
+}
+
+#endif // STAGINGBUFFER_H
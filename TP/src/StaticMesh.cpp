@@ -2,36 +2,176 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <glm/gtx/norm.hpp>
-#include <limits>
+#include <cmath>
 #include <iostream>
 
 namespace OM3D {
 
-StaticMesh::StaticMesh(const MeshData& data)
-    : _vertex_buffer(data.vertices), _index_buffer(data.indices) {
+// Levels are switched when their error would cover more than this many pixels
+static constexpr float lod_pixel_error = 1.0f;
+
+// Texture space length per mesh unit: square root of the ratio of the uv and surface areas
+static float uv_density(const MeshData& data) {
+    double uv_area = 0.0;
+    double area = 0.0;
+    for (size_t i = 0; i + 2 < data.indices.size(); i += 3) {
+        const Vertex& a = data.vertices[data.indices[i]];
+        const Vertex& b = data.vertices[data.indices[i + 1]];
+        const Vertex& c = data.vertices[data.indices[i + 2]];
+        area += glm::length(glm::cross(b.position - a.position, c.position - a.position));
+        const glm::vec2 uv_ab = b.uv - a.uv;
+        const glm::vec2 uv_ac = c.uv - a.uv;
+        uv_area += std::abs(uv_ab.x * uv_ac.y - uv_ab.y * uv_ac.x);
+    }
+    return area > 0.0 ? float(std::sqrt(uv_area / area)) : 0.0f;
+}
+
+StaticMesh::StaticMesh(const MeshData& data, bool compact, StagingBuffer* staging) {
     float maxDist = 0.0;
-    float minX = std::numeric_limits<float>::max();
-    float maxX = std::numeric_limits<float>::min();
-    float minY = std::numeric_limits<float>::max();
-    float maxY = std::numeric_limits<float>::min();
-    float minZ = std::numeric_limits<float>::max();
-    float maxZ = std::numeric_limits<float>::min();
     for (auto vertex : data.vertices) {
-        minX = (vertex.position.x < minX ? vertex.position.x : minX);
-        maxX = (vertex.position.x > maxX ? vertex.position.x : maxX);
-        minY = (vertex.position.y < minY ? vertex.position.y : minY);
-        maxY = (vertex.position.y > maxY ? vertex.position.y : maxY);
-        minZ = (vertex.position.z < minZ ? vertex.position.z : minZ);
-        maxZ = (vertex.position.z > maxZ ? vertex.position.z : maxZ);
+        aabb.extend(vertex.position);
         float dist = glm::l2Norm(vertex.position);
         if (dist > maxDist) maxDist = dist;
     }
     boundingSphereRadius = maxDist;
-    lengthX = maxX - minX;
-    lengthY = maxY - minY;
-    lengthZ = maxZ - minZ;
-    _data = data;
+    _uv_radius = uv_density(data) * maxDist;
+
+    const u32 vertex_count = u32(data.vertices.size());
+    if (compact) {
+        const bool has_colors = has_vertex_colors(data.vertices);
+        _format = VertexFormat::compact(has_colors);
+        _quantization = PositionQuantization::from_bounds(aabb);
+    } else {
+        _format = VertexFormat::standard();
+    }
+    _position_format = _format.positions_only();
+    _vertices = GeometryRange(&GeometryArena::global().vertex_pool(_format), vertex_count);
+
+    // The positions only stream comes after the streams of the format
+    const u32 position_stream = _format.stream_count();
+    if (compact) {
+        std::vector<CompactVertex> vertices(vertex_count);
+        for (size_t i = 0; i != vertices.size(); ++i) {
+            vertices[i] = compact_vertex(data.vertices[i], _quantization);
+        }
+        _vertices.write(0, vertices.data(), staging);
+
+        std::vector<glm::u16vec4> positions(vertex_count);
+        for (size_t i = 0; i != positions.size(); ++i) {
+            const u16* position = vertices[i].position;
+            positions[i] = glm::u16vec4(position[0], position[1], position[2], position[3]);
+        }
+        _vertices.write(position_stream, positions.data(), staging);
+
+        if (_format.stream_count() > 1) {
+            std::vector<glm::u8vec4> colors(vertex_count);
+            for (size_t i = 0; i != colors.size(); ++i) {
+                const glm::vec3 color = glm::clamp(data.vertices[i].color, 0.0f, 1.0f);
+                colors[i] = glm::u8vec4(glm::round(color * 255.0f), 255);
+            }
+            _vertices.write(1, colors.data(), staging);
+        }
+    } else {
+        _vertices.write(0, data.vertices.data(), staging);
+
+        std::vector<glm::vec3> positions(vertex_count);
+        for (size_t i = 0; i != positions.size(); ++i) {
+            positions[i] = data.vertices[i].position;
+        }
+        _vertices.write(position_stream, positions.data(), staging);
+    }
+
+    // Every level lives in the same index range, after the full mesh
+    _lods.push_back({0, u32(data.indices.size()), 0.0f});
+    std::vector<u32> indices = data.indices;
+    for (const MeshLod& level : data.lods) {
+        if (_lods.size() == max_lod_count) {
+            break;
+        }
+        const float error = maxDist > 0.0f ? level.error / maxDist : 0.0f;
+        _lods.push_back({u32(indices.size()), u32(level.indices.size()), error});
+        indices.insert(indices.end(), level.indices.begin(), level.indices.end());
+    }
+    _indices = GeometryRange(&GeometryArena::global().index_pool(), u32(indices.size()));
+    _indices.write(0, indices.data(), staging);
+
+    _meshlets = data.meshlets;
+
+    // The CPU copy is only used as a triangle list, the levels are not kept
+    _data.vertices = data.vertices;
+    _data.indices = data.indices;
+}
+
+u32 StaticMesh::lod_count() const {
+    return u32(_lods.size());
+}
+
+const StaticMesh::LodRange& StaticMesh::lod(u32 level) const {
+    DEBUG_ASSERT(level < _lods.size());
+    return _lods[level];
+}
+
+const std::vector<Meshlet>& StaticMesh::meshlets() const {
+    return _meshlets;
+}
+
+float StaticMesh::uv_radius() const {
+    return _uv_radius;
+}
+
+const VertexFormat& StaticMesh::vertex_format() const {
+    return _format;
+}
+
+void StaticMesh::bind_vertices() const {
+    const GeometryPool& pool = *_vertices.pool();
+    for (u32 stream = 0; stream != _format.stream_count(); ++stream) {
+        pool.buffer(stream).bind(BufferUsage::Attribute);
+        _format.bind_stream(stream);
+    }
+    _format.bind_defaults();
+    _indices.pool()->buffer(0).bind(BufferUsage::Index);
+}
+
+void StaticMesh::bind_positions() const {
+    _vertices.pool()->buffer(_format.stream_count()).bind(BufferUsage::Attribute);
+    _position_format.bind_stream(0);
+    _position_format.bind_defaults();
+    _indices.pool()->buffer(0).bind(BufferUsage::Index);
+}
+
+const GeometryPool* StaticMesh::vertex_pool() const {
+    return _vertices.pool();
+}
+
+u32 StaticMesh::base_vertex() const {
+    return _vertices.offset();
+}
+
+u32 StaticMesh::base_index() const {
+    return _indices.offset();
+}
+
+void StaticMesh::set_vertex_uniforms(Material& material, RenderMode mode) const {
+    material.set_uniform(mode, HASH("compact_vertices"), u32(_format.is_compact()));
+    material.set_uniform(mode, HASH("vertex_position_offset"), _quantization.offset);
+    material.set_uniform(mode, HASH("vertex_position_scale"), _quantization.scale);
+}
+
+void StaticMesh::set_vertex_uniforms(Program& program) const {
+    program.set_uniform(HASH("compact_vertices"), u32(_format.is_compact()));
+    program.set_uniform(HASH("vertex_position_offset"), _quantization.offset);
+    program.set_uniform(HASH("vertex_position_scale"), _quantization.scale);
+}
+
+u32 StaticMesh::select_lod(float radius_pixels) const {
+    u32 level = 0;
+    while (level + 1 < _lods.size() && _lods[level + 1].error * radius_pixels <= lod_pixel_error) {
+        ++level;
+    }
+    return level;
 }
 
 StaticMesh StaticMesh::CubeMesh() {
@@ -51,13 +191,11 @@ StaticMesh StaticMesh::CubeMesh() {
 
     std::vector<u32> indices = {14, 6,  1, 7, 23, 10, 18, 15, 21, 4, 22, 17, 2, 11, 5,  13, 3, 16,
                                 14, 19, 6, 7, 20, 23, 18, 12, 15, 4, 9,  22, 2, 8,  11, 13, 0, 3};
-    return StaticMesh({vertices, indices});
+    return StaticMesh({vertices, indices, {}, {}});
 }
 
 void StaticMesh::draw(const Frustum& frustum, const glm::mat4& transform,
                       const glm::vec3& camPosition) const {
-    _vertex_buffer.bind(BufferUsage::Attribute);
-    _index_buffer.bind(BufferUsage::Index);
     glm::vec3 center = glm::vec3(transform * glm::vec4(0.0, 0.0, 0.0, 1.0)) - camPosition;
     auto normals =
         std::vector<glm::vec3>{frustum._bottom_normal, frustum._left_normal, frustum._near_normal,
@@ -66,31 +204,13 @@ void StaticMesh::draw(const Frustum& frustum, const glm::mat4& transform,
         if (glm::dot(normal, center + normal * boundingSphereRadius) < 0) return;
     }
 
-    // Vertex position
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-    // Vertex normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(3 * sizeof(float)));
-    // Vertex uv
-    glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(6 * sizeof(float)));
-    // Tangent / bitangent sign
-    glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(8 * sizeof(float)));
-    // Vertex color
-    glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex),
-                          reinterpret_cast<void*>(12 * sizeof(float)));
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-
-    glDrawElements(GL_TRIANGLES, int(_index_buffer.element_count()), GL_UNSIGNED_INT, nullptr);
-}
-
-StaticMesh StaticMesh::getBoxMesh() {
+    bind_vertices();
+    glDrawElementsBaseVertex(GL_TRIANGLES, int(lod(0).index_count), GL_UNSIGNED_INT,
+                             reinterpret_cast<void*>(base_index() * sizeof(u32)),
+                             int(base_vertex()));
+}
+
+StaticMesh StaticMesh::getBoxMesh() const {
     std::vector<Vertex> vertices = {
         {{1, -1, -1}, {0, -1, -0}, {0.625, 0.5}},   {{1, -1, -1}, {0, 0, -1}, {0.625, 0.5}},
         {{1, -1, -1}, {1, 0, -0}, {0.625, 0.5}},    {{1, -1, 1}, {0, -1, -0}, {0.375, 0.5}},
@@ -104,24 +224,22 @@ StaticMesh StaticMesh::getBoxMesh() {
         {{-1, 1, -1}, {-1, 0, -0}, {0.625, 1}},     {{-1, 1, -1}, {0, 0, -1}, {0.875, 0.25}},
         {{-1, 1, -1}, {0, 1, -0}, {0.625, 0}},      {{-1, 1, 1}, {-1, 0, -0}, {0.375, 1}},
         {{-1, 1, 1}, {0, 0, 1}, {0.125, 0.25}},     {{-1, 1, 1}, {0, 1, -0}, {0.375, 0}}};
+    // Vertices are sorted by decreasing x, then increasing y and z, three per corner
+    const glm::vec3 center = aabb.center();
+    const glm::vec3 extent = aabb.extent();
     for (int i = 0; i <= 1; i++) {
         for (int j = 0; j <= 1; j++) {
             for (int k = 0; k <= 1; k++) {
-                int isign = i * 2 - 1;
-                int jsign = i * 2 - 1;
-                int ksign = i * 2 - 1;
-                vertices[i * 12 + j * 6 + k * 3].position = {
-                    isign * lengthX / 2.0f, jsign * lengthY / 2.0f, ksign * lengthZ / 2.0f};
-                vertices[i * 12 + j * 6 + k * 3 + 1].position = {
-                    isign * lengthX / 2.0f, jsign * lengthY / 2.0f, ksign * lengthZ / 2.0f};
-                vertices[i * 12 + j * 6 + k * 3 + 2].position = {
-                    isign * lengthX / 2.0f, jsign * lengthY / 2.0f, ksign * lengthZ / 2.0f};
+                const glm::vec3 sign(float(1 - 2 * i), float(2 * j - 1), float(2 * k - 1));
+                for (int v = 0; v != 3; ++v) {
+                    vertices[i * 12 + j * 6 + k * 3 + v].position = center + sign * extent;
+                }
             }
         }
     }
     std::vector<u32> indices = {14, 6,  1, 7, 23, 10, 18, 15, 21, 4, 22, 17, 2, 11, 5,  13, 3, 16,
                                 14, 19, 6, 7, 20, 23, 18, 12, 15, 4, 9,  22, 2, 8,  11, 13, 0, 3};
-    return StaticMesh({vertices, indices});
+    return StaticMesh({vertices, indices, {}, {}});
 }
 
 } // namespace OM3D
@@ -2,8 +2,12 @@
 #define STATICMESH_H
 
 #include <graphics.h>
-#include <TypedBuffer.h>
+#include <GeometryArena.h>
 #include <Vertex.h>
+#include <AABB.h>
+#include <Material.h>
+#include <Meshlet.h>
+#include <VertexFormat.h>
 
 #include <vector>
 
@@ -11,30 +15,89 @@
 
 namespace OM3D {
 
+struct MeshLod {
+    std::vector<u32> indices;
+    // Distance between this level and the full mesh, in mesh units
+    float error = 0.0f;
+};
+
 struct MeshData {
     std::vector<Vertex> vertices;
     std::vector<u32> indices;
+    // Coarser index lists sharing the vertices, from finest to coarsest
+    std::vector<MeshLod> lods;
+    // Clusters of the full mesh, empty for small meshes
+    std::vector<Meshlet> meshlets;
 };
 
 class StaticMesh {
 
     public:
+        static constexpr u32 max_lod_count = 5;
+
+        // Range of the index buffer drawn for a level, the error is relative to the bounding
+        // sphere radius
+        struct LodRange {
+            u32 first_index = 0;
+            u32 index_count = 0;
+            float error = 0.0f;
+        };
+
         StaticMesh() = default;
         StaticMesh(StaticMesh&&) = default;
         StaticMesh& operator=(StaticMesh&&) = default;
 
-        StaticMesh(const MeshData& data);
+        // compact stores the vertices as CompactVertex on the GPU, data keeps the full vertices.
+        // The geometry is uploaded through staging if it is not null.
+        StaticMesh(const MeshData& data, bool compact = false, StagingBuffer* staging = nullptr);
         static StaticMesh CubeMesh();
 
+        // Bind the vertex and index buffers and setup the attributes of the vertex format
+        void bind_vertices() const;
+        // Same for depth only passes, which only fetch the position stream
+        void bind_positions() const;
+        // Tell the vertex shader how to decode the attributes, see vertex_format.glsl
+        void set_vertex_uniforms(Material& material, RenderMode mode) const;
+        void set_vertex_uniforms(Program& program) const;
+
+        const VertexFormat& vertex_format() const;
+
+        // Meshes live in shared buffers: draws add these offsets, and meshes of the same pool
+        // can be drawn without binding anything again
+        const GeometryPool* vertex_pool() const;
+        u32 base_vertex() const;
+        u32 base_index() const;
+
         void draw(const Frustum& frustum, const glm::mat4&, const glm::vec3 &posistion) const;
-        TypedBuffer<Vertex> _vertex_buffer;
-        TypedBuffer<u32> _index_buffer;
+
+        u32 lod_count() const;
+        const LodRange& lod(u32 level) const;
+        // Coarsest level that looks like the full mesh when its bounding sphere covers
+        // radius_pixels on screen
+        u32 select_lod(float radius_pixels) const;
+
+        // Clusters of the first level, they can be culled independently
+        const std::vector<Meshlet>& meshlets() const;
+
+        // Texture space length of the bounding sphere radius, on average over the surface.
+        // Relates the screen size of the mesh to the texture mips it needs, 0 without uvs.
+        float uv_radius() const;
+
         float boundingSphereRadius;
-        float lengthX;
-        float lengthY;
-        float lengthZ;
+        AABB aabb;
         MeshData _data;
-        StaticMesh getBoxMesh();
+        StaticMesh getBoxMesh() const;
+
+    private:
+        VertexFormat _format;
+        VertexFormat _position_format;
+        GeometryRange _vertices;
+        GeometryRange _indices;
+        PositionQuantization _quantization;
+
+        std::vector<LodRange> _lods;
+        std::vector<Meshlet> _meshlets;
+        float _uv_radius = 0.0f;
 };
 
 }
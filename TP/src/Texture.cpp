@@ -1,10 +1,14 @@
 #include "Texture.h"
 
 #include <glad/glad.h>
+#include <glm/common.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb/stb_image_resize.h>
+
 #include <cmath>
 #include <algorithm>
 
@@ -31,11 +35,70 @@ Result<TextureData> TextureData::from_file(const std::string& file) {
     return {true, std::move(data)};
 }
 
+size_t mip_chain_size(const glm::uvec2& size, ImageFormat format) {
+    return mip_chain_size(size, format, Texture::mip_levels(size));
+}
+
+size_t mip_chain_size(const glm::uvec2& size, ImageFormat format, u32 levels) {
+    size_t bytes = 0;
+    for(u32 level = 0; level != levels; ++level) {
+        const glm::uvec2 level_size = Texture::mip_size(size, level);
+        bytes += image_byte_size(format, level_size.x, level_size.y);
+    }
+    return bytes;
+}
+
+std::vector<Span<const u8>> split_mip_chain(Span<const u8> mip_chain, const glm::uvec2& size, ImageFormat format, u32 levels) {
+    ALWAYS_ASSERT(mip_chain.size() == mip_chain_size(size, format, levels), "Incomplete mip chain");
+
+    std::vector<Span<const u8>> views;
+    const u8* level_data = mip_chain.data();
+    for(u32 level = 0; level != levels; ++level) {
+        const glm::uvec2 level_size = Texture::mip_size(size, level);
+        const size_t level_bytes = image_byte_size(format, level_size.x, level_size.y);
+        views.emplace_back(level_data, level_bytes);
+        level_data += level_bytes;
+    }
+    return views;
+}
+
+std::vector<u8> build_mip_chain(const TextureData& data) {
+    ALWAYS_ASSERT(data.format == ImageFormat::RGBA8_UNORM || data.format == ImageFormat::RGBA8_sRGB ||
+                  data.format == ImageFormat::RGB8_UNORM || data.format == ImageFormat::RGB8_sRGB,
+                  "Mip chains are only built for 8 bit textures");
+    const u32 channels = bytes_per_pixel(data.format);
+
+    std::vector<u8> chain(mip_chain_size(data.size, data.format));
+    std::copy_n(data.data.get(), image_byte_size(data.format, data.size.x, data.size.y), chain.data());
+
+    // Each level is filtered from the previous one. sRGB colors are filtered in linear space,
+    // colors are weighted by their alpha so that transparent texels do not bleed.
+    const int alpha_channel = channels == 4 ? 3 : STBIR_ALPHA_CHANNEL_NONE;
+    const stbir_colorspace colorspace = is_sRGB(data.format) ? STBIR_COLORSPACE_SRGB : STBIR_COLORSPACE_LINEAR;
+
+    const u8* src = chain.data();
+    u8* dst = chain.data() + image_byte_size(data.format, data.size.x, data.size.y);
+    for(u32 level = 1; level != Texture::mip_levels(data.size); ++level) {
+        const glm::uvec2 src_size = Texture::mip_size(data.size, level - 1);
+        const glm::uvec2 dst_size = Texture::mip_size(data.size, level);
 
+        const int ok = stbir_resize_uint8_generic(src, int(src_size.x), int(src_size.y), 0,
+                                                  dst, int(dst_size.x), int(dst_size.y), 0,
+                                                  int(channels), alpha_channel, 0, STBIR_EDGE_CLAMP,
+                                                  STBIR_FILTER_DEFAULT, colorspace, nullptr);
+        ALWAYS_ASSERT(ok, "Unable to resize texture");
 
-static GLuint create_texture_handle() {
+        src = dst;
+        dst += image_byte_size(data.format, dst_size.x, dst_size.y);
+    }
+
+    DEBUG_ASSERT(dst == chain.data() + chain.size());
+    return chain;
+}
+
+static GLuint create_texture_handle(GLenum target = GL_TEXTURE_2D) {
     GLuint handle = 0;
-    glCreateTextures(GL_TEXTURE_2D, 1, &handle);
+    glCreateTextures(target, 1, &handle);
     return handle;
 }
 
@@ -50,13 +113,97 @@ Texture::Texture(const TextureData& data) :
     glGenerateTextureMipmap(_handle.get());
 }
 
-Texture::Texture(const glm::uvec2 &size, ImageFormat format) :
+Texture::Texture(Span<const Span<const u8>> levels, const glm::uvec2& size, ImageFormat format, StagingBuffer* staging) :
+    _handle(create_texture_handle()),
+    _size(size),
+    _format(format) {
+
+    ALWAYS_ASSERT(!levels.is_empty() && levels.size() <= mip_levels(_size), "Invalid mip level count");
+
+    const ImageFormatGL gl_format = image_format_to_gl(_format);
+    glTextureStorage2D(_handle.get(), GLsizei(levels.size()), gl_format.internal_format, _size.x, _size.y);
+
+    for(u32 level = 0; level != levels.size(); ++level) {
+        upload_level(level, levels[level], staging);
+    }
+}
+
+Texture::Texture(const glm::uvec2 &size, ImageFormat format, u32 levels) :
     _handle(create_texture_handle()),
     _size(size),
     _format(format) {
 
+    ALWAYS_ASSERT(levels && levels <= mip_levels(_size), "Invalid mip level count");
+
+    const ImageFormatGL gl_format = image_format_to_gl(_format);
+    glTextureStorage2D(_handle.get(), GLsizei(levels), gl_format.internal_format, _size.x, _size.y);
+}
+
+Texture Texture::array(const glm::uvec2& size, ImageFormat format, u32 levels, u32 layers) {
+    ALWAYS_ASSERT(levels && levels <= mip_levels(size), "Invalid mip level count");
+    ALWAYS_ASSERT(layers, "Invalid layer count");
+
+    Texture texture;
+    texture._handle = GLHandle(create_texture_handle(GL_TEXTURE_2D_ARRAY));
+    texture._size = size;
+    texture._format = format;
+    texture._layers = layers;
+
+    const ImageFormatGL gl_format = image_format_to_gl(format);
+    glTextureStorage3D(texture._handle.get(), GLsizei(levels), gl_format.internal_format, size.x, size.y, GLsizei(layers));
+    return texture;
+}
+
+void Texture::upload_level(u32 level, Span<const u8> data, StagingBuffer* staging) {
+    DEBUG_ASSERT(!is_array());
+    upload_level(level, 0, data, staging);
+}
+
+void Texture::upload_level(u32 level, u32 layer, Span<const u8> data, StagingBuffer* staging) {
+    DEBUG_ASSERT(layer < layers());
+    const glm::uvec2 level_size = mip_size(_size, level);
+    const size_t level_bytes = image_byte_size(_format, level_size.x, level_size.y);
+    ALWAYS_ASSERT(data.size() == level_bytes, "Invalid mip level size");
+
+    // Levels of RGB textures are tightly packed, their rows are not aligned to 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    DEFER(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+    // Staged levels are read from the pixel unpack buffer, at their offset
+    const void* pixels = data.data();
+    const auto staged = staging ? staging->stage(data.data(), level_bytes) : Result<size_t>{false, 0};
+    if(staged.is_ok) {
+        staging->buffer().bind(BufferUsage::PixelUnpack);
+        pixels = reinterpret_cast<const void*>(staged.value);
+    }
+
     const ImageFormatGL gl_format = image_format_to_gl(_format);
-    glTextureStorage2D(_handle.get(), 1, gl_format.internal_format, _size.x, _size.y);
+    if(is_array()) {
+        if(is_compressed(_format)) {
+            glCompressedTextureSubImage3D(_handle.get(), level, 0, 0, layer, level_size.x, level_size.y, 1, gl_format.internal_format, GLsizei(level_bytes), pixels);
+        } else {
+            glTextureSubImage3D(_handle.get(), level, 0, 0, layer, level_size.x, level_size.y, 1, gl_format.format, gl_format.component_type, pixels);
+        }
+    } else if(is_compressed(_format)) {
+        glCompressedTextureSubImage2D(_handle.get(), level, 0, 0, level_size.x, level_size.y, gl_format.internal_format, GLsizei(level_bytes), pixels);
+    } else {
+        glTextureSubImage2D(_handle.get(), level, 0, 0, level_size.x, level_size.y, gl_format.format, gl_format.component_type, pixels);
+    }
+
+    if(staged.is_ok) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+void Texture::copy_level(u32 level, const Texture& src, u32 src_level) {
+    const glm::uvec2 level_size = mip_size(_size, level);
+    DEBUG_ASSERT(_format == src._format);
+    DEBUG_ASSERT(level_size == mip_size(src._size, src_level));
+    DEBUG_ASSERT(_layers == src._layers);
+    const GLenum target = is_array() ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    glCopyImageSubData(src._handle.get(), target, src_level, 0, 0, 0,
+                       _handle.get(), target, level, 0, 0, 0,
+                       level_size.x, level_size.y, layers());
 }
 
 Texture::~Texture() {
@@ -77,6 +224,14 @@ const glm::uvec2& Texture::size() const {
     return _size;
 }
 
+bool Texture::is_array() const {
+    return _layers != 0;
+}
+
+u32 Texture::layers() const {
+    return std::max(_layers, 1u);
+}
+
 void Texture::clear_with(float r, float g, float b, float a) {
     auto gl_format = image_format_to_gl(_format);
     float data[] = {r, g, b, a};
@@ -95,4 +250,8 @@ u32 Texture::mip_levels(glm::uvec2 size) {
     return 1 + u32(std::floor(std::log2(side)));
 }
 
+glm::uvec2 Texture::mip_size(glm::uvec2 size, u32 level) {
+    return glm::max(size >> level, glm::uvec2(1));
+}
+
 }
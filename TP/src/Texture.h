@@ -3,6 +3,7 @@
 
 #include <graphics.h>
 #include <ImageFormat.h>
+#include <StagingBuffer.h>
 
 #include <glm/vec2.hpp>
 
@@ -20,6 +21,16 @@ struct TextureData {
     static Result<TextureData> from_file(const std::string& file_name);
 };
 
+// Size of every mip level of a texture stored one after the other, finest first
+size_t mip_chain_size(const glm::uvec2& size, ImageFormat format);
+// Size of the first levels only, for chains that stop before 1x1
+size_t mip_chain_size(const glm::uvec2& size, ImageFormat format, u32 levels);
+// Views of the first levels of a mip chain
+std::vector<Span<const u8>> split_mip_chain(Span<const u8> mip_chain, const glm::uvec2& size,
+                                            ImageFormat format, u32 levels);
+// Mip chain of an 8 bit texture, sRGB colors are filtered in linear space
+std::vector<u8> build_mip_chain(const TextureData& data);
+
 class Texture {
 
     public:
@@ -30,17 +41,37 @@ class Texture {
         ~Texture();
 
         Texture(const TextureData& data);
-        Texture(const glm::uvec2 &size, ImageFormat format);
+        // Uploads the given levels, finest first, instead of generating them.
+        // The texture only has these levels. They go through staging if it is not null.
+        Texture(Span<const Span<const u8>> levels, const glm::uvec2& size, ImageFormat format,
+                StagingBuffer* staging = nullptr);
+        // Storage for levels mips, left uninitialized
+        Texture(const glm::uvec2 &size, ImageFormat format, u32 levels = 1);
+
+        // GL_TEXTURE_2D_ARRAY storage for levels mips of every layer, left uninitialized
+        static Texture array(const glm::uvec2& size, ImageFormat format, u32 levels, u32 layers);
+
+        // Data has the size of the level, it goes through staging if it is not null
+        void upload_level(u32 level, Span<const u8> data, StagingBuffer* staging = nullptr);
+        void upload_level(u32 level, u32 layer, Span<const u8> data,
+                          StagingBuffer* staging = nullptr);
+        // Copy of a level of a texture with the same format, the same size at that level and the
+        // same layers
+        void copy_level(u32 level, const Texture& src, u32 src_level);
 
         void bind(u32 index) const;
         void bind_as_image(u32 index, AccessType access);
 
         const glm::uvec2& size() const;
+        bool is_array() const;
+        // 1 for textures that are not arrays
+        u32 layers() const;
 
         void clear_with(float r, float g, float b, float a);
         void clear_with(float r, float g);
 
         static u32 mip_levels(glm::uvec2 size);
+        static glm::uvec2 mip_size(glm::uvec2 size, u32 level);
 
     private:
         friend class Framebuffer;
@@ -48,6 +79,8 @@ class Texture {
         GLHandle _handle;
         glm::uvec2 _size = {};
         ImageFormat _format;
+        // 0 for GL_TEXTURE_2D
+        u32 _layers = 0;
 };
 
 }
@@ -0,0 +1,34 @@
+#include "TextureCache.h"
+
+namespace OM3D {
+
+TextureKey TextureKey::from_image(Span<const u8> encoded, TextureUsage usage) {
+    return {hash_bytes(encoded), encoded.size(), usage};
+}
+
+TextureCache& TextureCache::global() {
+    static TextureCache cache;
+    return cache;
+}
+
+std::shared_ptr<const SharedBakedTexture> TextureCache::find(const TextureKey& key) {
+    std::unique_lock guard(_lock);
+
+    const auto it = _textures.find(key);
+    if (it == _textures.end()) {
+        return nullptr;
+    }
+
+    auto texture = it->second.lock();
+    if (!texture) {
+        _textures.erase(it);
+    }
+    return texture;
+}
+
+void TextureCache::add(const TextureKey& key, std::shared_ptr<const SharedBakedTexture> texture) {
+    std::unique_lock guard(_lock);
+    _textures[key] = std::move(texture);
+}
+
+}
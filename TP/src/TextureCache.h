@@ -0,0 +1,56 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <BakedScene.h>
+#include <TextureCompression.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace OM3D {
+
+// Identifies an image before it is decoded: its encoded bytes, and how it is sampled, which decides
+// its sRGB flag and its compression.
+// The byte count guards against hash collisions.
+struct TextureKey {
+    u64 hash = 0;
+    size_t byte_count = 0;
+    TextureUsage usage = TextureUsage::Color;
+
+    static TextureKey from_image(Span<const u8> encoded, TextureUsage usage);
+
+    bool operator==(const TextureKey& other) const {
+        return hash == other.hash && byte_count == other.byte_count && usage == other.usage;
+    }
+};
+
+// Shares the baked mip chains of identical images, even across files, so that an image is only
+// decoded and compressed once while a scene that uses it is alive. Images used by several
+// materials of a file end up in a single texture.
+// Mip chains are only kept alive by the baked scenes that use them.
+// Scenes are baked on worker threads, so the cache is guarded by a lock.
+class TextureCache : NonMovable {
+
+    struct KeyHasher {
+        size_t operator()(const TextureKey& key) const {
+            return size_t(key.hash);
+        }
+    };
+
+    public:
+        static TextureCache& global();
+
+        // Returns null if no living texture was baked from the same image
+        std::shared_ptr<const SharedBakedTexture> find(const TextureKey& key);
+        void add(const TextureKey& key, std::shared_ptr<const SharedBakedTexture> texture);
+
+    private:
+        std::mutex _lock;
+        std::unordered_map<TextureKey, std::weak_ptr<const SharedBakedTexture>, KeyHasher>
+            _textures;
+};
+
+}
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,118 @@
+#include "TextureCompression.h"
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// stb_dxt uses memcpy without including anything
+#define STB_DXT_IMPLEMENTATION
+#include <stb/stb_dxt.h>
+
+namespace OM3D {
+
+static bool has_transparency(const TextureData& data) {
+    if (bytes_per_pixel(data.format) != 4) {
+        return false;
+    }
+
+    const size_t texels = size_t(data.size.x) * data.size.y;
+    for (size_t i = 0; i != texels; ++i) {
+        if (data.data[i * 4 + 3] != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static ImageFormat compressed_format(const TextureData& data, TextureUsage usage) {
+    if (usage == TextureUsage::NormalMap) {
+        return ImageFormat::BC5_UNORM;
+    }
+
+    const bool srgb = is_sRGB(data.format);
+    if (has_transparency(data)) {
+        return srgb ? ImageFormat::BC3_sRGB : ImageFormat::BC3_UNORM;
+    }
+    return srgb ? ImageFormat::BC1_sRGB : ImageFormat::BC1_UNORM;
+}
+
+static u8 encode_snorm(float v) {
+    return u8(std::round(glm::clamp(v * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f));
+}
+
+// Texels of the 4x4 block at (block_x, block_y) as RGBA8, edge texels are repeated to fill the
+// blocks of levels smaller than a block or not a multiple of its size
+static void gather_block(const u8* level, const glm::uvec2& size, u32 channels, u32 block_x,
+                         u32 block_y, bool normal_map, u8 (&block)[16][4]) {
+    for (u32 y = 0; y != 4; ++y) {
+        const u32 row = std::min(block_y * 4 + y, size.y - 1);
+        for (u32 x = 0; x != 4; ++x) {
+            const u32 col = std::min(block_x * 4 + x, size.x - 1);
+            const u8* texel = level + (size_t(row) * size.x + col) * channels;
+            u8* out = block[y * 4 + x];
+            for (u32 c = 0; c != 4; ++c) {
+                out[c] = c < channels ? texel[c] : 255;
+            }
+
+            if (normal_map) {
+                const glm::vec3 n = glm::vec3(out[0], out[1], out[2]) / 127.5f - 1.0f;
+                const float length = glm::length(n);
+                if (length > 0.0f) {
+                    out[0] = encode_snorm(n.x / length);
+                    out[1] = encode_snorm(n.y / length);
+                    out[2] = encode_snorm(n.z / length);
+                }
+            }
+        }
+    }
+}
+
+CompressedTexture compress_texture(const TextureData& data, TextureUsage usage) {
+    const bool normal_map = usage == TextureUsage::NormalMap;
+    const u32 channels = bytes_per_pixel(data.format);
+    const std::vector<u8> mip_chain = build_mip_chain(data);
+
+    CompressedTexture compressed;
+    compressed.format = compressed_format(data, usage);
+    compressed.mip_chain.resize(mip_chain_size(data.size, compressed.format));
+
+    const bool alpha = compressed.format == ImageFormat::BC3_UNORM ||
+                       compressed.format == ImageFormat::BC3_sRGB;
+
+    const u8* src = mip_chain.data();
+    u8* dst = compressed.mip_chain.data();
+    for (u32 level = 0; level != Texture::mip_levels(data.size); ++level) {
+        const glm::uvec2 size = Texture::mip_size(data.size, level);
+        const glm::uvec2 blocks = (size + 3u) / 4u;
+
+        for (u32 block_y = 0; block_y != blocks.y; ++block_y) {
+            for (u32 block_x = 0; block_x != blocks.x; ++block_x) {
+                u8 block[16][4] = {};
+                gather_block(src, size, channels, block_x, block_y, normal_map, block);
+
+                if (normal_map) {
+                    u8 rg[16][2] = {};
+                    for (u32 i = 0; i != 16; ++i) {
+                        rg[i][0] = block[i][0];
+                        rg[i][1] = block[i][1];
+                    }
+                    stb_compress_bc5_block(dst, rg[0]);
+                    dst += 16;
+                } else {
+                    stb_compress_dxt_block(dst, block[0], alpha, STB_DXT_HIGHQUAL);
+                    dst += alpha ? 16 : 8;
+                }
+            }
+        }
+
+        src += image_byte_size(data.format, size.x, size.y);
+    }
+
+    DEBUG_ASSERT(dst == compressed.mip_chain.data() + compressed.mip_chain.size());
+    return compressed;
+}
+
+}
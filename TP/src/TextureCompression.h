@@ -0,0 +1,30 @@
+#ifndef TEXTURECOMPRESSION_H
+#define TEXTURECOMPRESSION_H
+
+#include <Texture.h>
+
+#include <vector>
+
+namespace OM3D {
+
+// How a texture is sampled, which decides how it is filtered and compressed
+enum class TextureUsage {
+    Color,
+    NormalMap,
+};
+
+struct CompressedTexture {
+    ImageFormat format = ImageFormat::BC1_UNORM;
+    // Every level, see mip_chain_size
+    std::vector<u8> mip_chain;
+};
+
+// Build the mip chain of an 8 bit texture and block compress every level:
+//  - colors to BC1, or BC3 if some texels are not opaque, keeping their sRGB flag
+//  - normal maps to BC5, with x and y in red and green: shaders rebuild z.
+//    Filtered normals are renormalized before compression.
+CompressedTexture compress_texture(const TextureData& data, TextureUsage usage);
+
+}
+
+#endif // TEXTURECOMPRESSION_H
@@ -0,0 +1,237 @@
+#include "TextureFile.h"
+
+#include <Texture.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace OM3D {
+
+static constexpr u8 ktx2_identifier[12] = {0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                           '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+static constexpr u8 dds_magic[4] = {'D', 'D', 'S', ' '};
+
+static constexpr u32 four_cc(const char (&code)[5]) {
+    return u32(u8(code[0])) | u32(u8(code[1])) << 8 | u32(u8(code[2])) << 16 |
+           u32(u8(code[3])) << 24;
+}
+
+template<typename T>
+static T read_le(Span<const u8> bytes, size_t offset) {
+    DEBUG_ASSERT(offset + sizeof(T) <= bytes.size());
+    T value = 0;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+static bool starts_with(Span<const u8> bytes, Span<const u8> prefix) {
+    return bytes.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), bytes.begin());
+}
+
+static Result<ImageFormat> vk_format_to_image_format(u32 vk_format) {
+    switch (vk_format) {
+        case 23:  return {true, ImageFormat::RGB8_UNORM};  // VK_FORMAT_R8G8B8_UNORM
+        case 29:  return {true, ImageFormat::RGB8_sRGB};   // VK_FORMAT_R8G8B8_SRGB
+        case 37:  return {true, ImageFormat::RGBA8_UNORM}; // VK_FORMAT_R8G8B8A8_UNORM
+        case 43:  return {true, ImageFormat::RGBA8_sRGB};  // VK_FORMAT_R8G8B8A8_SRGB
+        case 131: return {true, ImageFormat::BC1_UNORM};   // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case 132: return {true, ImageFormat::BC1_sRGB};    // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+        case 137: return {true, ImageFormat::BC3_UNORM};   // VK_FORMAT_BC3_UNORM_BLOCK
+        case 138: return {true, ImageFormat::BC3_sRGB};    // VK_FORMAT_BC3_SRGB_BLOCK
+        case 141: return {true, ImageFormat::BC5_UNORM};   // VK_FORMAT_BC5_UNORM_BLOCK
+        default:  return {false, {}};
+    }
+}
+
+static Result<ImageFormat> dxgi_format_to_image_format(u32 dxgi_format) {
+    switch (dxgi_format) {
+        case 28: return {true, ImageFormat::RGBA8_UNORM}; // DXGI_FORMAT_R8G8B8A8_UNORM
+        case 29: return {true, ImageFormat::RGBA8_sRGB};  // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+        case 71: return {true, ImageFormat::BC1_UNORM};   // DXGI_FORMAT_BC1_UNORM
+        case 72: return {true, ImageFormat::BC1_sRGB};    // DXGI_FORMAT_BC1_UNORM_SRGB
+        case 77: return {true, ImageFormat::BC3_UNORM};   // DXGI_FORMAT_BC3_UNORM
+        case 78: return {true, ImageFormat::BC3_sRGB};    // DXGI_FORMAT_BC3_UNORM_SRGB
+        case 83: return {true, ImageFormat::BC5_UNORM};   // DXGI_FORMAT_BC5_UNORM
+        default: return {false, {}};
+    }
+}
+
+static ImageFormat with_sRGB(ImageFormat format) {
+    switch (format) {
+        case ImageFormat::RGBA8_UNORM: return ImageFormat::RGBA8_sRGB;
+        case ImageFormat::BC1_UNORM:   return ImageFormat::BC1_sRGB;
+        case ImageFormat::BC3_UNORM:   return ImageFormat::BC3_sRGB;
+        default:                       return format;
+    }
+}
+
+static bool is_valid_size(const glm::uvec2& size, u32 levels) {
+    return size.x && size.y && levels && levels <= Texture::mip_levels(size);
+}
+
+// Checks that a level lies in the file and has the size its format implies
+static bool add_level(TextureFile& texture, Span<const u8> bytes, u64 offset, u64 byte_size) {
+    const glm::uvec2 size = Texture::mip_size(texture.size, u32(texture.levels.size()));
+    if (offset > bytes.size() || byte_size > bytes.size() - offset ||
+        byte_size != image_byte_size(texture.format, size.x, size.y)) {
+        return false;
+    }
+    texture.levels.emplace_back(bytes.data() + offset, size_t(byte_size));
+    return true;
+}
+
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+static Result<TextureFile> parse_ktx2(Span<const u8> bytes) {
+    static constexpr size_t header_size = 80;
+    static constexpr size_t level_index_entry_size = 24;
+
+    if (bytes.size() < header_size) {
+        return {false, {}};
+    }
+
+    const u32 vk_format = read_le<u32>(bytes, 12);
+    const u32 width = read_le<u32>(bytes, 20);
+    const u32 height = read_le<u32>(bytes, 24);
+    const u32 depth = read_le<u32>(bytes, 28);
+    const u32 layer_count = read_le<u32>(bytes, 32);
+    const u32 face_count = read_le<u32>(bytes, 36);
+    // 0 asks the loader to generate the mips, which is not possible for compressed formats
+    const u32 level_count = std::max(read_le<u32>(bytes, 40), 1u);
+    const u32 supercompression = read_le<u32>(bytes, 44);
+
+    const auto format = vk_format_to_image_format(vk_format);
+    if (!format.is_ok || supercompression) {
+        std::cerr << "Unsupported KTX2 format (" << vk_format << ", supercompression "
+                  << supercompression << ")" << std::endl;
+        return {false, {}};
+    }
+
+    TextureFile texture;
+    texture.size = glm::uvec2(width, height);
+    texture.format = format.value;
+    if (depth > 1 || layer_count > 1 || face_count != 1 ||
+        !is_valid_size(texture.size, level_count) ||
+        bytes.size() < header_size + level_count * level_index_entry_size) {
+        return {false, {}};
+    }
+
+    // The level index starts with the finest level, even though data is stored coarsest first
+    for (u32 level = 0; level != level_count; ++level) {
+        const size_t entry = header_size + level * level_index_entry_size;
+        const u64 offset = read_le<u64>(bytes, entry);
+        const u64 byte_size = read_le<u64>(bytes, entry + 8);
+        if (!add_level(texture, bytes, offset, byte_size)) {
+            return {false, {}};
+        }
+    }
+
+    return {true, std::move(texture)};
+}
+
+// https://learn.microsoft.com/windows/win32/direct3ddds/dx-graphics-dds-pguide
+static Result<TextureFile> parse_dds(Span<const u8> bytes, bool as_sRGB) {
+    static constexpr size_t header_size = 4 + 124;
+    static constexpr size_t dx10_header_size = 20;
+
+    static constexpr u32 flag_mip_map_count = 0x20000;
+    static constexpr u32 pixel_flag_alpha = 0x1;
+    static constexpr u32 pixel_flag_four_cc = 0x4;
+    static constexpr u32 pixel_flag_rgb = 0x40;
+    static constexpr u32 caps2_cube_map = 0x200;
+    static constexpr u32 caps2_volume = 0x200000;
+    static constexpr u32 dimension_texture_2d = 3;
+
+    if (bytes.size() < header_size || read_le<u32>(bytes, 4) != 124) {
+        return {false, {}};
+    }
+
+    const u32 flags = read_le<u32>(bytes, 8);
+    const u32 height = read_le<u32>(bytes, 12);
+    const u32 width = read_le<u32>(bytes, 16);
+    const u32 level_count = flags & flag_mip_map_count ? std::max(read_le<u32>(bytes, 28), 1u) : 1u;
+    const u32 pixel_flags = read_le<u32>(bytes, 80);
+    const u32 pixel_four_cc = read_le<u32>(bytes, 84);
+    const u32 caps2 = read_le<u32>(bytes, 112);
+
+    if (caps2 & (caps2_cube_map | caps2_volume)) {
+        std::cerr << "Unsupported DDS texture (cube map or volume)" << std::endl;
+        return {false, {}};
+    }
+
+    size_t data_offset = header_size;
+    Result<ImageFormat> format = {false, {}};
+    if (pixel_flags & pixel_flag_four_cc) {
+        switch (pixel_four_cc) {
+            case four_cc("DXT1"): format = {true, ImageFormat::BC1_UNORM}; break;
+            case four_cc("DXT5"): format = {true, ImageFormat::BC3_UNORM}; break;
+            case four_cc("ATI2"):
+            case four_cc("BC5U"): format = {true, ImageFormat::BC5_UNORM}; break;
+
+            case four_cc("DX10"): {
+                if (bytes.size() < header_size + dx10_header_size) {
+                    return {false, {}};
+                }
+                const u32 dimension = read_le<u32>(bytes, header_size + 4);
+                const u32 misc_flags = read_le<u32>(bytes, header_size + 8);
+                const u32 array_size = read_le<u32>(bytes, header_size + 12);
+                if (dimension != dimension_texture_2d || misc_flags || array_size > 1) {
+                    std::cerr << "Unsupported DDS texture (not a single 2D texture)" << std::endl;
+                    return {false, {}};
+                }
+                format = dxgi_format_to_image_format(read_le<u32>(bytes, header_size));
+                // DXGI formats say their color space, as_sRGB does not apply
+                as_sRGB = false;
+                data_offset += dx10_header_size;
+            } break;
+
+            default:
+                break;
+        }
+    } else if ((pixel_flags & pixel_flag_rgb) && (pixel_flags & pixel_flag_alpha) &&
+               read_le<u32>(bytes, 88) == 32 && read_le<u32>(bytes, 92) == 0x000000FF &&
+               read_le<u32>(bytes, 96) == 0x0000FF00 && read_le<u32>(bytes, 100) == 0x00FF0000) {
+        format = {true, ImageFormat::RGBA8_UNORM};
+    }
+
+    if (!format.is_ok) {
+        std::cerr << "Unsupported DDS format" << std::endl;
+        return {false, {}};
+    }
+
+    TextureFile texture;
+    texture.size = glm::uvec2(width, height);
+    texture.format = as_sRGB ? with_sRGB(format.value) : format.value;
+    if (!is_valid_size(texture.size, level_count)) {
+        return {false, {}};
+    }
+
+    // Levels are stored one after the other, finest first
+    size_t offset = data_offset;
+    for (u32 level = 0; level != level_count; ++level) {
+        const glm::uvec2 size = Texture::mip_size(texture.size, level);
+        const size_t level_bytes = image_byte_size(texture.format, size.x, size.y);
+        if (!add_level(texture, bytes, offset, level_bytes)) {
+            return {false, {}};
+        }
+        offset += level_bytes;
+    }
+
+    return {true, std::move(texture)};
+}
+
+bool is_texture_file(Span<const u8> bytes) {
+    return starts_with(bytes, ktx2_identifier) || starts_with(bytes, dds_magic);
+}
+
+Result<TextureFile> parse_texture_file(Span<const u8> bytes, bool as_sRGB) {
+    if (starts_with(bytes, ktx2_identifier)) {
+        return parse_ktx2(bytes);
+    }
+    if (starts_with(bytes, dds_magic)) {
+        return parse_dds(bytes, as_sRGB);
+    }
+    return {false, {}};
+}
+
+}
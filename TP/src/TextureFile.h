@@ -0,0 +1,32 @@
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+#include <ImageFormat.h>
+#include <utils.h>
+
+#include <glm/vec2.hpp>
+
+#include <string>
+#include <vector>
+
+namespace OM3D {
+
+// Texture read from a KTX2 or DDS container, uploaded as stored without decoding.
+// Only 2D textures in one of the formats of ImageFormat are supported, without supercompression.
+struct TextureFile {
+    glm::uvec2 size = {};
+    ImageFormat format = ImageFormat::RGBA8_UNORM;
+    // Finest first, point into the parsed bytes
+    std::vector<Span<const u8>> levels;
+};
+
+// Returns true if bytes start like a KTX2 or DDS file
+bool is_texture_file(Span<const u8> bytes);
+
+// Levels of the result point into bytes, which have to outlive it.
+// Legacy DDS formats do not tell their color space: they are read as sRGB if as_sRGB is set.
+Result<TextureFile> parse_texture_file(Span<const u8> bytes, bool as_sRGB = false);
+
+}
+
+#endif // TEXTUREFILE_H
@@ -0,0 +1,291 @@
+#include "TextureStreamer.h"
+
+#include <Material.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace OM3D {
+
+static constexpr size_t request_queue_size = 64;
+static constexpr size_t page_size = 4096;
+static constexpr u32 no_index = u32(-1);
+
+static Span<const u8> level_data(const BakedTexture& texture, u32 level) {
+    const glm::uvec2 size = Texture::mip_size(texture.size, level);
+    const size_t offset = mip_chain_size(texture.size, texture.format, level);
+    return Span<const u8>(texture.mip_chain.data() + offset,
+                          image_byte_size(texture.format, size.x, size.y));
+}
+
+TextureStreamer::TextureStreamer(size_t budget, size_t upload_budget) :
+    _budget(budget),
+    _upload_budget(upload_budget),
+    _staging(upload_budget * 4),
+    _requests(request_queue_size),
+    _ready(request_queue_size) {
+    _thread = std::thread([this] { run(); });
+}
+
+TextureStreamer::~TextureStreamer() {
+    _stop = true;
+    _thread.join();
+}
+
+u32 TextureStreamer::tail_level(const BakedTexture& texture) {
+    u32 level = 0;
+    while (level + 1 < texture.levels) {
+        const glm::uvec2 size = Texture::mip_size(texture.size, level);
+        if (std::max(size.x, size.y) <= tail_size) {
+            break;
+        }
+        ++level;
+    }
+    return level;
+}
+
+u32 TextureStreamer::add_textures(std::shared_ptr<const BakedScene> scene,
+                                  Span<const BakedTextureArray> arrays,
+                                  Span<const std::shared_ptr<Texture>> textures) {
+    DEBUG_ASSERT(textures.size() == arrays.size());
+
+    const u32 first = u32(_textures.size());
+    for (size_t i = 0; i != textures.size(); ++i) {
+        StreamedTexture& texture = _textures.emplace_back();
+        texture.texture = textures[i];
+        for (const u32 layer : arrays[i].textures) {
+            texture.layers.push_back(scene->textures[layer]);
+        }
+        DEBUG_ASSERT(texture.texture->layers() == texture.layers.size());
+        texture.tail = tail_level(texture.layers.front());
+        texture.resident = texture.tail;
+        texture.wanted = texture.tail;
+        _resident_size += levels_size(texture, texture.tail);
+    }
+
+    _sources.push_back(std::move(scene));
+    return first;
+}
+
+void TextureStreamer::add_material(std::shared_ptr<const Material> material,
+                                   Span<const u32> arrays) {
+    const u32 index = u32(_materials.size());
+    const auto it = _material_indices.emplace(material.get(), index).first;
+    if (it->second == index) {
+        _materials.push_back(std::move(material));
+        _material_textures.emplace_back();
+        _material_pixels.push_back(0.0f);
+    }
+    _material_textures[it->second].assign(arrays.begin(), arrays.end());
+    _last_material = nullptr;
+}
+
+void TextureStreamer::request(const Material* material, float pixels_per_uv) {
+    // Consecutive objects often share their material
+    if (material != _last_material) {
+        const auto it = _material_indices.find(material);
+        _last_material = material;
+        _last_material_index = it == _material_indices.end() ? no_index : it->second;
+    }
+
+    if (_last_material_index != no_index) {
+        float& pixels = _material_pixels[_last_material_index];
+        pixels = std::max(pixels, pixels_per_uv);
+    }
+}
+
+void TextureStreamer::update() {
+    DEFER(_staging.end_frame());
+    ++_frame;
+
+    // Levels read by the worker. Those of arrays that lost levels in the meantime are dropped.
+    size_t uploaded = 0;
+    while (Request* ready = _ready.front()) {
+        const size_t size = ready->size;
+        if (uploaded && uploaded + size > _upload_budget) {
+            break;
+        }
+
+        StreamedTexture& texture = _textures[ready->texture];
+        texture.pending = false;
+        _pending_size -= size;
+        if (ready->level + 1 == texture.resident) {
+            set_resident_level(texture, ready->level);
+            uploaded += size;
+        }
+        _ready.pop();
+    }
+
+    // Finest level needed by each array this frame
+    for (StreamedTexture& texture : _textures) {
+        texture.wanted = texture.tail;
+    }
+    for (size_t i = 0; i != _material_textures.size(); ++i) {
+        const float pixels_per_uv = _material_pixels[i];
+        if (pixels_per_uv <= 0.0f) {
+            continue;
+        }
+        for (const u32 index : _material_textures[i]) {
+            StreamedTexture& texture = _textures[index];
+            texture.wanted = std::min(texture.wanted, wanted_level(texture, pixels_per_uv));
+        }
+        _material_pixels[i] = 0.0f;
+    }
+    for (StreamedTexture& texture : _textures) {
+        if (texture.wanted <= texture.resident) {
+            texture.last_used = _frame;
+        }
+    }
+
+    // The budget can be lowered below what is resident
+    while (_resident_size > _budget && evict_one(no_index, true)) {
+    }
+
+    // Blurriest arrays first, one level at a time
+    std::vector<u32> missing;
+    for (u32 i = 0; i != _textures.size(); ++i) {
+        if (_textures[i].wanted < _textures[i].resident && !_textures[i].pending) {
+            missing.push_back(i);
+        }
+    }
+    std::stable_sort(missing.begin(), missing.end(), [&](u32 lhs, u32 rhs) {
+        const StreamedTexture& l = _textures[lhs];
+        const StreamedTexture& r = _textures[rhs];
+        return l.resident - l.wanted > r.resident - r.wanted;
+    });
+
+    for (const u32 index : missing) {
+        StreamedTexture& texture = _textures[index];
+        Request request;
+        request.texture = index;
+        request.level = texture.resident - 1;
+        for (const BakedTexture& layer : texture.layers) {
+            request.data.push_back(level_data(layer, request.level));
+            request.size += request.data.back().size();
+        }
+
+        // Only levels that are not needed anymore make room
+        const size_t size = request.size;
+        while (_resident_size + _pending_size + size > _budget && evict_one(index, false)) {
+        }
+        if (_resident_size + _pending_size + size > _budget) {
+            break;
+        }
+
+        if (!_requests.try_push(std::move(request))) {
+            break;
+        }
+        texture.pending = true;
+        _pending_size += size;
+    }
+}
+
+void TextureStreamer::set_budget(size_t bytes) {
+    _budget = bytes;
+}
+
+size_t TextureStreamer::budget() const {
+    return _budget;
+}
+
+size_t TextureStreamer::resident_size() const {
+    return _resident_size;
+}
+
+void TextureStreamer::run() {
+    while (!_stop) {
+        Request* request = _requests.front();
+        if (!request) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // Read a byte per page, so that mapped levels are in memory before the GL thread copies
+        // them to the staging buffer
+        volatile u8 sink = 0;
+        for (const Span<const u8> data : request->data) {
+            for (size_t i = 0; i < data.size(); i += page_size) {
+                sink = u8(sink ^ data[i]);
+            }
+        }
+
+        Request ready = std::move(*request);
+        _requests.pop();
+        while (!_ready.try_push(std::move(ready))) {
+            if (_stop) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+// Level whose texels are closest to the size of a pixel, without being larger
+u32 TextureStreamer::wanted_level(const StreamedTexture& texture, float pixels_per_uv) const {
+    const glm::uvec2 size = texture.layers.front().size;
+    const float texels = float(std::max(size.x, size.y));
+    if (texels <= pixels_per_uv) {
+        return 0;
+    }
+    const float level = std::floor(std::log2(texels / pixels_per_uv));
+    return u32(std::min(level, float(texture.tail)));
+}
+
+size_t TextureStreamer::levels_size(const StreamedTexture& texture, u32 first_level) const {
+    const BakedTexture& source = texture.layers.front();
+    const size_t layer_size = mip_chain_size(source.size, source.format, source.levels) -
+                              mip_chain_size(source.size, source.format, first_level);
+    return layer_size * texture.layers.size();
+}
+
+void TextureStreamer::set_resident_level(StreamedTexture& texture, u32 first_level) {
+    const BakedTexture& source = texture.layers.front();
+    const Texture& previous = *texture.texture;
+
+    Texture resized = Texture::array(Texture::mip_size(source.size, first_level), source.format,
+                                     source.levels - first_level, u32(texture.layers.size()));
+    for (u32 level = first_level; level != source.levels; ++level) {
+        if (level < texture.resident) {
+            for (u32 layer = 0; layer != texture.layers.size(); ++layer) {
+                resized.upload_level(level - first_level, layer,
+                                     level_data(texture.layers[layer], level), &_staging);
+            }
+        } else {
+            resized.copy_level(level - first_level, previous, level - texture.resident);
+        }
+    }
+
+    _resident_size -= levels_size(texture, texture.resident);
+    _resident_size += levels_size(texture, first_level);
+    texture.resident = first_level;
+
+    // Swaps the GL textures, the previous one is deleted with resized
+    *texture.texture = std::move(resized);
+}
+
+bool TextureStreamer::evict_one(u32 except, bool needed_too) {
+    u32 oldest = no_index;
+    for (u32 i = 0; i != _textures.size(); ++i) {
+        const StreamedTexture& texture = _textures[i];
+        if (i == except || texture.pending || texture.resident >= texture.tail) {
+            continue;
+        }
+        if (!needed_too && texture.resident >= texture.wanted) {
+            continue;
+        }
+        if (oldest == no_index || texture.last_used < _textures[oldest].last_used) {
+            oldest = i;
+        }
+    }
+
+    if (oldest == no_index) {
+        return false;
+    }
+
+    StreamedTexture& texture = _textures[oldest];
+    set_resident_level(texture, texture.resident + 1);
+    return true;
+}
+
+}
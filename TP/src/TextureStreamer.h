@@ -0,0 +1,124 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <BakedScene.h>
+#include <SpscQueue.h>
+#include <StagingBuffer.h>
+#include <Texture.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace OM3D {
+
+class Material;
+
+// Keeps the texture arrays of a scene within a GPU memory budget (see pack_texture_arrays).
+// Arrays are created with the coarse tail of their mip chains only. Every frame, the scene
+// reports how large the objects using each material are on screen, which gives the finest mip each
+// array needs: all its layers share their levels, so an array is streamed as a whole.
+// Missing levels are paged in from their baked source by a worker thread, then uploaded one level
+// at a time on the GL thread. To make room, levels finer than needed are evicted, least recently
+// needed first.
+// Changing the levels of an array replaces its GL texture, materials keep pointing to it.
+class TextureStreamer : NonMovable {
+
+    public:
+        // Levels up to this size are created with the texture and never evicted
+        static constexpr u32 tail_size = 64;
+
+        TextureStreamer(size_t budget = 256 << 20, size_t upload_budget = 4 << 20);
+        ~TextureStreamer();
+
+        // First level of the tail of a texture
+        static u32 tail_level(const BakedTexture& texture);
+
+        // Stream the texture arrays of a baked scene, created with their tail only (see
+        // tail_level). The scene is kept alive as the source of the levels. Returns the index of
+        // the first array, the others follow in order.
+        u32 add_textures(std::shared_ptr<const BakedScene> scene,
+                         Span<const BakedTextureArray> arrays,
+                         Span<const std::shared_ptr<Texture>> textures);
+        // Indices of the streamed arrays sampled by a material
+        void add_material(std::shared_ptr<const Material> material, Span<const u32> arrays);
+
+        // An object using material is visible, and covers pixels_per_uv pixels per unit of
+        // texture space on screen
+        void request(const Material* material, float pixels_per_uv);
+
+        // To be called once per frame on the GL thread, after the requests of the frame.
+        // Uploads the levels ready since the last call and schedules the next ones.
+        void update();
+
+        void set_budget(size_t bytes);
+        size_t budget() const;
+        // Bytes of every resident level, tails included
+        size_t resident_size() const;
+
+    private:
+        struct StreamedTexture {
+            std::shared_ptr<Texture> texture;
+            // Source of every layer, they all have the same size, format and levels
+            std::vector<BakedTexture> layers;
+            u32 tail = 0;
+            // First resident level, and finest level needed this frame
+            u32 resident = 0;
+            u32 wanted = 0;
+            // Last frame the finest resident level was needed
+            u64 last_used = 0;
+            bool pending = false;
+        };
+
+        struct Request {
+            u32 texture = 0;
+            u32 level = 0;
+            // Level of every layer
+            std::vector<Span<const u8>> data;
+            size_t size = 0;
+        };
+
+        void run();
+
+        u32 wanted_level(const StreamedTexture& texture, float pixels_per_uv) const;
+        size_t levels_size(const StreamedTexture& texture, u32 first_level) const;
+        // Replace the GL texture by one starting at first_level, keeping the levels both share.
+        // A new finest level is uploaded from the source.
+        void set_resident_level(StreamedTexture& texture, u32 first_level);
+        // Drop the finest level of the least recently needed array that has more than it needs,
+        // or of any array above its tail if needed_too is set. Returns false if there is none.
+        bool evict_one(u32 except, bool needed_too);
+
+        size_t _budget = 0;
+        size_t _upload_budget = 0;
+        size_t _resident_size = 0;
+        // Bytes of the levels requested but not uploaded yet
+        size_t _pending_size = 0;
+        u64 _frame = 0;
+
+        std::vector<std::shared_ptr<const BakedScene>> _sources;
+        std::vector<StreamedTexture> _textures;
+
+        // Materials are kept alive, so that their address is not reused by another one
+        std::vector<std::shared_ptr<const Material>> _materials;
+        std::unordered_map<const Material*, u32> _material_indices;
+        std::vector<std::vector<u32>> _material_textures;
+        // Largest pixels_per_uv requested this frame, 0 if the material was not seen
+        std::vector<float> _material_pixels;
+        const Material* _last_material = nullptr;
+        u32 _last_material_index = 0;
+
+        StagingBuffer _staging;
+
+        // The worker reads the data of requested levels so that they are in memory for the upload
+        SpscQueue<Request> _requests;
+        SpscQueue<Request> _ready;
+        std::thread _thread;
+        std::atomic<bool> _stop = false;
+};
+
+}
+
+#endif // TEXTURESTREAMER_H
@@ -0,0 +1,112 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+
+namespace OM3D {
+
+ThreadPool::ThreadPool(u32 thread_count) {
+    for (u32 i = 0; i != thread_count; ++i) {
+        _threads.emplace_back([this] { worker(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock lock(_lock);
+        _stop = true;
+    }
+    _condition.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::worker() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(_lock);
+            _condition.wait(lock, [this] { return _stop || !_tasks.empty(); });
+            if (_tasks.empty()) {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+            ++_running;
+        }
+
+        task();
+
+        {
+            std::unique_lock lock(_lock);
+            if (!--_running && _tasks.empty()) {
+                _idle_condition.notify_all();
+            }
+        }
+    }
+}
+
+void ThreadPool::schedule(std::function<void()> task) {
+    {
+        std::unique_lock lock(_lock);
+        _tasks.emplace_back(std::move(task));
+    }
+    _condition.notify_one();
+}
+
+void ThreadPool::parallel_for(u32 count, const std::function<void(u32)>& func) {
+    if (count == 0) {
+        return;
+    }
+
+    // Shared with the helper tasks, which might only start after this call has returned
+    struct State {
+        std::atomic<u32> next = 0;
+        std::atomic<u32> done = 0;
+        u32 count = 0;
+        const std::function<void(u32)>* func = nullptr;
+        std::mutex lock;
+        std::condition_variable condition;
+    };
+
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->func = &func;
+
+    auto run = [](State& s) {
+        for (u32 i = s.next++; i < s.count; i = s.next++) {
+            (*s.func)(i);
+            if (++s.done == s.count) {
+                std::unique_lock lock(s.lock);
+                s.condition.notify_all();
+            }
+        }
+    };
+
+    const u32 helpers = std::min(count - 1, thread_count());
+    for (u32 i = 0; i != helpers; ++i) {
+        schedule([state, run] { run(*state); });
+    }
+
+    run(*state);
+
+    std::unique_lock lock(state->lock);
+    state->condition.wait(lock, [&] { return state->done == state->count; });
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock lock(_lock);
+    _idle_condition.wait(lock, [this] { return !_running && _tasks.empty(); });
+}
+
+u32 ThreadPool::thread_count() const {
+    return u32(_threads.size());
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <utils.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace OM3D {
+
+class ThreadPool : NonMovable {
+
+    public:
+        // hardware_concurrency() is 0 when unknown, leave one core to the main thread otherwise
+        ThreadPool(u32 thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1);
+        ~ThreadPool();
+
+        // Queue a task to be run on any worker thread
+        void schedule(std::function<void()> task);
+
+        // Run func(0) to func(count - 1) in parallel and wait for all of them.
+        // The calling thread takes part in the work.
+        void parallel_for(u32 count, const std::function<void(u32)>& func);
+
+        // Wait for every scheduled task to be finished
+        void wait_idle();
+
+        u32 thread_count() const;
+
+        static ThreadPool& global();
+
+    private:
+        void worker();
+
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _tasks;
+
+        std::mutex _lock;
+        std::condition_variable _condition;
+        std::condition_variable _idle_condition;
+        u32 _running = 0;
+        bool _stop = false;
+};
+
+}
+
+#endif // THREADPOOL_H
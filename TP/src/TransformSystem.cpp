@@ -0,0 +1,188 @@
+#include "TransformSystem.h"
+
+#include <Culling.h>
+
+#include <algorithm>
+#include <cfloat>
+
+namespace OM3D {
+
+u32 TransformSystem::add(const glm::mat4& local, u32 parent) {
+    // A free id can only be reused if it keeps the parent before the child
+    if (!_free.empty() && (parent == no_parent || _free.back() > parent)) {
+        const u32 id = _free.back();
+        _free.pop_back();
+
+        _local[id] = local;
+        _world[id] = local;
+        _parent[id] = parent;
+        _first_child[id] = no_parent;
+        _next_sibling[id] = no_parent;
+        if (parent != no_parent) {
+            _next_sibling[id] = _first_child[parent];
+            _first_child[parent] = id;
+        }
+        _local_bounds[id] = AABB();
+        _local_radius[id] = -FLT_MAX;
+        mark_dirty(id);
+        return id;
+    }
+
+    const u32 id = u32(_local.size());
+    DEBUG_ASSERT(parent == no_parent || parent < id);
+
+    _local.push_back(local);
+    _world.push_back(local);
+    _parent.push_back(parent);
+    _first_child.push_back(no_parent);
+    _next_sibling.push_back(no_parent);
+    if (parent != no_parent) {
+        _next_sibling[id] = _first_child[parent];
+        _first_child[parent] = id;
+    }
+
+    _local_bounds.emplace_back();
+    _local_radius.push_back(-FLT_MAX);
+    _world_bounds.emplace_back();
+    _world_spheres.emplace_back(0.0f, 0.0f, 0.0f, -FLT_MAX);
+
+    _dirty.push_back(0);
+    mark_dirty(id);
+    return id;
+}
+
+void TransformSystem::remove(u32 id) {
+    DEBUG_ASSERT(_first_child[id] == no_parent);
+
+    const u32 parent = _parent[id];
+    if (parent != no_parent) {
+        u32* link = &_first_child[parent];
+        while (*link != id) {
+            link = &_next_sibling[*link];
+        }
+        *link = _next_sibling[id];
+        _parent[id] = no_parent;
+    }
+
+    // Clear the world bounds on the next update
+    _local_bounds[id] = AABB();
+    _local_radius[id] = -FLT_MAX;
+    mark_dirty(id);
+    _free.push_back(id);
+}
+
+void TransformSystem::clear() {
+    _local.clear();
+    _world.clear();
+    _parent.clear();
+    _first_child.clear();
+    _next_sibling.clear();
+    _local_bounds.clear();
+    _local_radius.clear();
+    _world_bounds.clear();
+    _world_spheres.clear();
+    _free.clear();
+    _dirty.clear();
+    _dirty_ids.clear();
+}
+
+size_t TransformSystem::size() const {
+    return _local.size();
+}
+
+void TransformSystem::mark_dirty(u32 id) {
+    if (!_dirty[id]) {
+        _dirty[id] = 1;
+        _dirty_ids.push_back(id);
+    }
+}
+
+void TransformSystem::set_local(u32 id, const glm::mat4& local) {
+    _local[id] = local;
+    mark_dirty(id);
+}
+
+const glm::mat4& TransformSystem::local(u32 id) const {
+    return _local[id];
+}
+
+u32 TransformSystem::parent(u32 id) const {
+    return _parent[id];
+}
+
+void TransformSystem::set_local_bounds(u32 id, const AABB& bounds, float sphere_radius) {
+    _local_bounds[id] = bounds;
+    _local_radius[id] = bounds.is_empty() ? -FLT_MAX : sphere_radius;
+    mark_dirty(id);
+}
+
+void TransformSystem::update_world(u32 id) {
+    const u32 parent = _parent[id];
+    _world[id] = parent == no_parent ? _local[id] : _world[parent] * _local[id];
+
+    const glm::mat4& world = _world[id];
+    if (_local_bounds[id].is_empty()) {
+        _world_bounds[id] = AABB();
+        _world_spheres[id] = glm::vec4(0.0f, 0.0f, 0.0f, -FLT_MAX);
+    } else {
+        _world_bounds[id] = _local_bounds[id].transformed(world);
+        _world_spheres[id] = glm::vec4(glm::vec3(world[3]), _local_radius[id] * max_scale(world));
+    }
+}
+
+void TransformSystem::update(std::vector<u32>& changed) {
+    changed.clear();
+    if (_dirty_ids.empty()) {
+        return;
+    }
+
+    // Parents have smaller ids: walking dirty ids in increasing order updates a parent before
+    // any of its children, and a subtree is only walked once
+    std::sort(_dirty_ids.begin(), _dirty_ids.end());
+    for (const u32 root : _dirty_ids) {
+        if (!_dirty[root]) {
+            continue;
+        }
+
+        _stack.push_back(root);
+        while (!_stack.empty()) {
+            const u32 id = _stack.back();
+            _stack.pop_back();
+
+            _dirty[id] = 0;
+            update_world(id);
+            changed.push_back(id);
+
+            for (u32 child = _first_child[id]; child != no_parent; child = _next_sibling[child]) {
+                _stack.push_back(child);
+            }
+        }
+    }
+    _dirty_ids.clear();
+}
+
+bool TransformSystem::has_changes() const {
+    return !_dirty_ids.empty();
+}
+
+const glm::mat4& TransformSystem::world(u32 id) const {
+    return _world[id];
+}
+
+const AABB& TransformSystem::world_bounds(u32 id) const {
+    return _world_bounds[id];
+}
+
+const std::vector<AABB>& TransformSystem::world_bounds() const {
+    return _world_bounds;
+}
+
+glm::vec3 TransformSystem::sphere_center(u32 id) const {
+    return glm::vec3(_world_spheres[id]);
+}
+
+float TransformSystem::sphere_radius(u32 id) const {
+    return _world_spheres[id].w;
+}
+
+}
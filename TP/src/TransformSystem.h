@@ -0,0 +1,74 @@
+#ifndef TRANSFORMSYSTEM_H
+#define TRANSFORMSYSTEM_H
+
+#include <AABB.h>
+#include <utils.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// Local and world transforms stored as structure of arrays, with world space bounds cached next
+// to them. Only the transforms whose local matrix changed, and their children, are recomputed
+// by update(). A parent is always added before its children so that its id is smaller.
+class TransformSystem : NonCopyable {
+
+    public:
+        static constexpr u32 no_parent = u32(-1);
+
+        TransformSystem() = default;
+
+        u32 add(const glm::mat4& local, u32 parent = no_parent);
+        // Only transforms without children can be removed, their id is reused by add()
+        void remove(u32 id);
+        void clear();
+        size_t size() const;
+
+        void set_local(u32 id, const glm::mat4& local);
+        const glm::mat4& local(u32 id) const;
+        u32 parent(u32 id) const;
+
+        // Bounds in the local space of the transform, an empty box is never visible
+        void set_local_bounds(u32 id, const AABB& bounds, float sphere_radius);
+
+        // Fill changed with every transform whose world matrix was recomputed
+        void update(std::vector<u32>& changed);
+        // True if a transform was added, removed or changed since the last update()
+        bool has_changes() const;
+
+        // World space values are valid after update()
+        const glm::mat4& world(u32 id) const;
+        const AABB& world_bounds(u32 id) const;
+        const std::vector<AABB>& world_bounds() const;
+        glm::vec3 sphere_center(u32 id) const;
+        float sphere_radius(u32 id) const;
+
+    private:
+        void mark_dirty(u32 id);
+        void update_world(u32 id);
+
+        std::vector<glm::mat4> _local;
+        std::vector<glm::mat4> _world;
+
+        std::vector<u32> _parent;
+        std::vector<u32> _first_child;
+        std::vector<u32> _next_sibling;
+
+        std::vector<AABB> _local_bounds;
+        std::vector<float> _local_radius;
+        std::vector<AABB> _world_bounds;
+        std::vector<glm::vec4> _world_spheres;
+
+        std::vector<u32> _free;
+
+        std::vector<u8> _dirty;
+        std::vector<u32> _dirty_ids;
+        std::vector<u32> _stack;
+};
+
+}
+
+#endif // TRANSFORMSYSTEM_H
@@ -23,6 +23,10 @@ class TypedBuffer : public ByteBuffer {
             return byte_size() / sizeof(T);
         }
 
+        void write(const T* data, size_t count, size_t first = 0) {
+            ByteBuffer::write(data, count * sizeof(T), first * sizeof(T));
+        }
+
         BufferMapping<T> map(AccessType access = AccessType::ReadWrite) {
             return BufferMapping<T>(ByteBuffer::map_internal(access), byte_size(), handle());
         }
@@ -16,10 +16,6 @@ struct Vertex {
     glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f); // to avoid completly black meshes if no color is present
 };
 
-struct Instance {
-    glm::mat4 model = glm::mat4(1.0);
-};
-
 struct LightInstance {
     glm::mat4 model = glm::mat4(1.0);
     glm::vec3 pos;
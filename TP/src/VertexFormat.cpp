@@ -0,0 +1,219 @@
+#include "VertexFormat.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+
+namespace OM3D {
+
+static u32 attribute_type_to_gl(AttributeType type) {
+    switch (type) {
+        case AttributeType::Float:
+            return GL_FLOAT;
+        case AttributeType::HalfFloat:
+            return GL_HALF_FLOAT;
+        case AttributeType::UNorm8:
+            return GL_UNSIGNED_BYTE;
+        case AttributeType::UNorm16:
+            return GL_UNSIGNED_SHORT;
+        case AttributeType::SNorm16:
+            return GL_SHORT;
+    }
+    FATAL("Unknown attribute type");
+}
+
+static u32 attribute_type_size(AttributeType type) {
+    switch (type) {
+        case AttributeType::Float:
+            return 4;
+        case AttributeType::HalfFloat:
+        case AttributeType::UNorm16:
+        case AttributeType::SNorm16:
+            return 2;
+        case AttributeType::UNorm8:
+            return 1;
+    }
+    FATAL("Unknown attribute type");
+}
+
+static bool is_normalized(AttributeType type) {
+    return type == AttributeType::UNorm8 || type == AttributeType::UNorm16 ||
+           type == AttributeType::SNorm16;
+}
+
+VertexFormat VertexFormat::standard() {
+    VertexFormat format;
+    format.add(0, 0, 3, AttributeType::Float);
+    format.add(1, 0, 3, AttributeType::Float);
+    format.add(2, 0, 2, AttributeType::Float);
+    format.add(3, 0, 4, AttributeType::Float);
+    format.add(4, 0, 3, AttributeType::Float);
+    DEBUG_ASSERT(format.stride(0) == sizeof(Vertex));
+    return format;
+}
+
+VertexFormat VertexFormat::compact(bool has_colors) {
+    VertexFormat format;
+    format._compact = true;
+    format.add(0, 0, 4, AttributeType::UNorm16);
+    format.add(1, 0, 2, AttributeType::SNorm16);
+    format.add(3, 0, 2, AttributeType::SNorm16);
+    format.add(2, 0, 2, AttributeType::HalfFloat);
+    if (has_colors) {
+        format.add(color_location, 1, 4, AttributeType::UNorm8);
+    }
+    DEBUG_ASSERT(format.stride(0) == sizeof(CompactVertex));
+    return format;
+}
+
+VertexFormat VertexFormat::positions_only() const {
+    VertexFormat format;
+    format._compact = _compact;
+    for (const VertexAttribute& attrib : _attributes) {
+        if (attrib.location == 0) {
+            format.add(0, 0, attrib.components, attrib.type);
+        }
+    }
+    return format;
+}
+
+void VertexFormat::add(u32 location, u32 stream, u32 components, AttributeType type) {
+    DEBUG_ASSERT(stream < max_streams);
+    _attributes.push_back({location, stream, components, type, _strides[stream]});
+    _strides[stream] += components * attribute_type_size(type);
+    _stream_count = std::max(_stream_count, stream + 1);
+}
+
+bool VertexFormat::has_attribute(u32 location) const {
+    for (const VertexAttribute& attrib : _attributes) {
+        if (attrib.location == location) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VertexFormat::operator==(const VertexFormat& other) const {
+    return _compact == other._compact && _attributes == other._attributes;
+}
+
+bool VertexFormat::is_compact() const {
+    return _compact;
+}
+
+u32 VertexFormat::stream_count() const {
+    return _stream_count;
+}
+
+u32 VertexFormat::stride(u32 stream) const {
+    DEBUG_ASSERT(stream < max_streams);
+    return _strides[stream];
+}
+
+u32 VertexFormat::vertex_size() const {
+    u32 size = 0;
+    for (u32 stream = 0; stream != _stream_count; ++stream) {
+        size += _strides[stream];
+    }
+    return size;
+}
+
+void VertexFormat::bind_stream(u32 stream) const {
+    for (const VertexAttribute& attrib : _attributes) {
+        if (attrib.stream != stream) {
+            continue;
+        }
+        const void* offset = reinterpret_cast<void*>(size_t(attrib.offset));
+        glVertexAttribPointer(attrib.location, int(attrib.components),
+                              attribute_type_to_gl(attrib.type), is_normalized(attrib.type),
+                              int(_strides[stream]), offset);
+        glEnableVertexAttribArray(attrib.location);
+    }
+}
+
+void VertexFormat::bind_defaults() const {
+    for (u32 location = 0; location != attribute_count; ++location) {
+        if (!has_attribute(location)) {
+            glDisableVertexAttribArray(location);
+        }
+    }
+    if (!has_attribute(color_location)) {
+        glVertexAttrib4f(color_location, 1.0f, 1.0f, 1.0f, 1.0f);
+    }
+}
+
+PositionQuantization PositionQuantization::from_bounds(const AABB& bounds) {
+    PositionQuantization quantization;
+    if (!bounds.is_empty()) {
+        quantization.offset = bounds.min;
+        quantization.scale = bounds.max - bounds.min;
+    }
+    return quantization;
+}
+
+static glm::vec2 sign_not_zero(const glm::vec2& v) {
+    return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+// "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle et al.)
+glm::vec2 octahedral_encode(const glm::vec3& n) {
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    const glm::vec2 p = glm::vec2(n) / l1;
+    if (n.z >= 0.0f) {
+        return p;
+    }
+    return (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign_not_zero(p);
+}
+
+glm::vec3 octahedral_decode(const glm::vec2& e) {
+    glm::vec3 v(e, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if (v.z < 0.0f) {
+        const glm::vec2 folded = (1.0f - glm::abs(glm::vec2(v.y, v.x))) * sign_not_zero(e);
+        v.x = folded.x;
+        v.y = folded.y;
+    }
+    return glm::normalize(v);
+}
+
+static u16 quantize_unorm16(float v) {
+    return u16(std::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f));
+}
+
+static i16 quantize_snorm16(float v) {
+    return i16(std::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+CompactVertex compact_vertex(const Vertex& vertex, const PositionQuantization& quantization) {
+    CompactVertex compact = {};
+    for (int i = 0; i != 3; ++i) {
+        const float scale = quantization.scale[i];
+        const float p = scale > 0.0f ? (vertex.position[i] - quantization.offset[i]) / scale : 0.0f;
+        compact.position[i] = quantize_unorm16(p);
+    }
+    compact.position[3] = vertex.tangent_bitangent_sign.w > 0.0f ? 65535 : 0;
+
+    const glm::vec2 normal = octahedral_encode(vertex.normal);
+    const glm::vec2 tangent = octahedral_encode(glm::vec3(vertex.tangent_bitangent_sign));
+    for (int i = 0; i != 2; ++i) {
+        compact.normal[i] = quantize_snorm16(normal[i]);
+        compact.tangent[i] = quantize_snorm16(tangent[i]);
+        compact.uv[i] = glm::packHalf1x16(vertex.uv[i]);
+    }
+    return compact;
+}
+
+bool has_vertex_colors(Span<const Vertex> vertices) {
+    for (const Vertex& vertex : vertices) {
+        if (vertex.color != glm::vec3(1.0f)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <utils.h>
+#include <Vertex.h>
+#include <AABB.h>
+
+#include <vector>
+
+namespace OM3D {
+
+enum class AttributeType {
+    Float,
+    HalfFloat,
+    UNorm8,
+    UNorm16,
+    SNorm16,
+};
+
+// One shader input of a mesh, read from a vertex buffer ("stream") at a fixed offset
+struct VertexAttribute {
+    u32 location = 0;
+    u32 stream = 0;
+    u32 components = 0;
+    AttributeType type = AttributeType::Float;
+    u32 offset = 0;
+
+    bool operator==(const VertexAttribute& other) const {
+        return location == other.location && stream == other.stream &&
+               components == other.components && type == other.type && offset == other.offset;
+    }
+};
+
+// Quantized vertex, 20 bytes instead of the 60 of Vertex:
+//  - position: unorm16 relative to the mesh bounds, w holds the bitangent sign
+//  - normal and tangent: octahedral encoded, snorm16 each
+//  - uv: half floats
+// Colors live in their own unorm8 stream, which is left out when every vertex is white.
+struct CompactVertex {
+    u16 position[4];
+    i16 normal[2];
+    i16 tangent[2];
+    u16 uv[2];
+};
+
+static_assert(sizeof(CompactVertex) == 20);
+
+// Describes how the vertex shader inputs are read from the vertex buffers of a mesh.
+// Locations 0 to 4 are position, normal, uv, tangent and color, like in Vertex.
+class VertexFormat {
+
+    public:
+        static constexpr u32 max_streams = 2;
+        static constexpr u32 attribute_count = 5;
+        static constexpr u32 color_location = 4;
+
+        // Vertex as is, in a single stream
+        static VertexFormat standard();
+        // CompactVertex in stream 0 and unorm8 colors in stream 1 if has_colors is set
+        static VertexFormat compact(bool has_colors);
+
+        // Position attribute alone in stream 0, with the same encoding, for depth only passes
+        VertexFormat positions_only() const;
+
+        bool is_compact() const;
+        u32 stream_count() const;
+        u32 stride(u32 stream) const;
+        u32 vertex_size() const;
+
+        bool operator==(const VertexFormat& other) const;
+
+        // Setup the attributes read from a stream, its buffer must be bound as attribute buffer
+        void bind_stream(u32 stream) const;
+        // Attributes that no stream provides are disabled, color reads white instead
+        void bind_defaults() const;
+
+    private:
+        void add(u32 location, u32 stream, u32 components, AttributeType type);
+        bool has_attribute(u32 location) const;
+
+        std::vector<VertexAttribute> _attributes;
+        u32 _strides[max_streams] = {};
+        u32 _stream_count = 0;
+        bool _compact = false;
+};
+
+// Maps the positions of the mesh bounds to [0, 1], the shader applies the inverse
+struct PositionQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+
+    static PositionQuantization from_bounds(const AABB& bounds);
+};
+
+glm::vec2 octahedral_encode(const glm::vec3& n);
+glm::vec3 octahedral_decode(const glm::vec2& e);
+
+CompactVertex compact_vertex(const Vertex& vertex, const PositionQuantization& quantization);
+// Returns false if every vertex has the default white color
+bool has_vertex_colors(Span<const Vertex> vertices);
+
+}
+
+#endif // VERTEXFORMAT_H
@@ -47,6 +47,8 @@ enum class BufferUsage {
     Index,
     Uniform,
     Storage,
+    Indirect,
+    PixelUnpack,
 };
 
 enum class AccessType {
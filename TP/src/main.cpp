@@ -8,6 +8,7 @@
 
 #include <graphics.h>
 #include <SceneView.h>
+#include <SceneLoader.h>
 #include <Texture.h>
 #include <Framebuffer.h>
 #include <ImGuiRenderer.h>
@@ -20,6 +21,9 @@ using namespace OM3D;
 static float delta_time = 0.0f;
 const glm::uvec2 window_size(800, 500);
 
+// Bytes of scene geometry and textures uploaded per frame while a scene loads in the background
+static constexpr size_t scene_upload_budget = 8 << 20;
+
 void glfw_check(bool cond) {
     if (!cond) {
         const char* err = nullptr;
@@ -95,30 +99,29 @@ std::unique_ptr<Scene> create_default_scene() {
     auto result = Scene::from_gltf(std::string(data_path) + "cube.glb");
     ALWAYS_ASSERT(result.is_ok, "Unable to load default scene");
     scene = std::move(result.value);
-    auto& object = scene->_objects[0];
+    const glm::mat4 base = scene->local_transform(scene->object(0));
 
+    // Every cube shares the same geometry and is drawn in one instanced batch
+    const auto cube = std::make_shared<StaticMesh>(StaticMesh::CubeMesh());
     for (int i = -1; i <= 1; i++) {
         for (int j = -1; j <= 1; j++) {
             for (int k = -1; k <= 1; k++) {
                 if (i == 0 && j == 0 && k == 0) continue;
-                auto obj1 = SceneObject(std::make_shared<StaticMesh>(StaticMesh::CubeMesh()),
-                                        Material::empty_material());
-                obj1.set_transform(
-                    glm::translate(object.transform(), {i * 4.0f, j * 4.0f, k * 4.0f}));
+                auto obj1 = SceneObject(cube, Material::empty_material());
+                obj1.set_transform(glm::translate(base, {i * 4.0f, j * 4.0f, k * 4.0f}));
                 scene->add_object(std::move(obj1));
             }
         }
     }
 
-    auto obj1 = SceneObject(std::make_shared<StaticMesh>(StaticMesh::CubeMesh()),
-                            Material::empty_material());
-    obj1.set_transform(glm::translate(glm::scale(object.transform(), glm::vec3(4.0f, 4.0f, 4.0f)),
+    auto obj1 = SceneObject(cube, Material::empty_material());
+    obj1.set_transform(glm::translate(glm::scale(base, glm::vec3(4.0f, 4.0f, 4.0f)),
                                       {7.0f, 0.0f, 0.0f}));
     scene->add_object(std::move(obj1));
 
     auto obj2 = SceneObject(Scene::meshFromGltf(std::string(data_path) + "sphere.glb").value,
                             Material::empty_material());
-    obj2.set_transform(glm::translate(glm::scale(object.transform(), glm::vec3(4.0f, 4.0f, 4.0f)),
+    obj2.set_transform(glm::translate(glm::scale(base, glm::vec3(4.0f, 4.0f, 4.0f)),
                                       {5.0f, 0.0f, 0.0f}));
     obj2.mark = true;
     scene->add_object(std::move(obj2));
@@ -184,6 +187,7 @@ int main(int, char**) {
 
     std::unique_ptr<Scene> scene = create_default_scene();
     SceneView scene_view(scene.get());
+    SceneLoader scene_loader;
 
     auto tonemap_program = Program::from_file("tonemap.comp");
 
@@ -211,6 +215,8 @@ int main(int, char**) {
     int occDebugMode = 0;
     int gBufferRenderMode = 0;
     bool renderSpheres = false;
+    bool depthPrepass = false;
+    int texture_budget_mb = 256;
 
     for (;;) {
         glfwPollEvents();
@@ -220,6 +226,12 @@ int main(int, char**) {
 
         update_delta_time();
 
+        // The current scene is rendered until the new one is fully uploaded
+        if (auto loaded = scene_loader.update(scene_upload_budget)) {
+            scene = std::move(loaded);
+            scene_view = SceneView(scene.get());
+        }
+
         if (taa_enabled) {
             history_current = !history_current;
             taaBuffer.replace_texture(1, &color_history[history_current]);
@@ -239,19 +251,29 @@ int main(int, char**) {
         }
 
         // Render the scene to the gbuffer
+        scene->animate(program_time());
         scene->moveObjects(program_time(), [](double t) {
             return glm::vec3(0.0f, 0.02f, 0.0f) * (sin(t / 10.0f * 2 * M_PI - M_PI_2) > 0 ? 1.0f : -1.0f);
         });
         scene->sortObjects(scene_view.camera());
-        if (gBufferRenderMode == 0) {
+        scene->set_software_occlusion(gBufferRenderMode == 2);
+        if (gBufferRenderMode != 1) {
             gBuffer.bind();
             velocity.clear_with(0.0f, 0.0f);
+            if (depthPrepass) {
+                scene_view.renderDepth();
+            }
             scene_view.render();
         } else {
             gBuffer.bind();
             scene_view.renderOcclusion(occDebugMode);
         }
 
+        if (scene->streams_textures()) {
+            scene->texture_streamer().set_budget(size_t(texture_budget_mb) << 20);
+        }
+        scene->update_textures();
+
         if (gDebugMode == 1) {
             gdebug_program1->bind();
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -308,17 +330,18 @@ int main(int, char**) {
             char buffer[1024] = {};
             if (ImGui::InputText("Load scene", buffer, sizeof(buffer),
                                  ImGuiInputTextFlags_EnterReturnsTrue)) {
-                auto result = Scene::from_gltf(buffer);
-                if (!result.is_ok) {
-                    std::cerr << "Unable to load scene (" << buffer << ")" << std::endl;
-                } else {
-                    scene = std::move(result.value);
-                    scene_view = SceneView(scene.get());
+                if (!scene_loader.load(buffer)) {
+                    std::cerr << "Already loading " << scene_loader.file_name() << std::endl;
                 }
             }
+            if (scene_loader.is_loading()) {
+                ImGui::Text("Loading %s...", scene_loader.file_name().c_str());
+            }
             ImGui::Text("Prepass");
             ImGui::RadioButton("Classic prepass", &gBufferRenderMode, 0);
             ImGui::RadioButton("Occlusion culling prepass", &gBufferRenderMode, 1);
+            ImGui::RadioButton("Software occlusion culling prepass", &gBufferRenderMode, 2);
+            ImGui::Checkbox("Depth only prepass", &depthPrepass);
             ImGui::Text("Display mode");
             ImGui::RadioButton("Normal display", &gDebugMode, 0);
             ImGui::RadioButton("Display Gbuffer albedo", &gDebugMode, 1);
@@ -330,6 +353,12 @@ int main(int, char**) {
             ImGui::RadioButton("Display occludees in red", &occDebugMode, 1);
             ImGui::Text("TAA");
             ImGui::Checkbox("Enable TAA", &taa_enabled);
+            if (scene->streams_textures()) {
+                ImGui::Text("Textures");
+                ImGui::SliderInt("Texture budget (MB)", &texture_budget_mb, 16, 2048);
+                ImGui::Text("Resident: %.1f MB",
+                            double(scene->texture_streamer().resident_size()) / (1 << 20));
+            }
         }
         imgui.finish();
 
@@ -337,6 +366,5 @@ int main(int, char**) {
         ++frame_counter;
     }
 
-    scene->deleteQueries();
     scene = nullptr; // destroy scene and child OpenGL objects
 }